@@ -0,0 +1,105 @@
+// Host benchmark of the telemetry ring (include/spsc_ring.h).
+//   make -C host && host/build/bench_spsc
+// Reports the cost of push() alone (into a ring big enough for a whole
+// batch, drained outside the timed region), push() with a batch pop every
+// TELEMETRY_ISR_EVENTS, push()+pop() on one thread, and the throughput with the producer and the consumer on two threads, counted
+// at the consumer: every event is delivered, the producer retries a push
+// into a full ring (the retries are reported, not counted as events).
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include "spsc_ring.h"
+#include "telemetry.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint32_t ITERATIONS = 20000000;
+static const uint32_t PUSH_BATCH = 4096;
+
+static double nsPer(Clock::time_point t0, Clock::time_point t1, uint32_t n) {
+  return std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+}
+
+int main() {
+  static SpscRing<TelemetryEvent, TELEMETRY_ISR_EVENTS> ring;
+  TelemetryEvent ev = {0, TEL_PHASE, 0, 0, 0};
+  TelemetryEvent out = ev;
+  uint64_t check = 0;
+
+  // push() alone: PUSH_BATCH pushes never fill the big ring. One untimed
+  // round first, so the pages are mapped.
+  static SpscRing<TelemetryEvent, PUSH_BATCH * 2> big;
+  double push_ns = 0;
+  for (uint32_t round = 0; round <= ITERATIONS / PUSH_BATCH; round++) {
+    Clock::time_point t0 = Clock::now();
+    for (uint32_t i = 0; i < PUSH_BATCH; i++) {
+      ev.timeUs = i;
+      big.push(ev);
+    }
+    Clock::time_point t1 = Clock::now();
+    if (round > 0) push_ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    while (big.pop(out)) check += out.timeUs;
+  }
+  std::printf("push           : %6.2f ns/event\n", push_ns / (ITERATIONS / PUSH_BATCH * PUSH_BATCH));
+
+  // push() into a ring that is drained every capacity() pushes.
+  Clock::time_point t0 = Clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    ev.timeUs = i;
+    ring.push(ev);
+    if ((i & (TELEMETRY_ISR_EVENTS - 1)) == TELEMETRY_ISR_EVENTS - 1) {
+      while (ring.pop(out)) check += out.timeUs;
+    }
+  }
+  Clock::time_point t1 = Clock::now();
+  std::printf("push+batch pop : %6.2f ns/event\n", nsPer(t0, t1, ITERATIONS));
+
+  t0 = Clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    ev.timeUs = i;
+    ring.push(ev);
+    ring.pop(out);
+    check += out.timeUs;
+  }
+  t1 = Clock::now();
+  std::printf("push+pop       : %6.2f ns/event\n", nsPer(t0, t1, ITERATIONS));
+
+  // Two threads: the producer spins on a full ring, so the rate is what
+  // the consumer takes out.
+  uint32_t dropped_before = ring.dropped();
+  uint64_t received = 0;
+  bool done = false;
+  std::atomic<bool> producer_done(false);
+  std::thread consumer([&]() {
+    TelemetryEvent e;
+    while (!done) {
+      if (ring.pop(e)) {
+        received++;
+      } else if (producer_done.load(std::memory_order_acquire)) {
+        done = !ring.pop(e);
+        if (!done) received++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  t0 = Clock::now();
+  for (uint32_t i = 0; i < ITERATIONS; i++) {
+    ev.timeUs = i;
+    while (!ring.push(ev)) std::this_thread::yield();
+  }
+  producer_done.store(true, std::memory_order_release);
+  consumer.join();
+  t1 = Clock::now();
+  uint32_t retries = ring.dropped() - dropped_before;
+  std::printf("2 threads      : %6.2f ns/event, %.1f M events/s received, %u full-ring retries\n",
+              nsPer(t0, t1, ITERATIONS), ITERATIONS / std::chrono::duration<double, std::micro>(t1 - t0).count(),
+              retries);
+
+  if (received != ITERATIONS) {
+    std::printf("event count mismatch\n");
+    return 1;
+  }
+  return check == 0 ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+// Streaming decoder for the binary telemetry log (include/binlog.h).
+//   make -C host
+//   host/build/binlog_decode [capture.bin] > log.csv
+//   host/build/binlog_decode -c run1 capture.bin
+// CSV rows are time_us,type,a,b,value like the firmware's CSV mode, with
+// time unwrapped to 64 bits. A sample block becomes one row per sample:
+// type 128, a = index in the block, value = raw sample.
+// -c <prefix> writes the same rows as little endian columns instead:
+// <prefix>.time.u64 .type.u8 .a.u8 .b.u16 .value.i32 (numpy.fromfile).
+// Bytes outside valid frames (text printed by the sketch, line noise) are
+// skipped and counted as bad frames; the summary goes to stderr.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "binlog.h"
+#include "command.h"
+
+static const size_t IO_BUF = 1 << 20;
+
+// Buffered writer, fwrite() once per IO_BUF bytes.
+class Out {
+ public:
+  explicit Out(FILE *f) : f_(f), buf_(IO_BUF), n_(0) {}
+  ~Out() { flush(); }
+  void flush() {
+    if (n_ > 0) fwrite(buf_.data(), 1, n_, f_);
+    n_ = 0;
+  }
+  void reserve(size_t n) {
+    if (n_ + n > buf_.size()) flush();
+  }
+  void put(const void *p, size_t n) {
+    reserve(n);
+    memcpy(&buf_[n_], p, n);
+    n_ += n;
+  }
+  void chr(char c) { buf_[n_++] = c; }
+  void u64(uint64_t v) {
+    char tmp[20];
+    int i = 0;
+    do {
+      tmp[i++] = (char)('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (i) buf_[n_++] = tmp[--i];
+  }
+  void i64(int64_t v) {
+    if (v < 0) {
+      chr('-');
+      u64((uint64_t)0 - (uint64_t)v);
+    } else {
+      u64((uint64_t)v);
+    }
+  }
+
+ private:
+  FILE *f_;
+  std::vector<char> buf_;
+  size_t n_;
+};
+
+struct Sink {
+  virtual ~Sink() {}
+  virtual void row(uint64_t t, uint8_t type, uint8_t a, uint16_t b, int32_t value) = 0;
+};
+
+struct CsvSink : Sink {
+  Out out;
+  explicit CsvSink(FILE *f) : out(f) {}
+  void row(uint64_t t, uint8_t type, uint8_t a, uint16_t b, int32_t value) override {
+    out.reserve(64);
+    out.u64(t);
+    out.chr(',');
+    out.u64(type);
+    out.chr(',');
+    out.u64(a);
+    out.chr(',');
+    out.u64(b);
+    out.chr(',');
+    out.i64(value);
+    out.chr('\n');
+  }
+};
+
+struct ColumnSink : Sink {
+  FILE *files[5];
+  Out *cols[5];
+  bool ok;
+  explicit ColumnSink(const char *prefix) : ok(true) {
+    static const char *const ext[5] = {".time.u64", ".type.u8", ".a.u8", ".b.u16", ".value.i32"};
+    for (int i = 0; i < 5; i++) {
+      std::string name = std::string(prefix) + ext[i];
+      files[i] = fopen(name.c_str(), "wb");
+      if (!files[i]) {
+        perror(name.c_str());
+        ok = false;
+      }
+      cols[i] = files[i] ? new Out(files[i]) : 0;
+    }
+  }
+  ~ColumnSink() override {
+    for (int i = 0; i < 5; i++) {
+      delete cols[i];
+      if (files[i]) fclose(files[i]);
+    }
+  }
+  void row(uint64_t t, uint8_t type, uint8_t a, uint16_t b, int32_t value) override {
+    cols[0]->put(&t, sizeof(t)); // the host is little endian
+    cols[1]->put(&type, 1);
+    cols[2]->put(&a, 1);
+    cols[3]->put(&b, sizeof(b));
+    cols[4]->put(&value, sizeof(value));
+  }
+};
+
+struct Stats {
+  uint64_t bytes, frames, replies, bad_frames, records, skipped;
+};
+
+class Decoder {
+ public:
+  explicit Decoder(Sink &sink)
+      : sink_(sink), oversize_(false), have_time_(false), last32_(0), time64_(0) {
+    memset(&stats, 0, sizeof(stats));
+    frame_.reserve(BINLOG_FRAME_MAX);
+  }
+
+  void feed(const uint8_t *p, size_t n) {
+    stats.bytes += n;
+    const uint8_t *end = p + n;
+    while (p < end) {
+      const uint8_t *zero = (const uint8_t *)memchr(p, 0, end - p);
+      if (!zero) {
+        append(p, end - p);
+        return;
+      }
+      append(p, zero - p);
+      frameDone();
+      p = zero + 1;
+    }
+  }
+
+  Stats stats;
+
+ private:
+  void append(const uint8_t *p, size_t n) {
+    // Anything longer than a frame is not one, keep only the count.
+    if (frame_.size() + n > BINLOG_FRAME_MAX) {
+      stats.skipped += frame_.size() + n;
+      frame_.clear();
+      oversize_ = true;
+      return;
+    }
+    if (!oversize_) frame_.insert(frame_.end(), p, p + n);
+    else stats.skipped += n;
+  }
+
+  void frameDone() {
+    if (oversize_ || frame_.empty()) {
+      oversize_ = false;
+      frame_.clear();
+      return;
+    }
+    size_t n = cobsDecode(frame_.data(), frame_.size(), frame_.data());
+    bool crc_ok = n >= 3 && binlogCrc16(frame_.data(), n - 2) ==
+                                (uint16_t)(frame_[n - 2] | frame_[n - 1] << 8);
+    if (crc_ok && frame_[0] == CMD_REPLY) {
+      stats.replies++; // answer to a command (command.h), not telemetry
+    } else if (!crc_ok || frame_[0] != BINLOG_VERSION ||
+               !parse(frame_.data() + 1, frame_.data() + n - 2)) {
+      stats.bad_frames++;
+      stats.skipped += frame_.size();
+    } else {
+      stats.frames++;
+    }
+    frame_.clear();
+  }
+
+  uint64_t unwrap(uint32_t t) {
+    if (have_time_) {
+      time64_ += (int64_t)(int32_t)(t - last32_);
+    } else {
+      time64_ = t;
+      have_time_ = true;
+    }
+    last32_ = t;
+    return time64_;
+  }
+
+  // Two passes, so a frame that fails half way emits no rows at all.
+  bool parse(const uint8_t *p, const uint8_t *end) {
+    for (int emit = 0; emit < 2; emit++) {
+      const uint8_t *q = p;
+      uint32_t time = 0;
+      while (q < end) {
+        uint8_t type = *q++;
+        uint32_t dt, a, b, v, count;
+        if (!(q = varintGet(q, end, &dt))) return false;
+        time += (uint32_t)zigzagDecode(dt);
+        if (type == BINLOG_SAMPLES) {
+          if (!(q = varintGet(q, end, &count)) || count > TEL_SAMPLES_MAX) return false;
+          uint64_t t = emit ? unwrap(time) : 0;
+          int32_t sample = 0;
+          for (uint32_t i = 0; i < count; i++) {
+            if (!(q = varintGet(q, end, &v))) return false;
+            sample += zigzagDecode(v);
+            if (emit) sink_.row(t, BINLOG_SAMPLES, (uint8_t)i, 0, sample);
+          }
+        } else {
+          if (!(q = varintGet(q, end, &a)) || !(q = varintGet(q, end, &b)) ||
+              !(q = varintGet(q, end, &v))) {
+            return false;
+          }
+          if (emit) sink_.row(unwrap(time), type, (uint8_t)a, (uint16_t)b, zigzagDecode(v));
+        }
+        if (emit) stats.records++;
+      }
+    }
+    return true;
+  }
+
+  Sink &sink_;
+  std::vector<uint8_t> frame_;
+  bool oversize_;
+  bool have_time_;
+  uint32_t last32_;
+  uint64_t time64_;
+};
+
+int main(int argc, char **argv) {
+  const char *prefix = 0;
+  const char *path = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      prefix = argv[++i];
+    } else if (argv[i][0] == '-' && argv[i][1] != 0) {
+      fprintf(stderr, "usage: %s [-c prefix] [capture.bin]\n", argv[0]);
+      return 2;
+    } else {
+      path = argv[i];
+    }
+  }
+
+  FILE *in = path && strcmp(path, "-") != 0 ? fopen(path, "rb") : stdin;
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+
+  Sink *sink;
+  if (prefix) {
+    ColumnSink *cols = new ColumnSink(prefix);
+    if (!cols->ok) return 1;
+    sink = cols;
+  } else {
+    sink = new CsvSink(stdout);
+  }
+
+  Decoder dec(*sink);
+  std::vector<uint8_t> buf(IO_BUF);
+  size_t n;
+  while ((n = fread(buf.data(), 1, buf.size(), in)) > 0) {
+    dec.feed(buf.data(), n);
+  }
+  delete sink;
+  if (in != stdin) fclose(in);
+
+  fprintf(stderr,
+          "%llu bytes, %llu frames, %llu records, %llu command replies, %llu bad frames, "
+          "%llu bytes skipped\n",
+          (unsigned long long)dec.stats.bytes, (unsigned long long)dec.stats.frames,
+          (unsigned long long)dec.stats.records, (unsigned long long)dec.stats.replies,
+          (unsigned long long)dec.stats.bad_frames,
+          (unsigned long long)dec.stats.skipped);
+  return 0;
+}
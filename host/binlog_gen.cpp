@@ -0,0 +1,100 @@
+// Round-trip check of the binary log (include/binlog.h): writes a capture
+// of pseudo-random events and sample blocks the way the firmware's drain
+// does (a record that does not fit sends the frame and starts the next
+// one), with text and a command reply between frames, and prints the CSV
+// binlog_decode must produce from it.
+//   make -C host binlog-check
+//   host/build/binlog_gen capture.bin [records] > expected.csv
+// The values cover the edges: time wrapping at 2^32 and stepping back a
+// little between the rings, 0 and full-range a/b/value, empty and full
+// sample blocks with full-scale steps.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "binlog.h"
+#include "command.h"
+
+static FILE *capture;
+static BinlogWriter w;
+static uint64_t frames = 0;
+
+static void sendFrame() {
+  uint8_t out[BINLOG_FRAME_MAX];
+  fwrite(out, 1, binlogFinish(w, out), capture);
+  binlogBegin(w);
+  // Every 16th frame, text of the sketch or a command reply in between.
+  if (++frames % 16 == 0) fputs("\r\nlog,3,1,1,2,5,1000,20\r\n", capture);
+  if (frames % 16 == 8) {
+    BinlogWriter r;
+    uint8_t out2[BINLOG_FRAME_MAX];
+    r.payload[0] = CMD_REPLY;
+    r.payload[1] = 1;
+    r.payload[2] = CMD_PING;
+    r.payload[3] = CMD_OK;
+    r.len = 4;
+    fwrite(out2, 1, binlogFinish(r, out2), capture);
+  }
+}
+
+static uint32_t rnd() {
+  return (uint32_t)rand() << 16 ^ (uint32_t)rand();
+}
+
+static int32_t pick(int32_t lo, int32_t hi) {
+  switch (rand() % 8) {
+    case 0: return lo;
+    case 1: return hi;
+    case 2: return 0;
+    default: return (int32_t)((int64_t)lo + (int64_t)(rnd() % ((uint64_t)hi - lo + 1)));
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s capture.bin [records] > expected.csv\n", argv[0]);
+    return 2;
+  }
+  long records = argc > 2 ? atol(argv[2]) : 200000;
+  capture = fopen(argv[1], "wb");
+  if (!capture) {
+    perror(argv[1]);
+    return 1;
+  }
+  srand(1);
+  uint64_t time = 0xFFF00000ULL; // wraps 2^32 after about a second
+  binlogBegin(w);
+  for (long i = 0; i < records; i++) {
+    time += rnd() % 5000;
+    // Samples come from their own ring and may be a little behind.
+    uint64_t t = time - (rand() % 4 == 0 ? rnd() % 2000 : 0);
+    if (t < 0xFFF00000ULL) t = 0xFFF00000ULL;
+    if (rand() % 3 == 0) {
+      TelemetrySamples s;
+      s.timeUs = (uint32_t)t;
+      s.count = (uint8_t)(rand() % (TEL_SAMPLES_MAX + 1));
+      for (int k = 0; k < s.count; k++) s.samples[k] = (int16_t)pick(-32768, 32767);
+      if (!binlogSamples(w, s.timeUs, s.samples, s.count)) {
+        sendFrame();
+        binlogSamples(w, s.timeUs, s.samples, s.count);
+      }
+      for (int k = 0; k < s.count; k++) {
+        printf("%llu,%d,%d,0,%d\n", (unsigned long long)t, BINLOG_SAMPLES, k, s.samples[k]);
+      }
+    } else {
+      TelemetryEvent ev;
+      ev.timeUs = (uint32_t)t;
+      ev.type = (uint8_t)(1 + rand() % 10);
+      ev.a = (uint8_t)pick(0, 255);
+      ev.b = (uint16_t)pick(0, 65535);
+      ev.value = pick(INT32_MIN, INT32_MAX);
+      if (!binlogEvent(w, ev)) {
+        sendFrame();
+        binlogEvent(w, ev);
+      }
+      printf("%llu,%u,%u,%u,%d\n", (unsigned long long)t, ev.type, ev.a, ev.b, ev.value);
+    }
+  }
+  if (w.len > 1) sendFrame();
+  return fclose(capture) == 0 ? 0 : 1;
+}
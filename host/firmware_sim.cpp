@@ -0,0 +1,473 @@
+// Host build of the whole firmware (src/main.cpp and the portable modules)
+// on a virtual clock, see sim/sim.h. The peripheral drivers are replaced at
+// their headers by sim/sim_*.cpp, the flash log runs on nvmc_sim.cpp.
+// The button is pressed whenever the sketch is idle, so a run goes through
+// the start-up wait, the debug run and then one stage per press. MOTOR_UI
+// reads the pump model (sim/sim_plant.h), which also gives the vacuum
+// reached by every cycle. firmware_sim_pt is the same with -DPHASE_TIMING
+// and prints the timing histograms (phase_timing.h) after the run.
+//   make -C host && host/build/firmware_sim [options]
+//   -s n      stage runs (button presses), default 18
+//   -m 0|1    pump_mode (0 swing, 1 solo)
+//   -n        no debug run at start-up
+//   -c        control_mode 1 (closed loop, targets taught on the way)
+//   -k        calib_mode 1 (one press calibrates every stage)
+//   -H        handoff_mode 0 (gap and solenoid timed in software)
+//   -t        CSV telemetry instead of binlog frames
+//   -o file   serial output (binlog frames: host/build/binlog_decode file)
+//   -e file   pin edges as CSV: t_ns,pin,name,kind,value,top
+//   -r file   pin trace (sim/trace.h), see trace_tool
+//   -p file   vacuum per cycle as CSV: cycle,open_s,peak_mmhg,charge_mas
+//   -L        plain resistive load on MOTOR_UI instead of the pump model
+//   -T list   calibration targets of pump_mode, 18 comma separated raw
+//             charges (0 = none), sent as CMD_SET_TARGETS at start-up
+//   -u n      before press n, upload pump_mode's profile with every
+//             build-up 10 ms longer, activate it and query it back once
+//             active; exits 1 unless the replies match and the charge
+//             targets taught so far were cleared (make -C host profile-check)
+//   -A        exits 1 if any current sample of a drive falls after the
+//             on-time of its period (make -C host sample-check)
+//   -D list   custom drive for every stage run (seqSetDrive()), segments
+//             cycles:from:to in PWM ticks, comma separated, the first one
+//             starting above 0; exits 1 unless every drive plays those
+//             on-times period by period, then 0%, and every refilled
+//             chunk lasts WAVE_FLAT_MIN periods (make -C host drive-check)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include <Arduino.h>
+#include "sim.h"
+#include "trace.h"
+#include "sim_plant.h"
+#include "nvmc_sim.h"
+#include "pins.h"
+#include "sequencer.h"
+#include "waveform.h"
+#include "binlog.h"
+#include "command.h"
+#include "target_store.h"
+#include "profile_store.h"
+#include "phase_timing.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// main.cpp
+void setup();
+void loop();
+extern int pump_mode;
+extern int debug_mode;
+extern int handoff_mode;
+extern int control_mode;
+extern int calib_mode;
+extern int binary_log;
+extern volatile bool start_pending;
+extern volatile int calib_stage;
+extern uint32_t charge_target[2][PROFILE_STAGES];
+
+#define SIM_PRESS_MS 100       // short press, well under LONG_PRESS_MS
+#define SIM_PRESS_DELAY_MS 200 // from idle to the press
+#define SIM_TAIL_MS 100        // after the last run, telemetry drains
+#define SIM_LIMIT_S 3600       // virtual time limit of a run
+
+static bool finished = false;
+static bool press_in_flight = false;
+
+static void press() {
+  uint64_t t = simNowNs() + SIM_PRESS_DELAY_MS * 1000000ULL;
+  simAt(t, []() { simPinInput(BUTTON, true); });
+  simAt(t + SIM_PRESS_MS * 1000000ULL, []() { simPinInput(BUTTON, false); });
+  press_in_flight = true;
+}
+
+// A request frame (command.h) into the serial input delayMs from now,
+// returns its seq. It arrives as an event, as the UART interrupt would wake
+// an idle sketch.
+static uint8_t sendCommand(uint8_t cmd, const uint8_t *arg, size_t len, uint32_t delayMs = 0) {
+  static uint8_t seq = 0;
+  BinlogWriter w;
+  w.payload[0] = cmd;
+  w.payload[1] = ++seq;
+  memcpy(w.payload + 2, arg, len);
+  w.len = (uint16_t)(2 + len);
+  std::vector<uint8_t> out(BINLOG_FRAME_MAX);
+  out.resize(binlogFinish(w, out.data()));
+  simAt(simNowNs() + delayMs * 1000000ULL, [out]() { simSerialInput(out.data(), out.size()); });
+  return seq;
+}
+
+// Upload test (-u): the profile sent and the seq of every request.
+struct UploadTest {
+  int beforePress = -1;
+  bool sent = false;
+  bool queried = false;
+  bool taught = false; // some target was taught before the activation
+  bool cleared = false;
+  PumpProfile profile;
+  uint8_t uploadSeq, activateSeq, querySeq;
+};
+
+static void uploadProfile(UploadTest &u) {
+  u.profile = profileActive(pump_mode);
+  for (int i = 0; i < PROFILE_STAGES; i++) u.profile.buildUpMs[i] += 10;
+  uint8_t arg[1 + PROFILE_WIRE_SIZE];
+  arg[0] = (uint8_t)pump_mode;
+  profileSerialize(u.profile, arg + 1);
+  u.uploadSeq = sendCommand(CMD_UPLOAD, arg, sizeof(arg));
+  uint16_t crc = profileCrc(u.profile);
+  uint8_t act[3] = {(uint8_t)pump_mode, (uint8_t)crc, (uint8_t)(crc >> 8)};
+  u.activateSeq = sendCommand(CMD_ACTIVATE, act, sizeof(act));
+  for (int i = 0; i < PROFILE_STAGES; i++) u.taught |= charge_target[pump_mode][i] != 0;
+  u.sent = true;
+  // The activation is applied right away, the sketch being idle. By the
+  // time the query arrives the taught targets must be gone.
+  uint8_t mode = (uint8_t)pump_mode;
+  u.querySeq = sendCommand(CMD_QUERY, &mode, 1, SIM_PRESS_DELAY_MS);
+  simAt(simNowNs() + SIM_PRESS_DELAY_MS * 1000000ULL, [&u]() {
+    u.cleared = profileSource(pump_mode) == PROFILE_UPLOADED;
+    for (int i = 0; i < PROFILE_STAGES; i++) u.cleared &= charge_target[pump_mode][i] == 0;
+    u.queried = true;
+  });
+}
+
+// Reply frames (command.h) in the serial output: payload without the CRC,
+// indexed by seq.
+static void readReplies(FILE *f, std::vector<std::vector<uint8_t>> &replies) {
+  replies.assign(256, std::vector<uint8_t>());
+  rewind(f);
+  std::vector<uint8_t> frame;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    if (c != 0) {
+      frame.push_back((uint8_t)c);
+      continue;
+    }
+    size_t n = frame.empty() ? 0 : cobsDecode(frame.data(), frame.size(), frame.data());
+    if (n >= 6 && frame[0] == CMD_REPLY &&
+        binlogCrc16(frame.data(), n - 2) == (uint16_t)(frame[n - 2] | frame[n - 1] << 8)) {
+      replies[frame[1]].assign(frame.begin(), frame.begin() + (n - 2));
+    }
+    frame.clear();
+  }
+}
+
+static bool replyOk(const std::vector<uint8_t> &r, uint8_t cmd, const char *what) {
+  if (r.size() >= 4 && r[2] == cmd && r[3] == CMD_OK) return true;
+  fprintf(stderr, "profile upload: %s got %s\n", what, r.empty() ? "no reply" : "an error");
+  return false;
+}
+
+static bool checkUpload(FILE *serial, const UploadTest &u) {
+  if (!u.queried) {
+    fprintf(stderr, "profile upload: never sent\n");
+    return false;
+  }
+  std::vector<std::vector<uint8_t>> replies;
+  readReplies(serial, replies);
+  if (!replyOk(replies[u.uploadSeq], CMD_UPLOAD, "upload") ||
+      !replyOk(replies[u.activateSeq], CMD_ACTIVATE, "activate") ||
+      !replyOk(replies[u.querySeq], CMD_QUERY, "query")) {
+    return false;
+  }
+  const std::vector<uint8_t> &q = replies[u.querySeq];
+  uint8_t wire[PROFILE_WIRE_SIZE];
+  profileSerialize(u.profile, wire);
+  uint16_t crc = profileCrc(u.profile);
+  if (q.size() != 7 + PROFILE_WIRE_SIZE || q[4] != PROFILE_UPLOADED || q[5] != (uint8_t)crc ||
+      q[6] != (uint8_t)(crc >> 8) || memcmp(q.data() + 7, wire, PROFILE_WIRE_SIZE) != 0) {
+    fprintf(stderr, "profile upload: query does not return the uploaded profile\n");
+    return false;
+  }
+  if (!u.cleared) {
+    fprintf(stderr, "profile upload: not activated, or the charge targets not cleared\n");
+    return false;
+  }
+  printf("profile upload: ok (crc %04x, %s)\n", crc,
+         u.taught ? "taught targets cleared" : "no targets taught before");
+  return true;
+}
+
+static bool parseTargets(const char *s, uint8_t *wire) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    char *end;
+    unsigned long v = strtoul(s, &end, 10);
+    if (end == s || (*end != (i + 1 < PROFILE_STAGES ? ',' : 0))) return false;
+    for (int k = 0; k < 4; k++) wire[4 * i + k] = (uint8_t)(v >> (8 * k));
+    s = end + 1;
+  }
+  return true;
+}
+
+static int parseDrive(const char *s, WaveSegment *segs) {
+  int n = 0;
+  while (n < WAVE_MAX_SEGMENTS) {
+    unsigned long v[3];
+    for (int k = 0; k < 3; k++) {
+      char *end;
+      v[k] = strtoul(s, &end, 10);
+      if (end == s || (k < 2 && *end != ':')) return 0;
+      s = k < 2 ? end + 1 : end;
+    }
+    if (v[0] == 0 || v[1] > PWM_TOP || v[2] > PWM_TOP || (n == 0 && v[1] == 0)) return 0;
+    segs[n++] = {(uint32_t)v[0], (uint16_t)v[1], (uint16_t)v[2]};
+    if (*s == 0) return n;
+    if (*s != ',') return 0;
+    s++;
+  }
+  return 0;
+}
+
+// Every MOTOR_PWM drive against segs, one period at a time: a drive starts
+// with the first non zero record after a 0% one. Returns the drives that
+// matched, -1 on the first one that does not.
+static int checkDrives(const WaveSegment *segs, int count) {
+  std::vector<uint16_t> expect;
+  for (int i = 0; i < count; i++) {
+    const WaveSegment &s = segs[i];
+    for (uint32_t pos = 0; pos < s.cycles; pos++) {
+      int32_t span = (int32_t)s.toTicks - (int32_t)s.fromTicks;
+      expect.push_back(s.cycles > 1 ? s.fromTicks + (int64_t)span * pos / (s.cycles - 1) : s.fromTicks);
+    }
+  }
+  expect.push_back(0);
+  std::vector<SimEdge> motor;
+  for (const SimEdge &e : simEdges()) {
+    if (e.pin == MOTOR_PWM && e.kind == SIM_EDGE_PWM) motor.push_back(e);
+  }
+  int drives = 0;
+  for (size_t i = 0; i < motor.size(); i++) {
+    if (motor[i].value == 0 || (i > 0 && motor[i - 1].value != 0)) continue;
+    uint64_t period = (uint64_t)motor[i].top * 1000000000ULL / PWM_HIRES_CLOCK_HZ;
+    size_t j = i;
+    for (size_t k = 0; k < expect.size(); k++) {
+      uint64_t t = motor[i].tNs + k * period;
+      while (j + 1 < motor.size() && motor[j + 1].tNs <= t) j++;
+      if (motor[j].value != expect[k]) {
+        fprintf(stderr, "drive %d: period %zu at %u ticks, expected %u\n", drives, k, motor[j].value,
+                expect[k]);
+        return -1;
+      }
+    }
+    drives++;
+  }
+  return drives;
+}
+
+static bool sketchIdle() {
+  return !seqBusy() && !start_pending && calib_stage < 0 && debug_mode == 0;
+}
+
+static const char *pinName(uint8_t pin) {
+  switch (pin) {
+    case MOTOR_PWM: return "MOTOR_PWM";
+    case SOL_ON_EN: return "SOL_ON_EN";
+    case SOL_ON_PWM: return "SOL_ON_PWM";
+    case BUTTON: return "BUTTON";
+    default: return "";
+  }
+}
+
+static bool writeEdges(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) return false;
+  fprintf(f, "t_ns,pin,name,kind,value,top\n");
+  for (const SimEdge &e : simEdges()) {
+    fprintf(f, "%llu,%u,%s,%s,%u,%u\n", (unsigned long long)e.tNs, e.pin, pinName(e.pin),
+            e.kind == SIM_EDGE_PWM ? "pwm" : "gpio", e.value, e.top);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool writeTrace(const char *path) {
+  Trace t;
+  traceBegin(t);
+  for (const SimEdge &e : simEdges()) {
+    int sig = traceSignal(e.pin);
+    if (sig >= 0) traceAdd(t, {e.tNs, (uint8_t)sig, e.value, e.top});
+  }
+  return traceSave(t, path);
+}
+
+static bool writeCycles(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) return false;
+  fprintf(f, "cycle,open_s,peak_mmhg,charge_mas\n");
+  const std::vector<SimPlantCycle> &cycles = simPlantCycles();
+  for (size_t i = 0; i < cycles.size(); i++) {
+    fprintf(f, "%zu,%.6f,%.2f,%.3f\n", i, cycles[i].openNs / 1e9, cycles[i].peakMmHg,
+            cycles[i].chargeAs * 1000);
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  int stages = 18;
+  const char *serial_path = 0;
+  const char *edges_path = 0;
+  const char *trace_path = 0;
+  const char *cycles_path = 0;
+  bool plant = true;
+  uint8_t targets[1 + TARGET_WIRE_SIZE];
+  bool set_targets = false;
+  UploadTest upload;
+  bool check_samples = false;
+  WaveSegment drive[WAVE_MAX_SEGMENTS];
+  int drive_count = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:m:nckHto:e:r:p:LT:u:AD:")) != -1) {
+    switch (opt) {
+      case 's': stages = atoi(optarg); break;
+      case 'm': pump_mode = atoi(optarg) != 0; break;
+      case 'n': debug_mode = 0; break;
+      case 'c': control_mode = 1; break;
+      case 'k': calib_mode = 1; break;
+      case 'H': handoff_mode = 0; break;
+      case 't': binary_log = 0; break;
+      case 'o': serial_path = optarg; break;
+      case 'e': edges_path = optarg; break;
+      case 'r': trace_path = optarg; break;
+      case 'p': cycles_path = optarg; break;
+      case 'L': plant = false; break;
+      case 'T':
+        set_targets = parseTargets(optarg, targets + 1);
+        if (set_targets) break;
+        fprintf(stderr, "-T needs %d comma separated charges\n", PROFILE_STAGES);
+        return 2;
+      case 'u': upload.beforePress = atoi(optarg); break;
+      case 'A': check_samples = true; break;
+      case 'D':
+        drive_count = parseDrive(optarg, drive);
+        if (drive_count > 0) break;
+        fprintf(stderr, "-D needs up to %d segments cycles:from:to, the first from above 0\n", WAVE_MAX_SEGMENTS);
+        return 2;
+      default:
+        fprintf(stderr, "usage: %s [-s stages] [-m mode] [-n] [-c] [-k] [-H] [-t] [-o serial] [-e edges.csv] [-r run.trc]\n"
+                "       [-p cycles.csv] [-L] [-T targets] [-u press] [-A] [-D drive]\n",
+                argv[0]);
+        return 2;
+    }
+  }
+  // The upload test reads the replies back, into a temporary file if no
+  // -o was given.
+  FILE *serial = 0;
+  if (serial_path) {
+    serial = fopen(serial_path, "w+b");
+    if (!serial) {
+      perror(serial_path);
+      return 1;
+    }
+  } else if (upload.beforePress >= 0) {
+    serial = tmpfile();
+  }
+
+  Clock::time_point t0 = Clock::now();
+  simReset();
+  nvmcSimReset();
+  simSerialOutput(serial);
+  simSetHorizon(SIM_LIMIT_S * 1000000000ULL);
+  if (plant) simPlantBegin(plantDefaults());
+  setup();
+  if (drive_count > 0) seqSetDrive(drive, (uint8_t)drive_count);
+  if (set_targets) {
+    targets[0] = (uint8_t)pump_mode;
+    sendCommand(CMD_SET_TARGETS, targets, sizeof(targets));
+  }
+
+  // A calibration run is one press for the whole table.
+  int presses = calib_mode == 1 ? 1 : stages;
+  int pressed = 0;
+  uint64_t passes = 0;
+  while (!finished && simNowNs() < simHorizon()) {
+    loop();
+    passes++;
+    if (press_in_flight) {
+      if (!sketchIdle()) press_in_flight = false;
+      continue;
+    }
+    if (!sketchIdle()) continue;
+    if (pressed == upload.beforePress && !upload.queried) {
+      if (!upload.sent) uploadProfile(upload);
+      continue;
+    }
+    if (presses > 0) {
+      presses--;
+      pressed++;
+      press();
+    } else {
+      simSetHorizon(simNowNs() + SIM_TAIL_MS * 1000000ULL);
+      simAt(simHorizon(), []() { finished = true; });
+    }
+  }
+  if (plant) simPlantAdvance(simNowNs());
+  double wall_ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+
+  bool upload_ok = upload.beforePress < 0 || checkUpload(serial, upload);
+  if (serial) fclose(serial);
+  if (edges_path && !writeEdges(edges_path)) {
+    perror(edges_path);
+    return 1;
+  }
+  if (trace_path && !writeTrace(trace_path)) {
+    perror(trace_path);
+    return 1;
+  }
+  if (plant && cycles_path && !writeCycles(cycles_path)) {
+    perror(cycles_path);
+    return 1;
+  }
+
+  const std::vector<SimEdge> &edges = simEdges();
+  unsigned long counts[SIM_PINS] = {0};
+  for (const SimEdge &e : edges) counts[e.pin]++;
+  double virtual_s = simNowNs() / 1e9;
+  printf("virtual %.3f s in %.1f ms wall (x%.0f), %llu events, %llu loop passes\n", virtual_s, wall_ms,
+         virtual_s * 1000 / wall_ms, (unsigned long long)simEvents(), (unsigned long long)passes);
+  printf("edges %zu:", edges.size());
+  for (int pin = 0; pin < SIM_PINS; pin++) {
+    if (counts[pin]) printf(" %s %lu", pinName(pin), counts[pin]);
+  }
+  printf("\nserial %llu bytes, flash %u writes %u erases\n", (unsigned long long)simSerialBytesOut(),
+         nvmcSimStats().writes, nvmcSimStats().erases);
+#ifdef PHASE_TIMING
+  simSerialOutput(stdout); // the histograms, as the 't' command prints them
+  PT_DUMP();
+#endif
+  const SimSampleStats &samples = simSampleStats();
+  printf("current %llu samples while driven, %llu after the on-time\n", (unsigned long long)samples.driven,
+         (unsigned long long)samples.offTime);
+  const std::vector<SimPlantCycle> &cycles = simPlantCycles();
+  if (plant && !cycles.empty()) {
+    double lo = cycles[0].peakMmHg, hi = lo, sum = 0;
+    for (const SimPlantCycle &c : cycles) {
+      if (c.peakMmHg < lo) lo = c.peakMmHg;
+      if (c.peakMmHg > hi) hi = c.peakMmHg;
+      sum += c.peakMmHg;
+    }
+    printf("pump %zu cycles, peak vacuum %.1f / %.1f / %.1f mmHg (min / mean / max)\n", cycles.size(), lo,
+           sum / cycles.size(), hi);
+  }
+  if (!finished) {
+    fprintf(stderr, "run did not finish within %d s of virtual time\n", SIM_LIMIT_S);
+    return 1;
+  }
+  if (check_samples && (samples.driven == 0 || samples.offTime > 0)) {
+    fprintf(stderr, "current samples outside the on-time\n");
+    return 1;
+  }
+  if (drive_count > 0) {
+    int drives = checkDrives(drive, drive_count);
+    const SimStreamStats &stream = simStreamStats();
+    printf("custom drive: %d drives played as set, %llu chunks, shortest refilled %u periods\n",
+           drives < 0 ? 0 : drives, (unsigned long long)stream.chunks, stream.minRefillPeriods);
+    if (drives <= 0 || stream.minRefillPeriods < WAVE_FLAT_MIN) {
+      fprintf(stderr, "custom drive not played as set\n");
+      return 1;
+    }
+  }
+  return upload_ok ? 0 : 1;
+}
@@ -0,0 +1,189 @@
+// Host check and benchmark of the flash results log (include/flash_log.h)
+// on the simulated NVMC (nvmc_sim.h).
+//   make -C host && host/build/flash_log_sim
+// 1. Endurance: pump runs of 7 cycles, one record per cycle, the service
+//    called once per loop() pass and allowed to erase between runs only.
+//    Checks the order and content of everything readable, reports the
+//    longest stall during a run and the wear spread over the pages.
+// 2. Power loss: cuts the power after a random number of word writes,
+//    reboots (flashLogInit()) and checks that the log is still readable in
+//    order, that no word was programmed twice and that the boot count never
+//    goes back, then that boots logging nothing else are counted too.
+// 3. Boot scan time on a full log.
+// 4. Charge target pages (include/target_store.h): tables written with and
+//    without power cuts, read back after every reboot; a table is never
+//    torn, never newer than the last one sent and never lost.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "flash_log.h"
+#include "nvmc_sim.h"
+#include "target_store.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static uint32_t next_value = 0;
+static int failures = 0;
+
+static void fail(const char *what, uint32_t a, uint32_t b) {
+  if (failures++ < 10) std::printf("FAIL %s (%u, %u)\n", what, a, b);
+}
+
+static void appendCycle(uint8_t stage, uint8_t sweep) {
+  FlashLogRecord r = {FLASH_LOG_CYCLE, 1, stage, sweep, next_value, next_value * 3, 0};
+  if (flashLogAppend(r)) next_value++;
+}
+
+// Everything readable is in order (values and boots); returns the newest value0 (+1), 0 if empty.
+static uint32_t checkLog() {
+  uint32_t count = flashLogCount();
+  uint32_t prev = 0;
+  uint32_t prev_boot = 0;
+  bool first = true;
+  FlashLogRecord r;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!flashLogRead(i, &r)) continue; // cut before word 0
+    if (r.boot < prev_boot) fail("boot order", prev_boot, r.boot);
+    prev_boot = r.boot;
+    if (r.kind == FLASH_LOG_BOOT) continue;
+    if (r.kind != FLASH_LOG_CYCLE || r.value1 != r.value0 * 3) fail("record content", i, r.value0);
+    if (!first && r.value0 <= prev) fail("record order", prev, r.value0);
+    prev = r.value0;
+    first = false;
+  }
+  return first ? 0 : prev + 1;
+}
+
+static void endurance() {
+  nvmcSimReset();
+  flashLogInit();
+  next_value = 0;
+  const int runs = 2000;
+  uint32_t run_max_stall = 0;
+  for (int run = 0; run < runs; run++) {
+    for (int cycle = 0; cycle < 7; cycle++) {
+      appendCycle(run % 18, cycle);
+      // About 15 loop() passes per pump cycle while the sequencer is busy.
+      for (int pass = 0; pass < 15; pass++) {
+        uint32_t before = nvmcSimStats().stallUs;
+        flashLogService(false);
+        uint32_t stall = (uint32_t)(nvmcSimStats().stallUs - before);
+        if (stall > run_max_stall) run_max_stall = stall;
+      }
+    }
+    for (int pass = 0; pass < 4; pass++) flashLogService(true); // idle
+  }
+  while (flashLogPending()) flashLogService(true);
+
+  uint32_t newest = checkLog();
+  if (newest != next_value) fail("newest record", newest, next_value);
+  if (flashLogDropped() != 0) fail("dropped", flashLogDropped(), 0);
+  if (nvmcSimStats().badWrites != 0) fail("word programmed twice", nvmcSimStats().badWrites, 0);
+
+  uint32_t wear_min = UINT32_MAX, wear_max = 0;
+  for (int p = 0; p < FLASH_LOG_PAGES; p++) {
+    uint32_t e = nvmcSimPageErases(p);
+    if (e < wear_min) wear_min = e;
+    if (e > wear_max) wear_max = e;
+  }
+  std::printf("endurance      : %u records, %u kept, %u erases (per page %u-%u)\n", next_value,
+              flashLogCount(), nvmcSimStats().erases, wear_min, wear_max);
+  std::printf("                 longest stall during a run %u us, %u words written\n",
+              run_max_stall, nvmcSimStats().writes);
+  if (run_max_stall > FLASH_LOG_SERVICE_WORDS * NVMC_SIM_WRITE_US) {
+    fail("stall during a run", run_max_stall, FLASH_LOG_SERVICE_WORDS * NVMC_SIM_WRITE_US);
+  }
+}
+
+static void powerLoss() {
+  nvmcSimReset();
+  flashLogInit();
+  next_value = 0;
+  srand(1);
+  const int cuts = 3000;
+  uint32_t boot = flashLogBoot();
+  for (int cut = 0; cut < cuts; cut++) {
+    nvmcSimCutAfter(rand() % 200);
+    for (int i = 0; i < 400; i++) {
+      appendCycle(i % 18, i % 7);
+      flashLogService(i % 50 == 0);
+    }
+    nvmcSimPowerOn();
+    flashLogInit(); // reboot
+    // Only a boot cut before its boot record was written is not counted.
+    if (flashLogBoot() < boot) fail("boot count went back", flashLogBoot(), boot);
+    boot = flashLogBoot();
+    checkLog();
+  }
+  // Power cycles that log nothing but their boot record still count.
+  uint32_t before = flashLogBoot();
+  for (int i = 0; i < 5; i++) {
+    while (flashLogPending()) flashLogService(true);
+    flashLogInit();
+  }
+  if (flashLogBoot() != before + 5) fail("empty boots not counted", flashLogBoot(), before + 5);
+  if (nvmcSimStats().badWrites != 0) fail("word programmed twice", nvmcSimStats().badWrites, 0);
+  std::printf("power loss     : %d cuts, %u records kept, boot %u\n", cuts, flashLogCount(),
+              flashLogBoot());
+}
+
+static void bootScan() {
+  // Fill to the point where every page is in use.
+  nvmcSimReset();
+  flashLogInit();
+  while (flashLogCount() < (FLASH_LOG_PAGES - 1) * FLASH_LOG_SLOTS - 1) {
+    appendCycle(0, 0);
+    while (flashLogPending()) flashLogService(true);
+  }
+  const int n = 20000;
+  Clock::time_point t0 = Clock::now();
+  for (int i = 0; i < n; i++) flashLogInit();
+  Clock::time_point t1 = Clock::now();
+  std::printf("boot scan      : %.2f us on the host for %u records in %d pages\n",
+              std::chrono::duration<double, std::micro>(t1 - t0).count() / n, flashLogCount(),
+              FLASH_LOG_PAGES);
+}
+
+static void targets() {
+  nvmcSimReset();
+  targetStoreInit();
+  srand(2);
+  const int tables = 3000;
+  uint32_t sent[PROFILE_MODES] = {0, 0};
+  for (int n = 1; n <= tables; n++) {
+    uint8_t mode = n % PROFILE_MODES;
+    uint32_t t[PROFILE_STAGES];
+    for (int i = 0; i < PROFILE_STAGES; i++) t[i] = n;
+    bool cut = n % 3 == 0;
+    // Up to a whole compaction: both tables and the page header.
+    if (cut) nvmcSimCutAfter(rand() % (PROFILE_MODES * TARGET_RECORD_WORDS + TARGET_PAGE_HEADER_WORDS + 1));
+    targetStoreSet(mode, t);
+    targetStoreService(true);
+    sent[mode] = n;
+    nvmcSimPowerOn();
+    targetStoreInit(); // reboot
+    for (uint8_t m = 0; m < PROFILE_MODES; m++) {
+      const uint32_t *got = targetStoreGet(m);
+      for (int i = 1; i < PROFILE_STAGES; i++) {
+        if (got[i] != got[0]) fail("torn target table", got[0], got[i]);
+      }
+      if (got[0] > sent[m]) fail("target newer than sent", got[0], sent[m]);
+      if (!cut && m == mode && got[0] != sent[m]) fail("target table not kept", got[0], sent[m]);
+      if (got[0] == 0 && sent[m] != 0) fail("target table lost", m, sent[m]);
+      sent[m] = got[0]; // what the device has now
+    }
+  }
+  if (nvmcSimStats().badWrites != 0) fail("word programmed twice", nvmcSimStats().badWrites, 0);
+  std::printf("targets        : %d tables, %u + %u erases\n", tables, nvmcSimPageErases(FLASH_LOG_PAGES),
+              nvmcSimPageErases(FLASH_LOG_PAGES + 1));
+}
+
+int main() {
+  endurance();
+  powerLoss();
+  bootScan();
+  targets();
+  std::printf("%s\n", failures ? "FAILED" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#include <vector>
+#include "nvmc.h"
+#include "nvmc_sim.h"
+
+static std::vector<uint32_t> image(NVMC_SIM_PAGES * NVMC_PAGE_WORDS, 0xFFFFFFFFUL);
+static std::vector<uint32_t> page_erases(NVMC_SIM_PAGES, 0);
+static NvmcSimStats stats;
+static int cut_after = -1;
+static bool powered = true;
+
+static uint32_t index(uint32_t addr) {
+  return (addr - FLASH_LOG_BASE) / 4;
+}
+
+static void stall(uint32_t us) {
+  stats.stallUs += us;
+  if (us > stats.maxStallUs) stats.maxStallUs = us;
+}
+
+void nvmcSimReset() {
+  image.assign(image.size(), 0xFFFFFFFFUL);
+  page_erases.assign(page_erases.size(), 0);
+  stats = NvmcSimStats();
+  cut_after = -1;
+  powered = true;
+}
+
+const NvmcSimStats &nvmcSimStats() {
+  return stats;
+}
+
+uint32_t nvmcSimPageErases(int page) {
+  return page_erases[page];
+}
+
+void nvmcSimCutAfter(int n) {
+  cut_after = n;
+}
+
+void nvmcSimPowerOn() {
+  cut_after = -1;
+  powered = true;
+}
+
+void nvmcErasePage(uint32_t pageAddr) {
+  if (!powered) return;
+  uint32_t first = index(pageAddr);
+  for (uint32_t i = 0; i < NVMC_PAGE_WORDS; i++) {
+    image[first + i] = 0xFFFFFFFFUL;
+  }
+  page_erases[first / NVMC_PAGE_WORDS]++;
+  stats.erases++;
+  stall(NVMC_SIM_ERASE_US);
+}
+
+void nvmcWriteWord(uint32_t addr, uint32_t value) {
+  if (!powered) return;
+  if (cut_after == 0) {
+    powered = false;
+    return;
+  }
+  if (cut_after > 0) cut_after--;
+  uint32_t &w = image[index(addr)];
+  if (w != 0xFFFFFFFFUL) stats.badWrites++;
+  w &= value;
+  stats.writes++;
+  stall(NVMC_SIM_WRITE_US);
+}
+
+const uint32_t *nvmcPtr(uint32_t addr) {
+  return &image[index(addr)];
+}
@@ -0,0 +1,32 @@
+#ifndef NVMC_SIM_H
+#define NVMC_SIM_H
+
+#include <stdint.h>
+#include "target_store.h"
+
+// Simulated NVMC for include/nvmc.h on the host: a RAM image of the flash
+// log and the charge target pages after it, with the real programming rules
+// (a write can only clear bits, an erase sets a page to 0xFF) and the CPU
+// stall of every operation.
+
+#define NVMC_SIM_PAGES (FLASH_LOG_PAGES + TARGET_STORE_PAGES)
+#define NVMC_SIM_WRITE_US 41
+#define NVMC_SIM_ERASE_US 85000
+
+struct NvmcSimStats {
+  uint64_t stallUs;        // total CPU stall
+  uint32_t maxStallUs;     // longest single call
+  uint32_t writes;
+  uint32_t erases;
+  uint32_t badWrites;      // word programmed twice without an erase
+};
+
+void nvmcSimReset();               // whole area erased, stats cleared
+const NvmcSimStats &nvmcSimStats();
+uint32_t nvmcSimPageErases(int page);
+// Power loss after n more word writes: later writes and erases are lost
+// until nvmcSimPowerOn(). n < 0 disables it.
+void nvmcSimCutAfter(int n);
+void nvmcSimPowerOn();
+
+#endif
@@ -0,0 +1,212 @@
+// Uploads, activates and queries pump profiles over the serial command
+// protocol (include/command.h).
+//   make -C host
+//   host/build/profile_cmd /dev/ttyUSB0 ping
+//   host/build/profile_cmd /dev/ttyUSB0 query solo
+//   host/build/profile_cmd /dev/ttyUSB0 upload solo "250,245,...,870" "26,30,...,46"
+//   host/build/profile_cmd /dev/ttyUSB0 targets solo ["1306144,...,8461887"]
+// upload stages the profile and activates it with its CRC. targets sets the
+// calibration charge targets of a mode (0 = none), or prints them.
+// Telemetry frames and text on the same port are skipped.
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "binlog.h"
+#include "command.h"
+#include "profile_store.h"
+#include "profile_tables.h"
+#include "target_store.h"
+
+static const int REPLY_TIMEOUT_MS = 2000;
+
+static int openPort(const char *path, int baud) {
+  int fd = open(path, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    perror(path);
+    return -1;
+  }
+  if (isatty(fd)) {
+    struct termios t;
+    tcgetattr(fd, &t);
+    cfmakeraw(&t);
+    speed_t speed = baud == 1000000 ? B1000000 : baud == 230400 ? B230400 : B115200;
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    tcsetattr(fd, TCSANOW, &t);
+    tcflush(fd, TCIFLUSH);
+  }
+  return fd;
+}
+
+static bool sendRequest(int fd, uint8_t cmd, uint8_t seq, const uint8_t *arg, size_t len) {
+  BinlogWriter w;
+  uint8_t out[BINLOG_FRAME_MAX];
+  w.payload[0] = cmd;
+  w.payload[1] = seq;
+  memcpy(w.payload + 2, arg, len);
+  w.len = (uint16_t)(2 + len);
+  size_t n = binlogFinish(w, out);
+  return write(fd, out, n) == (ssize_t)n;
+}
+
+// Reads frames until the reply to seq arrives; payload without the CRC.
+static bool readReply(int fd, uint8_t seq, std::vector<uint8_t> &reply) {
+  std::vector<uint8_t> frame;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  while (poll(&pfd, 1, REPLY_TIMEOUT_MS) > 0) {
+    uint8_t buf[256];
+    ssize_t got = read(fd, buf, sizeof(buf));
+    if (got <= 0) return false;
+    for (ssize_t i = 0; i < got; i++) {
+      if (buf[i] != 0) {
+        if (frame.size() < BINLOG_FRAME_MAX) frame.push_back(buf[i]);
+        continue;
+      }
+      size_t n = frame.empty() ? 0 : cobsDecode(frame.data(), frame.size(), frame.data());
+      if (n >= 6 && binlogCrc16(frame.data(), n - 2) == (frame[n - 2] | frame[n - 1] << 8) &&
+          frame[0] == CMD_REPLY && frame[1] == seq) {
+        reply.assign(frame.begin(), frame.begin() + (n - 2));
+        return true;
+      }
+      frame.clear();
+    }
+  }
+  fprintf(stderr, "no reply\n");
+  return false;
+}
+
+static bool transact(int fd, uint8_t cmd, const uint8_t *arg, size_t len, std::vector<uint8_t> &reply) {
+  static uint8_t seq = 0;
+  seq++;
+  if (!sendRequest(fd, cmd, seq, arg, len) || !readReply(fd, seq, reply)) return false;
+  if (reply[3] != CMD_OK) {
+    fprintf(stderr, "command %u failed: status %u", cmd, reply[3]);
+    if (reply[3] == CMD_ERR_RANGE && reply.size() > 4) fprintf(stderr, " (stage %u)", reply[4]);
+    fprintf(stderr, "\n");
+    return false;
+  }
+  return true;
+}
+
+static int parseMode(const char *s) {
+  if (strcmp(s, "swing") == 0 || strcmp(s, "0") == 0) return 0;
+  if (strcmp(s, "solo") == 0 || strcmp(s, "1") == 0) return 1;
+  fprintf(stderr, "mode is swing or solo\n");
+  return -1;
+}
+
+static bool parseList(const char *s, long *out) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    char *end;
+    out[i] = strtol(s, &end, 10);
+    if (end == s) return false;
+    s = end;
+    if (i + 1 < PROFILE_STAGES) {
+      if (*s != ',') return false;
+      s++;
+    }
+  }
+  return *s == 0;
+}
+
+static void printProfile(const std::vector<uint8_t> &reply, int mode) {
+  PumpProfile p;
+  profileDeserialize(&reply[7], &p);
+  printf("// %s, crc %04x\n", reply[4] == PROFILE_UPLOADED ? "uploaded" : "flash default",
+         reply[5] | reply[6] << 8);
+  int buildUp[PROFILE_STAGES], duty[PROFILE_STAGES];
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    buildUp[i] = p.buildUpMs[i];
+    duty[i] = p.dutyPct[i];
+  }
+  profilePrintBlock(mode, buildUp, duty);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr,
+            "usage: %s <port> ping | query <mode> | upload <mode> <build-up list> <duty list>\n"
+            "       | targets <mode> [charge list]\n",
+            argv[0]);
+    return 2;
+  }
+  int baud = getenv("BAUD") ? atoi(getenv("BAUD")) : 115200;
+  int fd = openPort(argv[1], baud);
+  if (fd < 0) return 1;
+  std::vector<uint8_t> reply;
+  const char *what = argv[2];
+
+  if (strcmp(what, "ping") == 0) {
+    if (!transact(fd, CMD_PING, 0, 0, reply)) return 1;
+    printf("ok\n");
+    return 0;
+  }
+
+  if (argc < 4) return 2;
+  int mode = parseMode(argv[3]);
+  if (mode < 0) return 2;
+  uint8_t m = (uint8_t)mode;
+
+  if (strcmp(what, "upload") == 0) {
+    long ms[PROFILE_STAGES], pct[PROFILE_STAGES];
+    if (argc < 6 || !parseList(argv[4], ms) || !parseList(argv[5], pct)) {
+      fprintf(stderr, "need %d comma separated build-up times and duties\n", PROFILE_STAGES);
+      return 2;
+    }
+    PumpProfile p;
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+      p.buildUpMs[i] = (uint16_t)ms[i];
+      p.dutyPct[i] = (uint8_t)pct[i];
+    }
+    uint8_t arg[1 + PROFILE_WIRE_SIZE];
+    arg[0] = m;
+    profileSerialize(p, arg + 1);
+    if (!transact(fd, CMD_UPLOAD, arg, sizeof(arg), reply)) return 1;
+    uint16_t crc = profileCrc(p);
+    uint8_t act[3] = {m, (uint8_t)crc, (uint8_t)(crc >> 8)};
+    if (!transact(fd, CMD_ACTIVATE, act, sizeof(act), reply)) return 1;
+    printf("staged, active from the next stage run (crc %04x)\n", crc);
+    return 0;
+  }
+
+  if (strcmp(what, "query") == 0) {
+    if (!transact(fd, CMD_QUERY, &m, 1, reply) || reply.size() != 7 + PROFILE_WIRE_SIZE) return 1;
+    printProfile(reply, mode);
+    return 0;
+  }
+
+  if (strcmp(what, "targets") == 0 && argc >= 5) {
+    long charge[PROFILE_STAGES];
+    if (!parseList(argv[4], charge)) {
+      fprintf(stderr, "need %d comma separated charges\n", PROFILE_STAGES);
+      return 2;
+    }
+    uint8_t arg[1 + TARGET_WIRE_SIZE];
+    arg[0] = m;
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+      for (int k = 0; k < 4; k++) arg[1 + 4 * i + k] = (uint8_t)((uint32_t)charge[i] >> (8 * k));
+    }
+    if (!transact(fd, CMD_SET_TARGETS, arg, sizeof(arg), reply)) return 1;
+    printf("staged, stored from the next stage run\n");
+    return 0;
+  }
+
+  if (strcmp(what, "targets") == 0) {
+    if (!transact(fd, CMD_QUERY_TARGETS, &m, 1, reply) || reply.size() != 4 + TARGET_WIRE_SIZE) return 1;
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+      const uint8_t *b = &reply[4 + 4 * i];
+      printf("%s%u", i ? "," : "", b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24);
+    }
+    printf("\n");
+    return 0;
+  }
+
+  fprintf(stderr, "unknown command %s\n", what);
+  return 2;
+}
@@ -0,0 +1,394 @@
+// Fits the Build_up/PWM tables to a target vacuum per stage on the pump
+// model (sim/plant.h), instead of tuning them by hand on the bench.
+//   make -C host
+//   host/build/profile_fit -P > targets.txt    vacuum the tables reach now
+//   (edit targets.txt)
+//   host/build/profile_fit targets.txt         new tables on stdout
+// targets: a line per mode to fit, "swing" or "solo" and 18 mmHg values,
+// comma or space separated; '#' starts a comment. A stage's vacuum is the
+// peak of its j = 0 sweep step, the stage played from the start as
+// seqStartStage() does (pump_cycle.h).
+//   -s file     tables to start from and stay close to (default src/main.cpp
+//               of this tree, wherever it is run from)
+//   -w weight   pull towards the start tables, per squared relative change,
+//               against the squared relative vacuum error (default 0.01)
+//   -n iters    Nelder-Mead iterations per stage at most (default 60)
+//   -j threads  0 = one per hardware thread (default 0)
+//   -i isa      batched solver, see sweep (default best)
+// Every stage of every mode is its own 2-D Nelder-Mead over (build-up ms,
+// duty %). They advance in lockstep: each round evaluates reflection,
+// expansion and both contractions of every simplex at once, all in one
+// batch over threads and SIMD lanes. Points are rounded to whole ms and %
+// as the tables hold them, and the result is polished on that grid.
+// The output replaces the PumpProfile blocks of src/main.cpp.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <unistd.h>
+#include "parallel.h"
+#include "profile_tables.h"
+#include "pump_cycle.h"
+
+typedef std::chrono::steady_clock Clock;
+
+#define MODES PROFILE_TEXT_MODES
+#define POLISH_ROUNDS 20
+
+// ---------------------------------------------------------------------------
+// Stage evaluation, batched
+
+struct Point {
+  uint16_t ms;
+  uint8_t pct;
+  uint32_t key() const { return (uint32_t)ms << 8 | pct; }
+};
+
+static Point roundPoint(double ms, double pct) {
+  long m = lround(ms), p = lround(pct);
+  m = m < PROFILE_BUILD_UP_MIN_MS ? PROFILE_BUILD_UP_MIN_MS : m > PROFILE_BUILD_UP_MAX_MS ? PROFILE_BUILD_UP_MAX_MS : m;
+  p = p < PROFILE_DUTY_MIN ? PROFILE_DUTY_MIN : p > PROFILE_DUTY_MAX ? PROFILE_DUTY_MAX : p;
+  return Point{(uint16_t)m, (uint8_t)p};
+}
+
+static PlantParams params;
+static PlantIsa isa = PLANT_ISA_BEST;
+static uint32_t threads = 0;
+static uint64_t evaluations;
+
+// Vacuum at the j = 0 step of a stage run with the given build-up and duty,
+// for every point, spread over threads in batches of the solver.
+static void evaluate(const std::vector<Point> &points, std::vector<float> &mmHg) {
+  const uint32_t sweeps = SEQ_SWEEP_CENTER + 1;
+  const uint32_t block = 4 * PLANT_LANES;
+  uint64_t n = points.size();
+  mmHg.resize(n);
+  parallelFor((n + block - 1) / block, threads, 1, [&](uint64_t b, uint32_t) {
+    uint64_t from = b * block, to = from + block < n ? from + block : n;
+    uint32_t count = (uint32_t)(to - from);
+    std::vector<PlantOp> ops(count * STAGE_OPS);
+    std::vector<PlantState> marks(count * STAGE_MARKS), states(count);
+    std::vector<PlantProgram> programs(count);
+    for (uint32_t k = 0; k < count; k++) {
+      const Point &pt = points[from + k];
+      PlantOp *o = &ops[k * STAGE_OPS];
+      plantInit(states[k]);
+      programs[k] = PlantProgram{&params, o, stageOps(pt.ms, pt.pct, sweeps, o), &states[k], &marks[k * STAGE_MARKS]};
+    }
+    plantRun(programs.data(), count, isa);
+    for (uint32_t k = 0; k < count; k++) {
+      mmHg[from + k] = cycleResult(&marks[k * STAGE_MARKS + SEQ_SWEEP_CENTER * CYCLE_MARKS]).peakMmHg;
+    }
+  });
+  evaluations += n;
+}
+
+// ---------------------------------------------------------------------------
+// Nelder-Mead per stage
+
+enum FitPhase { FIT_START, FIT_STEP, FIT_SHRINK, FIT_POLISH, FIT_DONE };
+
+struct Fit {
+  int mode, stage;
+  double target;
+  double ms0, pct0;     // start table entry
+  double x[3][2], f[3]; // simplex, best first once sorted
+  double cand[9][2];    // points waiting for their values
+  int cands;
+  FitPhase phase;
+  int iterations;
+  int polishRounds;
+  std::map<uint32_t, float> seen; // vacuum per grid point
+};
+
+static double weight = 0.01;
+static int max_iterations = 60;
+
+static double cost(const Fit &fit, Point pt, float mmHg) {
+  double e = (mmHg - fit.target) / fit.target;
+  double dm = (pt.ms - fit.ms0) / fit.ms0;
+  double dp = (pt.pct - fit.pct0) / fit.pct0;
+  return e * e + weight * (dm * dm + dp * dp);
+}
+
+static double costAt(const Fit &fit, const double *x) {
+  Point pt = roundPoint(x[0], x[1]);
+  return cost(fit, pt, fit.seen.at(pt.key()));
+}
+
+static void setCand(Fit &fit, int k, double ms, double pct) {
+  fit.cand[k][0] = ms;
+  fit.cand[k][1] = pct;
+}
+
+static void sortSimplex(Fit &fit) {
+  for (int a = 0; a < 3; a++) {
+    for (int b = a + 1; b < 3; b++) {
+      if (fit.f[b] < fit.f[a]) {
+        std::swap(fit.f[a], fit.f[b]);
+        std::swap(fit.x[a], fit.x[b]);
+      }
+    }
+  }
+}
+
+// Reflection, expansion, outside and inside contraction of the worst point.
+static void propose(Fit &fit) {
+  double c[2], *w = fit.x[2];
+  for (int d = 0; d < 2; d++) c[d] = (fit.x[0][d] + fit.x[1][d]) / 2;
+  for (int d = 0; d < 2; d++) {
+    double r = c[d] + (c[d] - w[d]);
+    fit.cand[0][d] = r;
+    fit.cand[1][d] = c[d] + 2 * (r - c[d]);
+    fit.cand[2][d] = c[d] + 0.5 * (r - c[d]);
+    fit.cand[3][d] = c[d] + 0.5 * (w[d] - c[d]);
+  }
+  fit.cands = 4;
+  fit.phase = FIT_STEP;
+}
+
+static void polishAround(Fit &fit) {
+  Point best = roundPoint(fit.x[0][0], fit.x[0][1]);
+  fit.cands = 0;
+  for (int dm = -1; dm <= 1; dm++) {
+    for (int dp = -1; dp <= 1; dp++) setCand(fit, fit.cands++, best.ms + dm, best.pct + dp);
+  }
+  fit.phase = FIT_POLISH;
+}
+
+static void nextIteration(Fit &fit) {
+  sortSimplex(fit);
+  fit.iterations++;
+  double spreadMs = 0, spreadPct = 0;
+  for (int k = 1; k < 3; k++) {
+    spreadMs = fmax(spreadMs, fabs(fit.x[k][0] - fit.x[0][0]));
+    spreadPct = fmax(spreadPct, fabs(fit.x[k][1] - fit.x[0][1]));
+  }
+  if ((spreadMs < 1 && spreadPct < 1) || fit.iterations >= max_iterations) {
+    polishAround(fit);
+  } else {
+    propose(fit);
+  }
+}
+
+// All candidates of fit have values now: the Nelder-Mead decision.
+static void advance(Fit &fit) {
+  switch (fit.phase) {
+    case FIT_START:
+      for (int k = 0; k < 3; k++) fit.f[k] = costAt(fit, fit.x[k]);
+      sortSimplex(fit);
+      propose(fit);
+      return;
+    case FIT_STEP: {
+      double fr = costAt(fit, fit.cand[0]);
+      int pick = -1;
+      if (fr < fit.f[0]) {
+        pick = costAt(fit, fit.cand[1]) < fr ? 1 : 0;
+      } else if (fr < fit.f[1]) {
+        pick = 0;
+      } else if (fr < fit.f[2]) {
+        if (costAt(fit, fit.cand[2]) <= fr) pick = 2;
+      } else if (costAt(fit, fit.cand[3]) < fit.f[2]) {
+        pick = 3;
+      }
+      if (pick >= 0) {
+        fit.x[2][0] = fit.cand[pick][0];
+        fit.x[2][1] = fit.cand[pick][1];
+        fit.f[2] = costAt(fit, fit.cand[pick]);
+        nextIteration(fit);
+        return;
+      }
+      // Shrink towards the best point.
+      for (int k = 1; k < 3; k++) {
+        setCand(fit, k - 1, (fit.x[0][0] + fit.x[k][0]) / 2, (fit.x[0][1] + fit.x[k][1]) / 2);
+      }
+      fit.cands = 2;
+      fit.phase = FIT_SHRINK;
+      return;
+    }
+    case FIT_SHRINK:
+      for (int k = 1; k < 3; k++) {
+        fit.x[k][0] = fit.cand[k - 1][0];
+        fit.x[k][1] = fit.cand[k - 1][1];
+        fit.f[k] = costAt(fit, fit.x[k]);
+      }
+      nextIteration(fit);
+      return;
+    case FIT_POLISH: {
+      // Moves to the best grid neighbour until none is better.
+      int best = 4; // the centre
+      for (int k = 0; k < fit.cands; k++) {
+        if (costAt(fit, fit.cand[k]) < costAt(fit, fit.cand[best])) best = k;
+      }
+      Point centre = roundPoint(fit.cand[4][0], fit.cand[4][1]);
+      Point moved = roundPoint(fit.cand[best][0], fit.cand[best][1]);
+      fit.x[0][0] = moved.ms;
+      fit.x[0][1] = moved.pct;
+      if (moved.key() != centre.key() && ++fit.polishRounds < POLISH_ROUNDS) {
+        polishAround(fit);
+      } else {
+        fit.phase = FIT_DONE;
+      }
+      return;
+    }
+    case FIT_DONE: return;
+  }
+}
+
+static void startFit(Fit &fit, int mode, int stage, double target, const ProfileTables &t) {
+  fit.mode = mode;
+  fit.stage = stage;
+  fit.target = target;
+  fit.ms0 = t.buildUpMs[mode][stage];
+  fit.pct0 = t.dutyPct[mode][stage];
+  fit.x[0][0] = fit.ms0;
+  fit.x[0][1] = fit.pct0;
+  fit.x[1][0] = fit.ms0 * 1.1;
+  fit.x[1][1] = fit.pct0;
+  fit.x[2][0] = fit.ms0;
+  fit.x[2][1] = fit.pct0 * 1.1;
+  for (int k = 0; k < 3; k++) setCand(fit, k, fit.x[k][0], fit.x[k][1]);
+  fit.cands = 3;
+  fit.phase = FIT_START;
+  fit.iterations = 0;
+  fit.polishRounds = 0;
+}
+
+// Rounds until every fit is done; each evaluates the grid points no fit
+// has seen yet, all fits together.
+static int runFits(std::vector<Fit> &fits) {
+  int rounds = 0;
+  for (;;) {
+    std::vector<Point> points;
+    std::vector<size_t> owner;
+    for (size_t f = 0; f < fits.size(); f++) {
+      Fit &fit = fits[f];
+      if (fit.phase == FIT_DONE) continue;
+      for (int k = 0; k < fit.cands; k++) {
+        Point pt = roundPoint(fit.cand[k][0], fit.cand[k][1]);
+        if (fit.seen.count(pt.key())) continue;
+        fit.seen[pt.key()] = NAN; // once per round
+        points.push_back(pt);
+        owner.push_back(f);
+      }
+    }
+    bool busy = false;
+    for (const Fit &fit : fits) busy |= fit.phase != FIT_DONE;
+    if (!busy) return rounds;
+    std::vector<float> mmHg;
+    evaluate(points, mmHg);
+    for (size_t k = 0; k < points.size(); k++) fits[owner[k]].seen[points[k].key()] = mmHg[k];
+    for (Fit &fit : fits) advance(fit);
+    rounds++;
+  }
+}
+
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-s main.cpp] [-w weight] [-n iters] [-j threads] [-i isa] targets\n"
+                  "       %s [-s main.cpp] -P\n", argv0, argv0);
+}
+
+int main(int argc, char **argv) {
+  const char *start = profileDefaultSource();
+  bool print = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "s:w:n:j:i:P")) != -1) {
+    bool ok = true;
+    switch (opt) {
+      case 's': start = optarg; break;
+      case 'w': weight = atof(optarg); break;
+      case 'n': max_iterations = atoi(optarg); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'i': ok = plantIsaParse(optarg, isa); break;
+      case 'P': print = true; break;
+      default: ok = false; break;
+    }
+    if (!ok) {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!print && optind + 1 != argc) {
+    usage(argv[0]);
+    return 2;
+  }
+  params = plantDefaults();
+  ProfileTables tables;
+  if (!profileReadTables(start, tables)) return 1;
+
+  if (print) {
+    printf("# vacuum (mmHg) at j = 0 per stage with the tables of %s\n", start);
+    for (int m = 0; m < MODES; m++) {
+      if (!tables.have[m]) continue;
+      std::vector<Point> points;
+      for (int i = 0; i < PROFILE_STAGES; i++) {
+        points.push_back(roundPoint(tables.buildUpMs[m][i], tables.dutyPct[m][i]));
+      }
+      std::vector<float> mmHg;
+      evaluate(points, mmHg);
+      printf("%-5s", profileModeName(m));
+      for (int i = 0; i < PROFILE_STAGES; i++) printf("%s%.1f", i ? ", " : " ", mmHg[i]);
+      printf("\n");
+    }
+    return 0;
+  }
+
+  bool want[MODES] = {};
+  double targets[MODES][PROFILE_STAGES];
+  if (!profileReadValues(argv[optind], want, targets)) return 1;
+  std::vector<Fit> fits;
+  for (int m = 0; m < MODES; m++) {
+    if (!want[m]) continue;
+    if (!tables.have[m]) {
+      // Nothing to start from: the middle of the usual range.
+      for (int i = 0; i < PROFILE_STAGES; i++) {
+        tables.buildUpMs[m][i] = 400;
+        tables.dutyPct[m][i] = 50;
+      }
+    }
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+      if (!(targets[m][i] > 0)) {
+        fprintf(stderr, "%s stage %d: target must be above 0 mmHg\n", profileModeName(m), i);
+        return 2;
+      }
+      fits.emplace_back();
+      startFit(fits.back(), m, i, targets[m][i], tables);
+    }
+  }
+  if (fits.empty()) {
+    fprintf(stderr, "%s: no targets\n", argv[optind]);
+    return 1;
+  }
+
+  Clock::time_point t0 = Clock::now();
+  int rounds = runFits(fits);
+  double s = std::chrono::duration<double>(Clock::now() - t0).count();
+  fprintf(stderr, "%zu stages, %d rounds, %llu stage runs in %.2f s (%s, %u threads)\n", fits.size(), rounds,
+          (unsigned long long)evaluations, s, plantIsaName(isa == PLANT_ISA_BEST ? plantIsaBest() : isa),
+          threads ? threads : parallelThreads());
+  fprintf(stderr, "mode  stage target reached  build-up      duty\n");
+  int miss = 0;
+  for (int m = 0; m < MODES; m++) {
+    if (!want[m]) continue;
+    int ms[PROFILE_STAGES], pct[PROFILE_STAGES];
+    for (const Fit &fit : fits) {
+      if (fit.mode != m) continue;
+      Point pt = roundPoint(fit.x[0][0], fit.x[0][1]);
+      float reached = fit.seen.at(pt.key());
+      // Off by more than 2% or 1 mmHg: out of reach within the limits.
+      bool off = fabs(reached - fit.target) > fmax(1.0, 0.02 * fit.target);
+      miss += off;
+      fprintf(stderr, "%-5s %5d %6.1f %7.1f%s %4d (%+4d) %4d (%+3d)\n", profileModeName(m), fit.stage, fit.target, reached,
+              off ? "!" : " ", pt.ms, pt.ms - (int)fit.ms0, pt.pct, pt.pct - (int)fit.pct0);
+      ms[fit.stage] = pt.ms;
+      pct[fit.stage] = pt.pct;
+    }
+    profilePrintBlock(m, ms, pct);
+  }
+  if (miss) fprintf(stderr, "%d stages off target (!)\n", miss);
+  return miss ? 1 : 0;
+}
@@ -0,0 +1,122 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "profile_tables.h"
+
+static const char *const mode_names[PROFILE_TEXT_MODES] = {"swing", "solo"};
+
+const char *profileDefaultSource() {
+  static std::string path;
+  if (!path.empty()) return path.c_str();
+  char exe[4096];
+  ssize_t n = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+  std::string dir(exe, n > 0 ? n : 0);
+  // <repo>/host/build/<tool>: up three.
+  for (int up = 0; up < 3 && !dir.empty(); up++) {
+    size_t slash = dir.rfind('/');
+    dir = slash == std::string::npos ? "" : dir.substr(0, slash);
+  }
+  path = dir.empty() ? "src/main.cpp" : dir + "/src/main.cpp";
+  return path.c_str();
+}
+
+const char *profileModeName(int mode) {
+  return mode >= 0 && mode < PROFILE_TEXT_MODES ? mode_names[mode] : "?";
+}
+
+int profileModeParse(const char *name) {
+  for (int m = 0; m < PROFILE_TEXT_MODES; m++) {
+    if (strcmp(name, mode_names[m]) == 0) return m;
+  }
+  return -1;
+}
+
+bool profileParseValues(const char *s, double *out) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    while (*s == ',' || *s == ' ' || *s == '\t') s++;
+    char *end;
+    out[i] = strtod(s, &end);
+    if (end == s) return false;
+    s = end;
+  }
+  while (*s == ',' || *s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') s++;
+  return *s == 0;
+}
+
+bool profileReadTables(const char *path, ProfileTables &t) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  memset(&t, 0, sizeof(t));
+  bool have[PROFILE_TEXT_MODES][2] = {};
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    const char *open = strchr(line, '{');
+    const char *close = strchr(line, '}');
+    const char *comment = strstr(line, "// ");
+    if (!open || !close || !comment || close < open || comment < close) continue;
+    for (int m = 0; m < PROFILE_TEXT_MODES; m++) {
+      for (int k = 0; k < 2; k++) {
+        char name[32];
+        snprintf(name, sizeof(name), "%s_%s", k == 0 ? "Build_up" : "PWM", mode_names[m]);
+        size_t len = strlen(name);
+        if (strncmp(comment + 3, name, len) != 0 || (unsigned char)comment[3 + len] > ' ') continue;
+        std::string list(open + 1, close);
+        double v[PROFILE_STAGES];
+        if (!profileParseValues(list.c_str(), v)) continue;
+        for (int i = 0; i < PROFILE_STAGES; i++) (k == 0 ? t.buildUpMs : t.dutyPct)[m][i] = (int)v[i];
+        have[m][k] = true;
+      }
+    }
+  }
+  fclose(f);
+  for (int m = 0; m < PROFILE_TEXT_MODES; m++) t.have[m] = have[m][0] && have[m][1];
+  return true;
+}
+
+bool profileReadValues(const char *path, bool have[PROFILE_TEXT_MODES],
+                       double values[PROFILE_TEXT_MODES][PROFILE_STAGES]) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  char line[1024];
+  int n = 0;
+  bool ok = true;
+  while (ok && fgets(line, sizeof(line), f)) {
+    n++;
+    char *hash = strchr(line, '#');
+    if (hash) *hash = 0;
+    char mode[16];
+    int used;
+    if (sscanf(line, " %15[a-z]%n", mode, &used) != 1) continue;
+    int m = profileModeParse(mode);
+    ok = m >= 0 && profileParseValues(line + used, values[m]);
+    if (ok) have[m] = true;
+  }
+  fclose(f);
+  if (!ok) fprintf(stderr, "%s:%d: expected swing|solo and %d values\n", path, n, PROFILE_STAGES);
+  return ok;
+}
+
+static void printList(char *out, size_t size, const int *v) {
+  size_t n = snprintf(out, size, "  {");
+  for (int i = 0; i < PROFILE_STAGES; i++) n += snprintf(out + n, size - n, "%s%d", i ? ", " : "", v[i]);
+  snprintf(out + n, size - n, "}");
+}
+
+void profilePrintBlock(int mode, const int *buildUpMs, const int *dutyPct) {
+  char buildUp[256], duty[256];
+  printList(buildUp, sizeof(buildUp), buildUpMs);
+  printList(duty, sizeof(duty), dutyPct);
+  int column = (int)strlen(buildUp) + 2;
+  printf("constexpr PumpProfile %s_profile = {\n", mode_names[mode]);
+  printf("%s, // Build_up_%s\n", buildUp, mode_names[mode]);
+  printf("%-*s // PWM_%s\n", column, duty, mode_names[mode]);
+  printf("};\n");
+}
@@ -0,0 +1,39 @@
+#ifndef PROFILE_TABLES_H
+#define PROFILE_TABLES_H
+
+#include "pump_profile.h"
+
+// The Build_up/PWM tables as text, for the host tools that read them from
+// src/main.cpp and write them back in the same layout.
+
+#define PROFILE_TEXT_MODES 2
+
+struct ProfileTables {
+  bool have[PROFILE_TEXT_MODES];
+  int buildUpMs[PROFILE_TEXT_MODES][PROFILE_STAGES];
+  int dutyPct[PROFILE_TEXT_MODES][PROFILE_STAGES];
+};
+
+// src/main.cpp of the tree the tool was built in, found from the
+// executable (host/build/), so the default works from any directory.
+// Falls back to "src/main.cpp" when the executable's path is unknown.
+const char *profileDefaultSource();
+
+const char *profileModeName(int mode); // "swing", "solo"
+int profileModeParse(const char *name); // -1 if neither
+
+// PROFILE_STAGES numbers, separated by commas and/or blanks.
+bool profileParseValues(const char *s, double *out);
+
+// The "{..}, // Build_up_<mode>" and "{..} // PWM_<mode>" lines of a
+// source file; have[mode] once both are found.
+bool profileReadTables(const char *path, ProfileTables &t);
+
+// A line per mode, the mode name and PROFILE_STAGES values, '#' comments.
+bool profileReadValues(const char *path, bool have[PROFILE_TEXT_MODES],
+                       double values[PROFILE_TEXT_MODES][PROFILE_STAGES]);
+
+// The constexpr PumpProfile block of main.cpp, comments lined up alike.
+void profilePrintBlock(int mode, const int *buildUpMs, const int *dutyPct);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Arduino core for the host build of the firmware (see sim.h): the
+// functions the sketch and the portable modules use, on the virtual clock.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define DEC 10
+#define HEX 16
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+// Logged as a PWM record with the 8 bit resolution of the core.
+void analogWrite(uint8_t pin, int value);
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class SimSerial {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  size_t write(uint8_t b);
+  size_t write(const uint8_t *buf, size_t len);
+  size_t print(const char *s);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  template <typename T> size_t println(T v) {
+    size_t n = print(v);
+    return n + print("\r\n");
+  }
+  size_t println() { return print("\r\n"); }
+};
+
+extern SimSerial Serial;
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef NRF_H
+#define NRF_H
+
+// The few CMSIS intrinsics the portable modules (idle.cpp) use. There is
+// no register access on the host: the peripheral drivers are replaced as a
+// whole by the sim_*.cpp files.
+
+#include <stdint.h>
+
+// Sleeps until the next event and runs it (the wake-up interrupt).
+void __WFE();
+// Events never preempt the main thread, so masking is a no-op.
+inline uint32_t __get_PRIMASK() { return 0; }
+inline void __disable_irq() {}
+inline void __enable_irq() {}
+
+// DWT cycle counter for phase_timing.cpp: the virtual clock at 64 MHz. No
+// time passes inside an event, so edge latencies read 0 on the host.
+#define SIM_CPU_HZ 64000000ULL
+struct SimCycleCounter {
+  uint32_t base = 0;
+  operator uint32_t() const;
+  SimCycleCounter &operator=(uint32_t value);
+};
+struct SimDwt {
+  uint32_t CTRL;
+  SimCycleCounter CYCCNT;
+};
+struct SimCoreDebug {
+  uint32_t DEMCR;
+};
+extern SimDwt sim_dwt;
+extern SimCoreDebug sim_core_debug;
+#define DWT (&sim_dwt)
+#define CoreDebug (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk 1UL
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+#endif
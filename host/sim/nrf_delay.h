@@ -0,0 +1,10 @@
+#ifndef NRF_DELAY_H
+#define NRF_DELAY_H
+
+#include <stdint.h>
+
+// Busy wait of the nRF5 SDK, on the virtual clock (see sim.h).
+void nrf_delay_us(uint32_t us);
+void nrf_delay_ms(uint32_t ms);
+
+#endif
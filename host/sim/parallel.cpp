@@ -0,0 +1,91 @@
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "parallel.h"
+
+// Padded to a cache line each, the owner and the thieves of one slice do
+// not share a line with any other slice. Changed under lock only; the
+// atomics let thieves size up a slice without taking it.
+struct alignas(64) Slice {
+  std::mutex lock;
+  std::atomic<uint64_t> begin;
+  std::atomic<uint64_t> end;
+};
+
+uint32_t parallelThreads() {
+  uint32_t n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+// Moves the back half of the largest other slice into slices[self].
+static bool steal(std::vector<Slice> &slices, uint32_t self) {
+  for (;;) {
+    uint32_t victim = self;
+    uint64_t most = 0;
+    for (uint32_t v = 0; v < slices.size(); v++) {
+      if (v == self) continue;
+      // Two separate loads, only a hint: a torn pair wraps and is skipped.
+      uint64_t left = slices[v].end.load(std::memory_order_relaxed) -
+                      slices[v].begin.load(std::memory_order_relaxed);
+      if (left > most && left <= UINT64_MAX / 2) {
+        most = left;
+        victim = v;
+      }
+    }
+    if (victim == self || most == 0) return false;
+    uint64_t from, to;
+    {
+      std::lock_guard<std::mutex> g(slices[victim].lock);
+      Slice &s = slices[victim];
+      uint64_t begin = s.begin, end = s.end;
+      if (end <= begin) continue; // drained meanwhile, look again
+      to = end;
+      from = end - (end - begin + 1) / 2;
+      s.end = from;
+    }
+    std::lock_guard<std::mutex> g(slices[self].lock);
+    slices[self].begin = from;
+    slices[self].end = to;
+    return true;
+  }
+}
+
+ParallelStats parallelFor(uint64_t count, uint32_t threads, uint32_t grain,
+                          const std::function<void(uint64_t index, uint32_t worker)> &fn) {
+  if (threads == 0) threads = parallelThreads();
+  if (threads > count && count > 0) threads = (uint32_t)count;
+  if (grain == 0) grain = 1;
+  std::vector<Slice> slices(threads);
+  for (uint32_t t = 0; t < threads; t++) {
+    slices[t].begin = count * t / threads;
+    slices[t].end = count * (t + 1) / threads;
+  }
+  std::atomic<uint64_t> steals(0);
+
+  auto work = [&](uint32_t self) {
+    Slice &mine = slices[self];
+    for (;;) {
+      uint64_t from, to;
+      {
+        std::lock_guard<std::mutex> g(mine.lock);
+        from = mine.begin;
+        uint64_t end = mine.end;
+        to = end - from > grain ? from + grain : end;
+        mine.begin = to;
+      }
+      if (from >= to) {
+        if (!steal(slices, self)) return;
+        steals.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      for (uint64_t i = from; i < to; i++) fn(i, self);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (uint32_t t = 1; t < threads; t++) pool.emplace_back(work, t);
+  work(0);
+  for (std::thread &th : pool) th.join();
+  return ParallelStats{threads, steals.load()};
+}
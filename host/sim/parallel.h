@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+#include <functional>
+
+// Work-stealing parallel loop for the host tools. Every worker starts with
+// an equal slice of the index range and takes grain indices at a time from
+// the front of its own slice; a worker that runs dry steals the back half
+// of the largest slice left. Each slice has its own lock, only touched once
+// per grain by its owner, so workers never queue on a shared counter and
+// uneven jobs (long build-ups next to short ones) still finish together.
+
+struct ParallelStats {
+  uint32_t threads;
+  uint64_t steals;
+};
+
+// fn(index, worker) for every index in [0, count), worker in [0, threads).
+// threads 0 = one per hardware thread. Returns when all have run.
+ParallelStats parallelFor(uint64_t count, uint32_t threads, uint32_t grain,
+                          const std::function<void(uint64_t index, uint32_t worker)> &fn);
+
+uint32_t parallelThreads(); // hardware threads, at least 1
+
+#endif
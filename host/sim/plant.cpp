@@ -0,0 +1,130 @@
+#include <math.h>
+#include "plant.h"
+#include "plant_coef.h"
+#include "current_sense.h"
+
+PlantParams plantDefaults() {
+  PlantParams p;
+  p.supplyV = 4.0;
+  p.diodeV = 0.4;
+  p.rOhm = 2.0;
+  p.lH = 0.3e-3;
+  p.keVsPerRad = 0.005;
+  p.jKgM2 = 1.2e-6;
+  p.bNmsPerRad = 1e-7;
+  p.frictionNm = 0.4e-3;
+  p.dispM3PerRad = 0.5e-6 / (2 * M_PI);
+  p.efficiency = 0.6;
+  p.volumeM3 = 40e-6;
+  p.vacMaxPa = 300 * PLANT_PA_PER_MMHG;
+  p.leakM3PerSPa = 2e-10;
+  p.valveM3PerSPa = 2e-8;
+  p.atmPa = 101325;
+  p.shuntOhm = 0.1;
+  p.senseGain = 10;
+  p.stepS = 12.5e-6;
+  p.idleStepS = 100e-6;
+  return p;
+}
+
+void plantInit(PlantState &s) {
+  s.i = 0;
+  s.w = 0;
+  s.vac = 0;
+  s.vacPeak = 0;
+  s.iPeak = 0;
+  s.charge = 0;
+}
+
+void plantResetPeak(PlantState &s) {
+  s.vacPeak = s.vac;
+  s.iPeak = s.i;
+}
+
+struct Deriv {
+  double di, dw, dvac;
+};
+
+static inline Deriv deriv(const Coef &c, double i, double w, double vac, bool motorOn) {
+  Deriv d;
+  if (motorOn) {
+    d.di = (c.supplyV - c.r * i - c.ke * w) * c.invL;
+  } else if (i > 0) {
+    d.di = (-c.diodeV - c.r * i - c.ke * w) * c.invL;
+  } else {
+    d.di = 0; // open winding
+  }
+  if (vac < 0) vac = 0;
+  double load = c.friction + c.loadPerPa * vac;
+  double torque = c.ke * i - c.b * w;
+  // Friction and the pump only brake, a stopped rotor stays stopped.
+  d.dw = (w > 0 || torque > load) ? (torque - load) * c.invJ : 0;
+  double moved = w > 0 && vac < c.vacMax ? c.disp * w * (1 - vac * c.invVacMax) : 0;
+  d.dvac = (c.atm - vac) * c.invVol * (moved - c.g * vac);
+  return d;
+}
+
+static inline void rk4(const Coef &c, PlantState &s, double h, bool motorOn) {
+  Deriv k1 = deriv(c, s.i, s.w, s.vac, motorOn);
+  Deriv k2 = deriv(c, s.i + h / 2 * k1.di, s.w + h / 2 * k1.dw, s.vac + h / 2 * k1.dvac, motorOn);
+  Deriv k3 = deriv(c, s.i + h / 2 * k2.di, s.w + h / 2 * k2.dw, s.vac + h / 2 * k2.dvac, motorOn);
+  Deriv k4 = deriv(c, s.i + h * k3.di, s.w + h * k3.dw, s.vac + h * k3.dvac, motorOn);
+  double i0 = s.i;
+  s.i += h / 6 * (k1.di + 2 * k2.di + 2 * k3.di + k4.di);
+  s.w += h / 6 * (k1.dw + 2 * k2.dw + 2 * k3.dw + k4.dw);
+  s.vac += h / 6 * (k1.dvac + 2 * k2.dvac + 2 * k3.dvac + k4.dvac);
+  // The diode blocks once the freewheeling current is gone.
+  if (s.i < 0) s.i = 0;
+  if (s.w < 0) s.w = 0;
+  if (s.vac < 0) s.vac = 0;
+  s.charge += h / 2 * (i0 + s.i);
+  if (s.vac > s.vacPeak) s.vacPeak = s.vac;
+  if (s.i > s.iPeak) s.iPeak = s.i;
+}
+
+void plantSegment(const PlantParams &p, PlantState &s, double seconds, bool motorOn, bool valveOpen) {
+  Coef c = coef(p, valveOpen);
+  while (seconds > 0) {
+    double hmax = motorOn || s.i > 0 ? p.stepS : p.idleStepS;
+    // Equal steps up to the end, or up to the next step size change.
+    int n = (int)ceil(seconds / hmax);
+    double h = seconds / n;
+    if (motorOn || s.i > 0) {
+      for (int k = 0; k < n; k++) {
+        rk4(c, s, h, motorOn);
+        seconds -= h;
+        if (!motorOn && s.i == 0) break; // freewheeling over, idle steps
+      }
+    } else {
+      for (int k = 0; k < n; k++) rk4(c, s, h, motorOn);
+      seconds = 0;
+    }
+    if (seconds < 1e-12) seconds = 0;
+  }
+}
+
+void plantPwm(const PlantParams &p, PlantState &s, uint32_t periods, uint16_t onTicks, uint16_t top,
+              bool valveOpen) {
+  if (top == 0) return;
+  if (onTicks > top) onTicks = top;
+  Coef c = coef(p, valveOpen);
+  // Step counts fixed for the whole run; the off part keeps the small step
+  // even once the current is gone, it is shorter than a period anyway.
+  double on = onTicks / PLANT_PWM_CLOCK_HZ;
+  double off = (top - onTicks) / PLANT_PWM_CLOCK_HZ;
+  int n_on = (int)ceil(on / p.stepS);
+  int n_off = (int)ceil(off / p.stepS);
+  double h_on = n_on > 0 ? on / n_on : 0;
+  double h_off = n_off > 0 ? off / n_off : 0;
+  for (uint32_t k = 0; k < periods; k++) {
+    for (int i = 0; i < n_on; i++) rk4(c, s, h_on, true);
+    for (int i = 0; i < n_off; i++) rk4(c, s, h_off, false);
+  }
+}
+
+int16_t plantSenseLsb(const PlantParams &p, const PlantState &s) {
+  double uv = s.i * p.shuntOhm * p.senseGain * 1e6;
+  long lsb = lround(uv / CURRENT_UV_PER_LSB);
+  if (lsb > 4095) lsb = 4095;
+  return (int16_t)lsb;
+}
@@ -0,0 +1,73 @@
+#ifndef PLANT_H
+#define PLANT_H
+
+#include <stdint.h>
+
+// Physical model of the pump for the host tools: the DC motor (winding
+// resistance and inductance, back-EMF, rotor inertia, friction), the
+// diaphragm pump pulling a vacuum on a closed air volume, and the solenoid
+// valve that lets it back to atmosphere. Integrated with fixed step RK4;
+// PWM periods are split at the switching edges so no step straddles one.
+//
+//   L di/dt = V - R i - Ke w          V = supply while on, -diode while
+//                                     freewheeling, no current below 0
+//   J dw/dt = Ke i - B w - friction - disp * vacuum / efficiency
+//   dvac/dt = (Pabs / volume) * (disp * w * (1 - vac / vacMax)
+//                                - (leak + valve) * vac)
+//
+// The current is read back as the SAADC would see it on MOTOR_UI
+// (shunt, amplifier, CURRENT_UV_PER_LSB).
+
+#define PLANT_PA_PER_MMHG 133.322
+
+struct PlantParams {
+  double supplyV;        // motor supply, the kick is 1.5 V of it
+  double diodeV;         // freewheeling diode drop
+  double rOhm;           // winding + switch + shunt
+  double lH;             // winding inductance
+  double keVsPerRad;     // back-EMF constant = torque constant
+  double jKgM2;          // rotor and eccentric inertia
+  double bNmsPerRad;     // viscous friction
+  double frictionNm;     // Coulomb friction
+  double dispM3PerRad;   // diaphragm displacement per motor radian
+  double efficiency;     // mechanical, pump torque = disp * vac / efficiency
+  double volumeM3;       // closed air volume (shield, tubing, pump head)
+  double vacMaxPa;       // vacuum at which the pump stops moving air
+  double leakM3PerSPa;   // leak conductance
+  double valveM3PerSPa;  // solenoid open conductance
+  double atmPa;
+  double shuntOhm;
+  double senseGain;
+  double stepS;          // RK4 step while the winding carries current
+  double idleStepS;      // RK4 step with no current
+};
+
+struct PlantState {
+  double i;        // A
+  double w;        // rad/s
+  double vac;      // Pa below atmosphere
+  double vacPeak;  // since plantResetPeak()
+  double iPeak;    // same
+  double charge;   // integral of the current, A s
+};
+
+// Nominal unit: 2 ohm, 0.75 A stall at the 1.5 V kick, ~100 ms mechanical
+// time constant, 0.5 ml per revolution into 40 ml. The default tables
+// reach 30-180 mmHg with it.
+PlantParams plantDefaults();
+void plantInit(PlantState &s);
+void plantResetPeak(PlantState &s);
+
+// Integrates seconds with the motor switch held on or off.
+void plantSegment(const PlantParams &p, PlantState &s, double seconds, bool motorOn, bool valveOpen);
+// periods of onTicks/top on the 16 MHz PWM clock, from the start of a period.
+void plantPwm(const PlantParams &p, PlantState &s, uint32_t periods, uint16_t onTicks, uint16_t top,
+              bool valveOpen);
+
+// SAADC reading of the current, clamped to the 12 bit range.
+int16_t plantSenseLsb(const PlantParams &p, const PlantState &s);
+inline double plantMmHg(double pa) {
+  return pa / PLANT_PA_PER_MMHG;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <math.h>
+#include <string.h>
+#include "plant_batch.h"
+#include "plant_coef.h"
+#include "plant_lanes.h"
+
+void plantRunScalar(const PlantProgram &program) {
+  const PlantParams &p = *program.params;
+  PlantState &s = *program.state;
+  uint32_t mark = 0;
+  for (uint32_t k = 0; k < program.count; k++) {
+    const PlantOp &op = program.ops[k];
+    switch (op.kind) {
+      case PLANT_OP_PWM: plantPwm(p, s, op.periods, op.onTicks, op.top, op.valveOpen); break;
+      case PLANT_OP_SEGMENT: plantSegment(p, s, op.seconds, op.motorOn, op.valveOpen); break;
+      case PLANT_OP_RESET_PEAK: plantResetPeak(s); break;
+      case PLANT_OP_MARK:
+        if (program.marks) program.marks[mark++] = s;
+        break;
+    }
+  }
+}
+
+// Where a lane is in its program. The step loop of plantSegment() is
+// replayed here: the kernel runs one chunk of equal steps, the lane then
+// takes off the seconds done and picks the step size for the rest.
+struct Lane {
+  const PlantProgram *program; // 0 while idle
+  uint32_t op;                 // next one to load
+  uint32_t mark;
+  bool segment;
+  bool motorOn;
+  bool small; // stepS chunk, else idleStepS
+  double seconds;
+  double h;
+};
+
+static void setIdle(PlantLanes &l, int k) {
+  l.hOn[k] = l.hOff[k] = l.h6On[k] = l.h6Off[k] = 0;
+  l.nOn[k] = 0;
+  l.nSteps[k] = 1;
+  l.step[k] = 0;
+  l.periods[k] = HUGE_VAL;
+  l.stopAtZero[k] = 0;
+}
+
+static void loadState(PlantLanes &l, int k, const PlantState &s) {
+  l.i[k] = s.i;
+  l.w[k] = s.w;
+  l.vac[k] = s.vac;
+  l.vacPeak[k] = s.vacPeak;
+  l.iPeak[k] = s.iPeak;
+  l.charge[k] = s.charge;
+}
+
+static void storeState(const PlantLanes &l, int k, PlantState &s) {
+  s.i = l.i[k];
+  s.w = l.w[k];
+  s.vac = l.vac[k];
+  s.vacPeak = l.vacPeak[k];
+  s.iPeak = l.iPeak[k];
+  s.charge = l.charge[k];
+}
+
+static void loadCoef(PlantLanes &l, int k, const PlantParams &p, bool valveOpen) {
+  Coef c = coef(p, valveOpen);
+  l.supplyV[k] = c.supplyV;
+  l.negDiodeV[k] = -c.diodeV;
+  l.r[k] = c.r;
+  l.ke[k] = c.ke;
+  l.invL[k] = c.invL;
+  l.b[k] = c.b;
+  l.friction[k] = c.friction;
+  l.loadPerPa[k] = c.loadPerPa;
+  l.invJ[k] = c.invJ;
+  l.atm[k] = c.atm;
+  l.invVol[k] = c.invVol;
+  l.disp[k] = c.disp;
+  l.vacMax[k] = c.vacMax;
+  l.invVacMax[k] = c.invVacMax;
+  l.g[k] = c.g;
+}
+
+// The step counts and sizes of plantPwm().
+static bool loadPwm(PlantLanes &l, int k, const PlantParams &p, const PlantOp &op) {
+  if (op.top == 0 || op.periods == 0) return false;
+  uint16_t onTicks = op.onTicks > op.top ? op.top : op.onTicks;
+  double on = onTicks / PLANT_PWM_CLOCK_HZ;
+  double off = (op.top - onTicks) / PLANT_PWM_CLOCK_HZ;
+  int n_on = (int)ceil(on / p.stepS);
+  int n_off = (int)ceil(off / p.stepS);
+  l.hOn[k] = n_on > 0 ? on / n_on : 0;
+  l.hOff[k] = n_off > 0 ? off / n_off : 0;
+  l.h6On[k] = l.hOn[k] / 6;
+  l.h6Off[k] = l.hOff[k] / 6;
+  l.nOn[k] = n_on;
+  l.nSteps[k] = n_on + n_off;
+  l.step[k] = 0;
+  l.periods[k] = op.periods;
+  l.stopAtZero[k] = 0;
+  return true;
+}
+
+// One pass of the plantSegment() loop, lane.seconds > 0.
+static void loadChunk(PlantLanes &l, int k, const PlantParams &p, Lane &lane) {
+  lane.small = lane.motorOn || l.i[k] > 0;
+  double hmax = lane.small ? p.stepS : p.idleStepS;
+  int n = (int)ceil(lane.seconds / hmax);
+  lane.h = lane.seconds / n;
+  l.hOn[k] = l.hOff[k] = lane.h;
+  l.h6On[k] = l.h6Off[k] = lane.h / 6;
+  l.nOn[k] = lane.motorOn ? n : 0;
+  l.nSteps[k] = n;
+  l.step[k] = 0;
+  l.periods[k] = 1;
+  l.stopAtZero[k] = lane.small && !lane.motorOn;
+}
+
+// Runs the instant ops and loads the next stepped one; false at the end.
+static bool advance(PlantLanes &l, int k, Lane &lane) {
+  const PlantProgram &program = *lane.program;
+  const PlantParams &p = *program.params;
+  while (lane.op < program.count) {
+    const PlantOp &op = program.ops[lane.op++];
+    switch (op.kind) {
+      case PLANT_OP_PWM:
+        l.g[k] = coef(p, op.valveOpen).g;
+        lane.segment = false;
+        if (loadPwm(l, k, p, op)) return true;
+        break;
+      case PLANT_OP_SEGMENT:
+        if (!(op.seconds > 0)) break;
+        l.g[k] = coef(p, op.valveOpen).g;
+        lane.segment = true;
+        lane.motorOn = op.motorOn;
+        lane.seconds = op.seconds;
+        loadChunk(l, k, p, lane);
+        return true;
+      case PLANT_OP_RESET_PEAK:
+        l.vacPeak[k] = l.vac[k];
+        l.iPeak[k] = l.i[k];
+        break;
+      case PLANT_OP_MARK:
+        if (program.marks) storeState(l, k, program.marks[lane.mark++]);
+        break;
+    }
+  }
+  return false;
+}
+
+// The lane stopped in the kernel; false once its program is over.
+static bool service(PlantLanes &l, int k, Lane &lane) {
+  if (lane.segment) {
+    if (lane.small) {
+      int done = l.periods[k] == 0 ? (int)l.nSteps[k] : (int)l.step[k];
+      for (int n = 0; n < done; n++) lane.seconds -= lane.h;
+    } else {
+      lane.seconds = 0;
+    }
+    if (lane.seconds < 1e-12) lane.seconds = 0;
+    if (lane.seconds > 0) {
+      loadChunk(l, k, *lane.program->params, lane);
+      return true;
+    }
+  }
+  return advance(l, k, lane);
+}
+
+static void runLanes(uint32_t (*kernel)(PlantLanes &), const PlantProgram *programs, uint32_t n) {
+  PlantLanes l{};
+  Lane lanes[PLANT_LANES];
+  uint32_t next = 0;
+  // Fills lane k with the next program that has any steps to run.
+  auto start = [&](int k) {
+    while (next < n) {
+      const PlantProgram &program = programs[next++];
+      lanes[k] = Lane{&program, 0, 0, false, false, false, 0, 0};
+      loadCoef(l, k, *program.params, false);
+      loadState(l, k, *program.state);
+      if (advance(l, k, lanes[k])) return true;
+      storeState(l, k, *program.state);
+    }
+    lanes[k].program = 0;
+    setIdle(l, k);
+    return false;
+  };
+  int busy = 0;
+  for (int k = 0; k < PLANT_LANES; k++) busy += start(k);
+  while (busy > 0) {
+    uint32_t attention = kernel(l);
+    while (attention) {
+      int k = __builtin_ctz(attention);
+      attention &= attention - 1;
+      if (service(l, k, lanes[k])) continue;
+      storeState(l, k, *lanes[k].program->state);
+      if (!start(k)) busy--;
+    }
+  }
+}
+
+void plantRun(const PlantProgram *programs, uint32_t n, PlantIsa isa) {
+  if (isa == PLANT_ISA_BEST || !plantIsaSupported(isa)) isa = plantIsaBest();
+  switch (isa) {
+    case PLANT_ISA_AVX512: runLanes(plantLanesAvx512, programs, n); break;
+    case PLANT_ISA_AVX2: runLanes(plantLanesAvx2, programs, n); break;
+    default:
+      for (uint32_t k = 0; k < n; k++) plantRunScalar(programs[k]);
+      break;
+  }
+}
+
+bool plantIsaSupported(PlantIsa isa) {
+  switch (isa) {
+#if defined(__x86_64__)
+    case PLANT_ISA_AVX512: return __builtin_cpu_supports("avx512f");
+    case PLANT_ISA_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+    case PLANT_ISA_BEST:
+    case PLANT_ISA_SCALAR: return true;
+    default: return false;
+  }
+}
+
+PlantIsa plantIsaBest() {
+  if (plantIsaSupported(PLANT_ISA_AVX512)) return PLANT_ISA_AVX512;
+  if (plantIsaSupported(PLANT_ISA_AVX2)) return PLANT_ISA_AVX2;
+  return PLANT_ISA_SCALAR;
+}
+
+static const char *const isa_names[] = {"best", "scalar", "avx2", "avx512"};
+
+const char *plantIsaName(PlantIsa isa) {
+  return isa <= PLANT_ISA_AVX512 ? isa_names[isa] : "?";
+}
+
+bool plantIsaParse(const char *name, PlantIsa &isa) {
+  for (uint8_t k = 0; k <= PLANT_ISA_AVX512; k++) {
+    if (strcmp(name, isa_names[k]) == 0) {
+      isa = (PlantIsa)k;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,76 @@
+#ifndef PLANT_BATCH_H
+#define PLANT_BATCH_H
+
+#include <stdint.h>
+#include "plant.h"
+
+// Many independent pump models integrated at once. Each one runs a short
+// program of the plant.h calls (PWM runs, motor segments, peak resets and
+// state marks); PLANT_LANES of them advance side by side in SIMD registers,
+// structure-of-arrays, one RK4 step of every lane per pass. A lane whose
+// program ends takes the next program, so uneven programs keep all lanes
+// busy.
+//
+// The vector kernels do the scalar solver's operations in the same order,
+// without FMA, and pick the same step sizes: results match plantPwm() and
+// plantSegment() bit for bit. The instruction set is chosen at run time;
+// without AVX2 every program runs through the scalar solver.
+
+#define PLANT_LANES 16
+
+enum PlantIsa : uint8_t {
+  PLANT_ISA_BEST,   // widest one the CPU has
+  PLANT_ISA_SCALAR, // plantPwm() / plantSegment() one program at a time
+  PLANT_ISA_AVX2,   // 4 doubles per register, 4 registers per pass
+  PLANT_ISA_AVX512, // 8 doubles per register, 2 registers per pass
+};
+
+enum PlantOpKind : uint8_t {
+  PLANT_OP_PWM,        // plantPwm(periods, onTicks, top, valveOpen)
+  PLANT_OP_SEGMENT,    // plantSegment(seconds, motorOn, valveOpen)
+  PLANT_OP_RESET_PEAK, // plantResetPeak()
+  PLANT_OP_MARK,       // copies the state into the next marks[] entry
+};
+
+struct PlantOp {
+  PlantOpKind kind;
+  bool motorOn;
+  bool valveOpen;
+  uint16_t onTicks;
+  uint16_t top;
+  uint32_t periods;
+  double seconds;
+};
+
+inline PlantOp plantOpPwm(uint32_t periods, uint16_t onTicks, uint16_t top, bool valveOpen) {
+  return PlantOp{PLANT_OP_PWM, false, valveOpen, onTicks, top, periods, 0};
+}
+inline PlantOp plantOpSegment(double seconds, bool motorOn, bool valveOpen) {
+  return PlantOp{PLANT_OP_SEGMENT, motorOn, valveOpen, 0, 0, 0, seconds};
+}
+inline PlantOp plantOpResetPeak() {
+  return PlantOp{PLANT_OP_RESET_PEAK, false, false, 0, 0, 0, 0};
+}
+inline PlantOp plantOpMark() {
+  return PlantOp{PLANT_OP_MARK, false, false, 0, 0, 0, 0};
+}
+
+struct PlantProgram {
+  const PlantParams *params;
+  const PlantOp *ops;
+  uint32_t count;
+  PlantState *state; // start state in, end state out
+  PlantState *marks; // one per PLANT_OP_MARK, may be 0 without marks
+};
+
+// Runs every program to its end. Programs may share params and ops, not
+// state or marks.
+void plantRun(const PlantProgram *programs, uint32_t n, PlantIsa isa = PLANT_ISA_BEST);
+void plantRunScalar(const PlantProgram &program);
+
+PlantIsa plantIsaBest();
+bool plantIsaSupported(PlantIsa isa);
+const char *plantIsaName(PlantIsa isa);
+bool plantIsaParse(const char *name, PlantIsa &isa);
+
+#endif
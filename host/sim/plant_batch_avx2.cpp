@@ -0,0 +1,41 @@
+// plant_kernel.h on AVX2: 4 doubles per register. FMA is left off so every
+// product is rounded before it is summed, as in the scalar solver.
+#include "plant_lanes.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#define KFN static inline __attribute__((always_inline, target("avx2")))
+#define KTARGET __attribute__((target("avx2")))
+#define KERNEL plantLanesAvx2
+
+typedef __m256d V;
+typedef __m256d M;
+#define W 4
+
+KFN V vload(const double *p) { return _mm256_load_pd(p); }
+KFN void vstore(double *p, V a) { _mm256_store_pd(p, a); }
+KFN V vset(double a) { return _mm256_set1_pd(a); }
+KFN V vadd(V a, V b) { return _mm256_add_pd(a, b); }
+KFN V vsub(V a, V b) { return _mm256_sub_pd(a, b); }
+KFN V vmul(V a, V b) { return _mm256_mul_pd(a, b); }
+KFN V vsel(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+KFN V vmax(V a, V b) { return _mm256_max_pd(a, b); }
+KFN V vkeep(M m, V a) { return _mm256_and_pd(m, a); }
+KFN M vlt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+KFN M vgt(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GT_OQ); }
+KFN M vge(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+KFN M veq(V a, V b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+KFN M mand(M a, M b) { return _mm256_and_pd(a, b); }
+KFN M mor(M a, M b) { return _mm256_or_pd(a, b); }
+KFN uint32_t mbits(M m) { return (uint32_t)_mm256_movemask_pd(m); }
+
+#include "plant_kernel.h"
+
+#else
+
+uint32_t plantLanesAvx2(PlantLanes &) {
+  return 0; // never picked, plantIsaSupported() says no
+}
+
+#endif
@@ -0,0 +1,42 @@
+// plant_kernel.h on AVX-512F: 8 doubles per register. Only AVX-512F is
+// enabled, not FMA, so every product is rounded before it is summed.
+#include "plant_lanes.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#define KFN static inline __attribute__((always_inline, target("avx512f")))
+#define KTARGET __attribute__((target("avx512f")))
+#define KERNEL plantLanesAvx512
+
+typedef __m512d V;
+typedef __mmask8 M;
+#define W 8
+
+KFN V vload(const double *p) { return _mm512_load_pd(p); }
+KFN void vstore(double *p, V a) { _mm512_store_pd(p, a); }
+KFN V vset(double a) { return _mm512_set1_pd(a); }
+KFN V vadd(V a, V b) { return _mm512_add_pd(a, b); }
+KFN V vsub(V a, V b) { return _mm512_sub_pd(a, b); }
+KFN V vmul(V a, V b) { return _mm512_mul_pd(a, b); }
+KFN V vsel(M m, V a, V b) { return _mm512_mask_blend_pd(m, b, a); }
+// Masked: _mm512_max_pd() trips -Wuninitialized in GCC 12's headers.
+KFN V vmax(V a, V b) { return _mm512_maskz_max_pd(0xFF, a, b); }
+KFN V vkeep(M m, V a) { return _mm512_mask_blend_pd(m, _mm512_setzero_pd(), a); }
+KFN M vlt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+KFN M vgt(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ); }
+KFN M vge(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_GE_OQ); }
+KFN M veq(V a, V b) { return _mm512_cmp_pd_mask(a, b, _CMP_EQ_OQ); }
+KFN M mand(M a, M b) { return a & b; }
+KFN M mor(M a, M b) { return a | b; }
+KFN uint32_t mbits(M m) { return m; }
+
+#include "plant_kernel.h"
+
+#else
+
+uint32_t plantLanesAvx512(PlantLanes &) {
+  return 0; // never picked, plantIsaSupported() says no
+}
+
+#endif
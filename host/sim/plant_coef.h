@@ -0,0 +1,36 @@
+#ifndef PLANT_COEF_H
+#define PLANT_COEF_H
+
+#include "plant.h"
+
+#define PLANT_PWM_CLOCK_HZ 16000000.0
+
+// The parameters as the derivative uses them, divisions done once per call.
+// Shared by the scalar solver and the batched one (plant_batch.h) so both
+// start every step from the same bits.
+struct Coef {
+  double supplyV, diodeV, r, ke, invL, b, friction, loadPerPa, invJ;
+  double atm, invVol, disp, vacMax, invVacMax, g;
+};
+
+inline Coef coef(const PlantParams &p, bool valveOpen) {
+  Coef c;
+  c.supplyV = p.supplyV;
+  c.diodeV = p.diodeV;
+  c.r = p.rOhm;
+  c.ke = p.keVsPerRad;
+  c.invL = 1 / p.lH;
+  c.b = p.bNmsPerRad;
+  c.friction = p.frictionNm;
+  c.loadPerPa = p.dispM3PerRad / p.efficiency;
+  c.invJ = 1 / p.jKgM2;
+  c.atm = p.atmPa;
+  c.invVol = 1 / p.volumeM3;
+  c.disp = p.dispM3PerRad;
+  c.vacMax = p.vacMaxPa;
+  c.invVacMax = 1 / p.vacMaxPa;
+  c.g = p.leakM3PerSPa + (valveOpen ? p.valveM3PerSPa : 0);
+  return c;
+}
+
+#endif
@@ -0,0 +1,148 @@
+// RK4 over PlantLanes, written once for every vector width. Included by
+// plant_batch_avx2.cpp and plant_batch_avx512.cpp after they define
+//   V, M, W             register, compare mask, doubles per register
+//   KFN, KTARGET        attributes of the helpers and of the kernel
+//   vload vstore vset vadd vsub vmul vsel vlt vgt vge veq mand mor mbits
+//   vmax                a > b ? a : b (MAXPD, not fmax() on zeros and NaN)
+//   vkeep               a where m, else +0
+//   KERNEL              name of the kernel
+// Each expression is plant.cpp's deriv() and rk4() operation for operation;
+// the branches become selects.
+
+#include "plant_lanes.h"
+
+static constexpr int CHUNKS = PLANT_LANES / W; // constexpr for #pragma GCC unroll
+
+struct KDeriv {
+  V di, dw, dvac;
+};
+
+// vin is the supply or the diode drop as on picks, the same for the whole step.
+KFN KDeriv kDeriv(const PlantLanes &l, int o, V i, V w, V vac, M on, V vin) {
+  const V zero = vset(0);
+  KDeriv d;
+  V r = vload(l.r + o);
+  V ke = vload(l.ke + o);
+  V di = vmul(vsub(vsub(vin, vmul(r, i)), vmul(ke, w)), vload(l.invL + o));
+  d.di = vkeep(mor(on, vgt(i, zero)), di);
+  vac = vmax(zero, vac);
+  V load = vadd(vload(l.friction + o), vmul(vload(l.loadPerPa + o), vac));
+  V torque = vsub(vmul(ke, i), vmul(vload(l.b + o), w));
+  M turning = vgt(w, zero);
+  d.dw = vkeep(mor(turning, vgt(torque, load)), vmul(vsub(torque, load), vload(l.invJ + o)));
+  V moved = vmul(vmul(vload(l.disp + o), w), vsub(vset(1), vmul(vac, vload(l.invVacMax + o))));
+  moved = vkeep(mand(turning, vlt(vac, vload(l.vacMax + o))), moved);
+  V gas = vmul(vsub(vload(l.atm + o), vac), vload(l.invVol + o));
+  d.dvac = vmul(gas, vsub(moved, vmul(vload(l.g + o), vac)));
+  return d;
+}
+
+// The input of the next stage: x + hh * k.
+KFN KDeriv kAhead(V i, V w, V vac, V hh, const KDeriv &k) {
+  return KDeriv{vadd(i, vmul(hh, k.di)), vadd(w, vmul(hh, k.dw)), vadd(vac, vmul(hh, k.dvac))};
+}
+
+// k1 + 2 k2 + 2 k3 + k4 summed as it comes, in rk4()'s order.
+KFN void kAddTwice(KDeriv &sum, const KDeriv &k) {
+  const V two = vset(2);
+  sum.di = vadd(sum.di, vmul(two, k.di));
+  sum.dw = vadd(sum.dw, vmul(two, k.dw));
+  sum.dvac = vadd(sum.dvac, vmul(two, k.dvac));
+}
+
+KFN void kAdd(KDeriv &sum, const KDeriv &k) {
+  sum.di = vadd(sum.di, k.di);
+  sum.dw = vadd(sum.dw, k.dw);
+  sum.dvac = vadd(sum.dvac, k.dvac);
+}
+
+KTARGET uint32_t KERNEL(PlantLanes &l) {
+  const V zero = vset(0);
+  const V one = vset(1);
+  const V half = vset(0.5);
+  V i[CHUNKS], w[CHUNKS], vac[CHUNKS], vacPeak[CHUNKS], iPeak[CHUNKS], charge[CHUNKS];
+  V step[CHUNKS], periods[CHUNKS];
+  for (int c = 0; c < CHUNKS; c++) {
+    int o = c * W;
+    i[c] = vload(l.i + o);
+    w[c] = vload(l.w + o);
+    vac[c] = vload(l.vac + o);
+    vacPeak[c] = vload(l.vacPeak + o);
+    iPeak[c] = vload(l.iPeak + o);
+    charge[c] = vload(l.charge + o);
+    step[c] = vload(l.step + o);
+    periods[c] = vload(l.periods + o);
+  }
+  uint32_t attention = 0;
+  // Every stage of the step runs over all chunks before the next one, so
+  // their dependency chains overlap, and only the running sum of the slopes
+  // is kept. The chunk loops are unrolled: rolled up, the arrays live on
+  // the stack and every stage goes through memory.
+  while (attention == 0) {
+    M on[CHUNKS];
+    V h[CHUNKS], h2[CHUNKS], vin[CHUNKS];
+    KDeriv k[CHUNKS], sum[CHUNKS];
+#pragma GCC unroll CHUNKS
+    for (int c = 0; c < CHUNKS; c++) {
+      int o = c * W;
+      on[c] = vlt(step[c], vload(l.nOn + o));
+      h[c] = vsel(on[c], vload(l.hOn + o), vload(l.hOff + o));
+      h2[c] = vmul(h[c], half);
+      vin[c] = vsel(on[c], vload(l.supplyV + o), vload(l.negDiodeV + o));
+      k[c] = kDeriv(l, o, i[c], w[c], vac[c], on[c], vin[c]);
+      sum[c] = k[c];
+    }
+    for (int stage = 0; stage < 2; stage++) {
+#pragma GCC unroll CHUNKS
+      for (int c = 0; c < CHUNKS; c++) {
+        KDeriv x = kAhead(i[c], w[c], vac[c], h2[c], k[c]);
+        k[c] = kDeriv(l, c * W, x.di, x.dw, x.dvac, on[c], vin[c]);
+        kAddTwice(sum[c], k[c]);
+      }
+    }
+#pragma GCC unroll CHUNKS
+    for (int c = 0; c < CHUNKS; c++) {
+      KDeriv x = kAhead(i[c], w[c], vac[c], h[c], k[c]);
+      k[c] = kDeriv(l, c * W, x.di, x.dw, x.dvac, on[c], vin[c]);
+      kAdd(sum[c], k[c]);
+    }
+#pragma GCC unroll CHUNKS
+    for (int c = 0; c < CHUNKS; c++) {
+      int o = c * W;
+      V h6 = vsel(on[c], vload(l.h6On + o), vload(l.h6Off + o));
+      V i0 = i[c];
+      V ni = vadd(i[c], vmul(h6, sum[c].di));
+      V nw = vadd(w[c], vmul(h6, sum[c].dw));
+      V nvac = vadd(vac[c], vmul(h6, sum[c].dvac));
+      ni = vmax(zero, ni);
+      nw = vmax(zero, nw);
+      nvac = vmax(zero, nvac);
+      charge[c] = vadd(charge[c], vmul(h2[c], vadd(i0, ni)));
+      vacPeak[c] = vmax(nvac, vacPeak[c]);
+      iPeak[c] = vmax(ni, iPeak[c]);
+      i[c] = ni;
+      w[c] = nw;
+      vac[c] = nvac;
+
+      V s = vadd(step[c], one);
+      M wrap = vge(s, vload(l.nSteps + o));
+      step[c] = vsel(wrap, zero, s);
+      periods[c] = vsel(wrap, vsub(periods[c], one), periods[c]);
+      M done = mor(veq(periods[c], zero), mand(vgt(vload(l.stopAtZero + o), zero), veq(ni, zero)));
+      attention |= mbits(done) << o;
+    }
+  }
+  for (int c = 0; c < CHUNKS; c++) {
+    int o = c * W;
+    vstore(l.i + o, i[c]);
+    vstore(l.w + o, w[c]);
+    vstore(l.vac + o, vac[c]);
+    vstore(l.vacPeak + o, vacPeak[c]);
+    vstore(l.iPeak + o, iPeak[c]);
+    vstore(l.charge + o, charge[c]);
+    vstore(l.step + o, step[c]);
+    vstore(l.periods + o, periods[c]);
+  }
+  return attention;
+}
+
@@ -0,0 +1,52 @@
+#ifndef PLANT_LANES_H
+#define PLANT_LANES_H
+
+#include <stdint.h>
+#include "plant_batch.h"
+
+// What the vector kernels see of PLANT_LANES pump models, one array per
+// quantity. Every op is loaded as periods of nSteps steps, the first nOn
+// with the switch on: a PWM run as it is, a segment as a single period.
+// Counts are kept as doubles, exact far beyond any program, so the kernels
+// stay in one register type. An idle lane has h = 0 and endless periods.
+struct alignas(64) PlantLanes {
+  double i[PLANT_LANES];
+  double w[PLANT_LANES];
+  double vac[PLANT_LANES];
+  double vacPeak[PLANT_LANES];
+  double iPeak[PLANT_LANES];
+  double charge[PLANT_LANES];
+
+  double supplyV[PLANT_LANES];
+  double negDiodeV[PLANT_LANES];
+  double r[PLANT_LANES];
+  double ke[PLANT_LANES];
+  double invL[PLANT_LANES];
+  double b[PLANT_LANES];
+  double friction[PLANT_LANES];
+  double loadPerPa[PLANT_LANES];
+  double invJ[PLANT_LANES];
+  double atm[PLANT_LANES];
+  double invVol[PLANT_LANES];
+  double disp[PLANT_LANES];
+  double vacMax[PLANT_LANES];
+  double invVacMax[PLANT_LANES];
+  double g[PLANT_LANES];
+
+  double hOn[PLANT_LANES];
+  double hOff[PLANT_LANES];
+  double h6On[PLANT_LANES]; // h / 6 as rk4() rounds it
+  double h6Off[PLANT_LANES];
+  double nOn[PLANT_LANES];
+  double nSteps[PLANT_LANES];
+  double step[PLANT_LANES];    // in the current period
+  double periods[PLANT_LANES]; // left, counting the current one
+  double stopAtZero[PLANT_LANES]; // 1: freewheeling, stop when i reaches 0
+};
+
+// Steps every lane until at least one finishes its op or a freewheeling one
+// runs out of current; returns those lanes as a bit mask.
+uint32_t plantLanesAvx2(PlantLanes &l);
+uint32_t plantLanesAvx512(PlantLanes &l);
+
+#endif
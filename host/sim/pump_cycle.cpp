@@ -0,0 +1,84 @@
+#include <math.h>
+#include <vector>
+#include "pump_cycle.h"
+#include "sequencer.h"
+
+// The integer math of sweep_schedule.h with the countertop as a parameter.
+static uint32_t roundDiv(uint64_t a, uint64_t b) {
+  return (uint32_t)((a + b / 2) / b);
+}
+
+CycleSpec cycleSpec(uint32_t buildUpMs, uint32_t dutyPct, double kickV, double supplyV, uint32_t freqHz,
+                    int j) {
+  CycleSpec c;
+  c.top = (uint16_t)(PWM_HIRES_CLOCK_HZ / freqHz);
+  c.kickTicks = (uint16_t)lround(c.top * kickV / supplyV);
+  if (c.kickTicks > c.top) c.kickTicks = c.top;
+  c.kickCycles = roundDiv((uint64_t)SEQ_KICK_MS * (PWM_HIRES_CLOCK_HZ / 1000), c.top);
+  c.dutyTicks = (uint16_t)roundDiv((uint64_t)c.top * DUTY_PCT(dutyPct), PWM_DUTY_FULL);
+  uint32_t ms = buildUpMs > SEQ_KICK_MS ? buildUpMs - SEQ_KICK_MS : 0;
+  c.buildUpCycles = roundDiv((uint64_t)ms * (uint32_t)(1000 + j) * (PWM_HIRES_CLOCK_HZ / 1000000), c.top);
+  return c;
+}
+
+uint32_t cycleOps(const CycleSpec &c, PlantOp *ops) {
+  ops[0] = plantOpMark();
+  ops[1] = plantOpResetPeak();
+  ops[2] = plantOpPwm(c.kickCycles, c.kickTicks, c.top, false);
+  ops[3] = plantOpPwm(c.buildUpCycles, c.dutyTicks, c.top, false);
+  ops[4] = plantOpMark();
+  ops[5] = plantOpSegment(SEQ_GAP_MS * 1e-3, false, false);
+  ops[6] = plantOpMark();
+  ops[7] = plantOpSegment(SEQ_SOL_OPEN_MS * 1e-3, false, true);
+  return CYCLE_OPS;
+}
+
+CycleResult cycleResult(const PlantState *marks) {
+  CycleResult r;
+  r.endRadS = (float)marks[1].w;
+  r.chargeMas = (float)((marks[1].charge - marks[0].charge) * 1000);
+  r.peakMmHg = (float)plantMmHg(marks[2].vacPeak);
+  r.peakA = (float)marks[2].iPeak;
+  return r;
+}
+
+CycleSpec stageSpec(uint32_t buildUpMs, uint32_t dutyPct, int j) {
+  CycleSpec c;
+  c.top = PWM_TOP;
+  c.kickTicks = dutyToTicks(KICK_DUTY);
+  c.kickCycles = msToCycles(SEQ_KICK_MS);
+  c.dutyTicks = dutyToTicks(DUTY_PCT(dutyPct));
+  c.buildUpCycles = buildUpCycles(buildUpMs, j);
+  return c;
+}
+
+uint32_t stageOps(uint32_t buildUpMs, uint32_t dutyPct, uint32_t sweeps, PlantOp *ops) {
+  uint32_t n = 0;
+  ops[n++] = plantOpSegment(SEQ_STAGE_GAP_MS * 1e-3, false, false);
+  for (uint32_t k = 0; k < sweeps && k < SEQ_SWEEPS; k++) {
+    n += cycleOps(stageSpec(buildUpMs, dutyPct, sweepOffset(k)), ops + n);
+  }
+  return n;
+}
+
+CycleResult runCycle(const PlantParams &p, PlantState &s, const CycleSpec &c) {
+  PlantOp ops[CYCLE_OPS];
+  PlantState marks[CYCLE_MARKS];
+  plantRunScalar(PlantProgram{&p, ops, cycleOps(c, ops), &s, marks});
+  return cycleResult(marks);
+}
+
+void runCycles(const PlantParams &p, PlantState *s, const CycleSpec *c, CycleResult *r, uint32_t n,
+               PlantIsa isa) {
+  struct Slot {
+    PlantOp ops[CYCLE_OPS];
+    PlantState marks[CYCLE_MARKS];
+  };
+  std::vector<Slot> slots(n);
+  std::vector<PlantProgram> programs(n);
+  for (uint32_t k = 0; k < n; k++) {
+    programs[k] = PlantProgram{&p, slots[k].ops, cycleOps(c[k], slots[k].ops), &s[k], slots[k].marks};
+  }
+  plantRun(programs.data(), n, isa);
+  for (uint32_t k = 0; k < n; k++) r[k] = cycleResult(slots[k].marks);
+}
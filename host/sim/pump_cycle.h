@@ -0,0 +1,57 @@
+#ifndef PUMP_CYCLE_H
+#define PUMP_CYCLE_H
+
+#include <stdint.h>
+#include "plant.h"
+#include "plant_batch.h"
+#include "sweep_schedule.h"
+
+// One stage drive as the sequencer plays it (sequencer.h), on the pump
+// model alone, without the firmware: kick, build-up, SEQ_GAP_MS with the
+// motor off, then the valve open for SEQ_SOL_OPEN_MS. Cheap enough to run
+// by the million across threads (parallel.h); at 20 kHz with the 1.5 V kick
+// the periods and ticks are exactly those of makeSchedule().
+
+struct CycleSpec {
+  uint16_t top;
+  uint16_t kickTicks;
+  uint32_t kickCycles;
+  uint16_t dutyTicks;
+  uint32_t buildUpCycles; // kick excluded
+};
+
+struct CycleResult {
+  float peakMmHg;  // vacuum when the valve opens
+  float chargeMas; // motor current integral over the drive
+  float peakA;
+  float endRadS;   // motor speed at the end of the build-up
+};
+
+// buildUpMs includes the kick as in the profiles, j is the sweep offset in
+// 0.1% (sweep_schedule.h).
+CycleSpec cycleSpec(uint32_t buildUpMs, uint32_t dutyPct, double kickV, double supplyV, uint32_t freqHz,
+                    int j = 0);
+// From the state s is in (plantInit() for a pump at rest); s is left at
+// the end of the valve open time, ready for the next cycle.
+CycleResult runCycle(const PlantParams &p, PlantState &s, const CycleSpec &c);
+// n of them at once on the batched solver (plant_batch.h), s[k] runs c[k].
+void runCycles(const PlantParams &p, PlantState *s, const CycleSpec *c, CycleResult *r, uint32_t n,
+               PlantIsa isa = PLANT_ISA_BEST);
+
+// The cycle as a plant program, for callers that batch their own: writes
+// CYCLE_OPS ops, the result comes from the CYCLE_MARKS marks they leave.
+#define CYCLE_OPS 8
+#define CYCLE_MARKS 3
+uint32_t cycleOps(const CycleSpec &c, PlantOp *ops);
+CycleResult cycleResult(const PlantState *marks);
+
+// Stage runs as seqStartStage() plays them, with the firmware's own
+// schedule arithmetic (20 kHz, 1.5 V kick): SEQ_STAGE_GAP_MS with the motor
+// off, then one cycle per sweep step from SEQ_SWEEP_FIRST, the first
+// `sweeps` of them. Cycle k's result is cycleResult(marks + k * CYCLE_MARKS).
+#define STAGE_OPS (1 + SEQ_SWEEPS * CYCLE_OPS)
+#define STAGE_MARKS (SEQ_SWEEPS * CYCLE_MARKS)
+CycleSpec stageSpec(uint32_t buildUpMs, uint32_t dutyPct, int j);
+uint32_t stageOps(uint32_t buildUpMs, uint32_t dutyPct, uint32_t sweeps, PlantOp *ops);
+
+#endif
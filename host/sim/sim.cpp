@@ -0,0 +1,332 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include <nrf_delay.h>
+#include <algorithm>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include "sim.h"
+
+struct QueuedEvent {
+  uint64_t tNs;
+  uint32_t id; // increasing, keeps same-time events in order
+  bool operator>(const QueuedEvent &o) const {
+    return tNs != o.tNs ? tNs > o.tNs : id > o.id;
+  }
+};
+
+static uint64_t now_ns = 0;
+static uint64_t horizon_ns = UINT64_MAX;
+static uint32_t next_id = 1;
+static uint64_t event_count = 0;
+static std::priority_queue<QueuedEvent, std::vector<QueuedEvent>, std::greater<QueuedEvent>> queue;
+static std::unordered_map<uint32_t, sim_event_t> pending; // cancelled ids are missing
+
+static std::vector<SimEdge> edges;
+static bool edges_sorted = true;
+static bool pin_level[SIM_PINS];
+static std::deque<SimLevel> levels[SIM_PINS]; // front: the level at the last query
+static void (*pin_hook)(uint8_t pin, bool level) = 0;
+
+static sim_current_model_t current_model = 0;
+
+static FILE *serial_out = 0;
+static uint64_t serial_bytes = 0;
+static std::deque<uint8_t> serial_in;
+
+SimSerial Serial;
+
+uint64_t simNowNs() {
+  return now_ns;
+}
+
+uint32_t simAt(uint64_t tNs, sim_event_t fn) {
+  uint32_t id = next_id++;
+  if (tNs < now_ns) tNs = now_ns;
+  queue.push({tNs, id});
+  pending.emplace(id, std::move(fn));
+  return id;
+}
+
+void simCancel(uint32_t id) {
+  pending.erase(id);
+}
+
+// Drops cancelled entries off the top of the queue.
+static bool nextDue(uint64_t limitNs) {
+  while (!queue.empty() && pending.find(queue.top().id) == pending.end()) {
+    queue.pop();
+  }
+  return !queue.empty() && queue.top().tNs <= limitNs;
+}
+
+bool simRunNext(uint64_t limitNs) {
+  if (!nextDue(limitNs)) {
+    if (limitNs > now_ns) now_ns = limitNs;
+    return false;
+  }
+  QueuedEvent e = queue.top();
+  queue.pop();
+  auto it = pending.find(e.id);
+  sim_event_t fn = std::move(it->second);
+  pending.erase(it);
+  now_ns = e.tNs;
+  event_count++;
+  fn();
+  return true;
+}
+
+void simRunUntil(uint64_t tNs) {
+  while (simRunNext(tNs)) {
+  }
+}
+
+void simSetHorizon(uint64_t tNs) {
+  horizon_ns = tNs;
+}
+
+uint64_t simHorizon() {
+  return horizon_ns;
+}
+
+uint64_t simEvents() {
+  return event_count;
+}
+
+void simReset() {
+  now_ns = 0;
+  horizon_ns = UINT64_MAX;
+  event_count = 0;
+  queue = decltype(queue)();
+  pending.clear();
+  edges.clear();
+  edges_sorted = true;
+  for (int i = 0; i < SIM_PINS; i++) {
+    pin_level[i] = false;
+    levels[i].clear();
+  }
+  serial_in.clear();
+  serial_bytes = 0;
+}
+
+static void logEdge(uint64_t tNs, uint8_t pin, uint8_t kind, uint16_t value, uint16_t top) {
+  if (!edges.empty() && tNs < edges.back().tNs) edges_sorted = false;
+  edges.push_back({tNs, pin, kind, value, top});
+  if (pin < SIM_PINS) levels[pin].push_back({tNs, value, top});
+}
+
+void simPinWrite(uint8_t pin, bool level) {
+  if (pin >= SIM_PINS || pin_level[pin] == level) return;
+  pin_level[pin] = level;
+  logEdge(now_ns, pin, SIM_EDGE_GPIO, level, 1);
+}
+
+bool simPinRead(uint8_t pin) {
+  return pin < SIM_PINS && pin_level[pin];
+}
+
+void simPinInput(uint8_t pin, bool level) {
+  if (pin >= SIM_PINS || pin_level[pin] == level) return;
+  pin_level[pin] = level;
+  logEdge(now_ns, pin, SIM_EDGE_GPIO, level, 1);
+  if (pin_hook) pin_hook(pin, level);
+}
+
+void simPinHook(void (*hook)(uint8_t pin, bool level)) {
+  pin_hook = hook;
+}
+
+void simPwmRecord(uint64_t tNs, uint8_t pin, uint16_t value, uint16_t top) {
+  logEdge(tNs, pin, SIM_EDGE_PWM, value, top);
+}
+
+void simPwmTruncate(uint8_t pin, uint64_t tNs) {
+  // The PWM records of a pin are logged in time order, so the ones to drop
+  // are all after the last one before tNs.
+  size_t from = edges.size();
+  while (from > 0) {
+    const SimEdge &e = edges[from - 1];
+    if (e.pin == pin && e.kind == SIM_EDGE_PWM && e.tNs < tNs) break;
+    from--;
+  }
+  edges.erase(std::remove_if(edges.begin() + from, edges.end(),
+                             [&](const SimEdge &e) {
+                               return e.pin == pin && e.kind == SIM_EDGE_PWM && e.tNs >= tNs;
+                             }),
+              edges.end());
+  while (!levels[pin].empty() && levels[pin].back().tNs >= tNs) levels[pin].pop_back();
+}
+
+const std::vector<SimEdge> &simEdges() {
+  if (!edges_sorted) {
+    std::stable_sort(edges.begin(), edges.end(),
+                     [](const SimEdge &a, const SimEdge &b) { return a.tNs < b.tNs; });
+    edges_sorted = true;
+  }
+  return edges;
+}
+
+SimLevel simLevelAt(uint8_t pin, uint64_t tNs) {
+  std::deque<SimLevel> &l = levels[pin];
+  while (l.size() > 1 && l[1].tNs <= tNs) l.pop_front();
+  if (l.empty() || l.front().tNs > tNs) return {0, 0, 1};
+  return l.front();
+}
+
+uint64_t simNextChange(uint8_t pin, uint64_t tNs) {
+  for (const SimLevel &e : levels[pin]) {
+    if (e.tNs > tNs) return e.tNs;
+  }
+  return UINT64_MAX;
+}
+
+static int16_t plainLoad(uint64_t tNs, uint16_t onTicks, uint16_t top) {
+  (void)tNs;
+  // ~1.8 V across the shunt at 100%, 12 bit over 3.6 V.
+  return top > 0 ? (int16_t)((uint32_t)onTicks * 2048 / top) : 0;
+}
+
+void simSetCurrentModel(sim_current_model_t model) {
+  current_model = model;
+}
+
+int16_t simCurrentSample(uint64_t tNs, uint16_t onTicks, uint16_t top) {
+  return current_model ? current_model(tNs, onTicks, top) : plainLoad(tNs, onTicks, top);
+}
+
+void simSerialOutput(FILE *out) {
+  serial_out = out;
+}
+
+void simSerialInput(const uint8_t *data, size_t len) {
+  serial_in.insert(serial_in.end(), data, data + len);
+}
+
+uint64_t simSerialBytesOut() {
+  return serial_bytes;
+}
+
+// Arduino core
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  simPinWrite(pin, level != LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  return simPinRead(pin) ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  if (value < 0) value = 0;
+  if (value > 255) value = 255;
+  simPwmRecord(now_ns, pin, (uint16_t)value, 255);
+}
+
+unsigned long millis() {
+  return (unsigned long)(now_ns / 1000000);
+}
+
+unsigned long micros() {
+  return (unsigned long)(now_ns / 1000);
+}
+
+void delay(unsigned long ms) {
+  simRunUntil(now_ns + (uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simRunUntil(now_ns + (uint64_t)us * 1000);
+}
+
+void nrf_delay_us(uint32_t us) {
+  delayMicroseconds(us);
+}
+
+void nrf_delay_ms(uint32_t ms) {
+  delay(ms);
+}
+
+void __WFE() {
+  simRunNext(horizon_ns);
+}
+
+SimDwt sim_dwt;
+SimCoreDebug sim_core_debug;
+
+SimCycleCounter::operator uint32_t() const {
+  return (uint32_t)(now_ns * SIM_CPU_HZ / 1000000000ULL) - base;
+}
+
+SimCycleCounter &SimCycleCounter::operator=(uint32_t value) {
+  base = (uint32_t)(now_ns * SIM_CPU_HZ / 1000000000ULL) - value;
+  return *this;
+}
+
+void SimSerial::begin(unsigned long baud) {
+  (void)baud;
+}
+
+int SimSerial::available() {
+  return (int)serial_in.size();
+}
+
+int SimSerial::read() {
+  if (serial_in.empty()) return -1;
+  uint8_t b = serial_in.front();
+  serial_in.pop_front();
+  return b;
+}
+
+size_t SimSerial::write(const uint8_t *buf, size_t len) {
+  serial_bytes += len;
+  if (serial_out) fwrite(buf, 1, len, serial_out);
+  return len;
+}
+
+size_t SimSerial::write(uint8_t b) {
+  return write(&b, 1);
+}
+
+size_t SimSerial::print(const char *s) {
+  return write((const uint8_t *)s, strlen(s));
+}
+
+size_t SimSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t SimSerial::print(unsigned long n, int base) {
+  char buf[34];
+  snprintf(buf, sizeof(buf), base == HEX ? "%lX" : "%lu", n);
+  return print(buf);
+}
+
+size_t SimSerial::print(long n, int base) {
+  if (base != DEC) return print((unsigned long)n, base);
+  char buf[24];
+  snprintf(buf, sizeof(buf), "%ld", n);
+  return print(buf);
+}
+
+size_t SimSerial::print(unsigned char n, int base) {
+  return print((unsigned long)n, base);
+}
+
+size_t SimSerial::print(int n, int base) {
+  return print((long)n, base);
+}
+
+size_t SimSerial::print(unsigned int n, int base) {
+  return print((unsigned long)n, base);
+}
+
+size_t SimSerial::print(double n, int digits) {
+  char buf[48];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
@@ -0,0 +1,102 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+#include <vector>
+
+// Virtual-time core of the host build of the firmware (firmware_sim).
+// Nothing here waits for real time: an event queue holds everything the
+// peripherals would do later (PWM sequence ends, TIMER1 compares, SAADC
+// blocks, button edges), and sleeping or delay() simply jumps the clock to
+// the next event and runs it. Events play the part of the interrupts, they
+// always run from the main thread and never nest.
+
+typedef std::function<void()> sim_event_t;
+
+uint64_t simNowNs();
+// Schedules fn at the absolute time tNs (now if already past), same-time
+// events run in the order they were scheduled. Returns an id for simCancel().
+uint32_t simAt(uint64_t tNs, sim_event_t fn);
+void simCancel(uint32_t id);
+// Runs the next event if it is due by limitNs, otherwise moves the clock to
+// limitNs. Returns false when nothing ran.
+bool simRunNext(uint64_t limitNs);
+// Runs every event up to tNs and leaves the clock there (delay()).
+void simRunUntil(uint64_t tNs);
+// End of the run: sleeping with nothing due before it jumps there.
+void simSetHorizon(uint64_t tNs);
+uint64_t simHorizon();
+uint64_t simEvents(); // events run so far
+void simReset();      // clock 0, queue and edge log cleared
+
+// Pin edge log. GPIO records are logic levels; a PWM record is the on-time
+// of the carrier from tNs on (value/top, 0 = LOW), one record per duty
+// change rather than per carrier edge.
+enum sim_edge_kind_t {
+  SIM_EDGE_GPIO,
+  SIM_EDGE_PWM
+};
+
+struct SimEdge {
+  uint64_t tNs;
+  uint8_t pin;
+  uint8_t kind;
+  uint16_t value;
+  uint16_t top;
+};
+
+#define SIM_PINS 32
+
+void simPinWrite(uint8_t pin, bool level); // firmware output, logged on change
+bool simPinRead(uint8_t pin);
+void simPinInput(uint8_t pin, bool level); // driven from outside (button)
+void simPinHook(void (*hook)(uint8_t pin, bool level)); // input changes
+// PWM records can be logged ahead of time (a whole sequence at its start);
+// simPwmTruncate() drops the ones of pin at or after tNs when it stops early.
+void simPwmRecord(uint64_t tNs, uint8_t pin, uint16_t value, uint16_t top);
+void simPwmTruncate(uint8_t pin, uint64_t tNs);
+// Sorted by time (stable), so records logged ahead are in place.
+const std::vector<SimEdge> &simEdges();
+
+// Level of a pin for models that read the outputs (plant.h): the last record
+// at or before tNs, value/top as in SimEdge (0/1 for a GPIO level). The
+// queries of a pin must not go back in time.
+struct SimLevel {
+  uint64_t tNs;
+  uint16_t value;
+  uint16_t top;
+};
+SimLevel simLevelAt(uint8_t pin, uint64_t tNs);
+// First record of pin after tNs, UINT64_MAX when none is known yet.
+uint64_t simNextChange(uint8_t pin, uint64_t tNs);
+
+// Motor current seen by the SAADC on MOTOR_UI, in LSB (current_sense.h),
+// given the carrier on-time at the sample instant. The default is a plain
+// load: proportional to the duty, nothing when the drive is off.
+typedef int16_t (*sim_current_model_t)(uint64_t tNs, uint16_t onTicks, uint16_t top);
+void simSetCurrentModel(sim_current_model_t model);
+int16_t simCurrentSample(uint64_t tNs, uint16_t onTicks, uint16_t top);
+// CURRENT_SYNC samples taken while the motor is driven (on-time > 0), and
+// those of them that fell after the on-time of their period.
+struct SimSampleStats {
+  uint64_t driven;
+  uint64_t offTime;
+};
+const SimSampleStats &simSampleStats();
+// hwPWMStream() chunks since hwPWMInit(), and the shortest one in periods
+// among those with a refill behind them (all but the last of a stream).
+struct SimStreamStats {
+  uint64_t chunks;
+  uint32_t minRefillPeriods; // UINT32_MAX when none
+};
+const SimStreamStats &simStreamStats();
+
+// Serial: output goes to out (nullptr = dropped), input is read from the
+// bytes queued with simSerialInput().
+void simSerialOutput(FILE *out);
+void simSerialInput(const uint8_t *data, size_t len);
+uint64_t simSerialBytesOut();
+
+#endif
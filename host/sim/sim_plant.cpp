@@ -0,0 +1,99 @@
+#include <math.h>
+#include "sim_plant.h"
+#include "sim.h"
+#include "pins.h"
+
+#define TICK_NS 62.5 // 16 MHz PWM clock
+
+static PlantParams params;
+static PlantState state;
+static uint64_t at_ns;
+static bool valve_open;
+static double charge_from;
+static std::vector<SimPlantCycle> cycles;
+
+static int16_t plantCurrent(uint64_t tNs, uint16_t onTicks, uint16_t top) {
+  (void)onTicks;
+  (void)top;
+  simPlantAdvance(tNs);
+  return plantSenseLsb(params, state);
+}
+
+void simPlantBegin(const PlantParams &p) {
+  params = p;
+  plantInit(state);
+  at_ns = 0;
+  valve_open = false;
+  charge_from = 0;
+  cycles.clear();
+  simSetCurrentModel(plantCurrent);
+}
+
+static void valve(bool open) {
+  if (open && !valve_open) {
+    cycles.push_back({at_ns, plantMmHg(state.vacPeak), state.charge - charge_from});
+    charge_from = state.charge;
+  } else if (!open && valve_open) {
+    plantResetPeak(state);
+  }
+  valve_open = open;
+}
+
+static void segment(uint64_t toNs, bool on) {
+  plantSegment(params, state, (toNs - at_ns) * 1e-9, on, valve_open);
+  at_ns = toNs;
+}
+
+// PWM from level.tNs on, up to toNs: whole periods in one go, split only
+// where toNs or the start falls inside a period.
+static void pwm(const SimLevel &level, uint64_t toNs) {
+  double period = level.top * TICK_NS;
+  double on = level.value * TICK_NS;
+  while (at_ns < toNs) {
+    uint64_t n = (uint64_t)((at_ns - level.tNs) / period + 1e-9);
+    uint64_t start = level.tNs + llround(n * period);
+    if (at_ns == start) {
+      uint64_t whole = (uint64_t)((toNs - at_ns) / period + 1e-9);
+      if (whole > 0) {
+        plantPwm(params, state, whole, level.value, level.top, valve_open);
+        at_ns = level.tNs + llround((n + whole) * period);
+        continue;
+      }
+    }
+    uint64_t on_end = start + llround(on);
+    uint64_t end = level.tNs + llround((n + 1) * period);
+    if (at_ns < on_end) {
+      segment(on_end < toNs ? on_end : toNs, true);
+    } else {
+      segment(end < toNs ? end : toNs, false);
+    }
+  }
+}
+
+void simPlantAdvance(uint64_t tNs) {
+  static const uint8_t inputs[] = {MOTOR_PWM, SOL_ON_EN, SOL_ON_PWM};
+  while (at_ns < tNs) {
+    SimLevel motor = simLevelAt(MOTOR_PWM, at_ns);
+    valve(simLevelAt(SOL_ON_EN, at_ns).value && simLevelAt(SOL_ON_PWM, at_ns).value);
+    uint64_t next = tNs;
+    for (uint8_t pin : inputs) {
+      uint64_t t = simNextChange(pin, at_ns);
+      if (t < next) next = t;
+    }
+    if (motor.value == 0) {
+      segment(next, false);
+    } else if (motor.value >= motor.top) {
+      segment(next, true);
+    } else {
+      pwm(motor, next);
+    }
+  }
+}
+
+const PlantState &simPlantState() {
+  return state;
+}
+
+const std::vector<SimPlantCycle> &simPlantCycles() {
+  return cycles;
+}
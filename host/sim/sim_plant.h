@@ -0,0 +1,26 @@
+#ifndef SIM_PLANT_H
+#define SIM_PLANT_H
+
+#include <stdint.h>
+#include <vector>
+#include "plant.h"
+
+// The pump model (plant.h) on the simulated pins (sim.h): MOTOR_PWM drives
+// the motor switch, SOL_ON_EN and SOL_ON_PWM both high open the valve, and
+// the SAADC samples of MOTOR_UI read the model current. The model follows
+// the pins lazily, up to each sample and to simPlantAdvance().
+// PWM records are taken on the undivided 16 MHz clock (hwPWMTicks/HiRes/Stream).
+
+// One per valve opening: the vacuum reached by the build-up before it.
+struct SimPlantCycle {
+  uint64_t openNs;
+  double peakMmHg;
+  double chargeAs; // motor current since the previous opening
+};
+
+void simPlantBegin(const PlantParams &p); // also installs the current model
+void simPlantAdvance(uint64_t tNs);
+const PlantState &simPlantState();
+const std::vector<SimPlantCycle> &simPlantCycles();
+
+#endif
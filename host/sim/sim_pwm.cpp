@@ -0,0 +1,468 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include <deque>
+#include "sim.h"
+#include "hw_pwm.h"
+#include "handoff.h"
+#include "current_sense.h"
+#include "pins.h"
+#include "phase_timing.h"
+
+// PWM0, the TIMER2 hand-off and the SAADC for the host build (sim.h),
+// behind the same headers as hw_pwm.cpp, handoff.cpp and current_sense.cpp.
+// The three share PWM0 events in hardware (STOPPED through PPI, the
+// PWMPERIODEND sample trigger), so they share this file.
+
+#define PWM_CLOCK_HZ 16000000UL
+#define PWM_MAX_TOP 32767
+#define PWM_REFRESH_CNT_MAX 0xFFFFFF
+#define PWM_LOOP_CNT_MAX 0xFFFF
+
+// One of the two sequences: values held refresh + 1 periods each.
+struct SimSeq {
+  uint16_t values[PWM_STREAM_VALUES];
+  uint16_t count;
+  uint32_t refresh;
+  uint64_t startNs;
+};
+
+static SimSeq seqs[2];
+static int playing;
+static uint32_t seqs_to_play;      // including the one playing
+static uint32_t stream_seqs_left;  // still to be programmed, as in hw_pwm.cpp
+static uint32_t stream_chunks_left;
+static pwm_fill_t stream_fill = 0;
+static pwm_start_t stream_started = 0;
+static uint32_t stream_starts_left;
+static uint16_t stream_min[2];
+static SimStreamStats stream_stats;
+static uint32_t seq_end_event;
+static bool stopping;
+static bool busy = false;
+static pwm_done_t done_cb = 0;
+static uint8_t out_pin;
+static uint16_t out_top;
+static uint64_t period_ns;
+static int32_t last_logged = -1; // PWM record of out_pin, merged when equal
+
+// Motor drive on-time from a time on, what the SAADC sees on MOTOR_UI.
+struct MotorLevel {
+  uint64_t tNs;
+  uint16_t onTicks;
+};
+static std::deque<MotorLevel> motor;
+static uint16_t motor_top = 1;
+
+static void onPeriodsStart(uint64_t t0);
+static void onPeriodsStop(uint64_t tStop);
+static void onHandoffStart(uint64_t t);
+
+static void logLevel(uint64_t t, uint16_t value) {
+  if ((int32_t)value != last_logged) {
+    simPwmRecord(t, out_pin, value, out_top);
+    last_logged = value;
+  }
+  uint16_t on = out_pin == MOTOR_PWM ? value : 0;
+  if (motor.empty() || motor.back().onTicks != on) motor.push_back({t, on});
+}
+
+static uint64_t valueNs(const SimSeq &s) {
+  return (uint64_t)(s.refresh + 1) * period_ns;
+}
+
+static void onSeqEnd(int n);
+
+// The hardware starts sequence n, every value is known from here on.
+static void playSeq(int n, uint64_t t) {
+  SimSeq &s = seqs[n];
+  playing = n;
+  s.startNs = t;
+  for (uint16_t i = 0; i < s.count; i++) {
+    logLevel(t + i * valueNs(s), s.values[i]);
+  }
+  seq_end_event = simAt(t + s.count * valueNs(s), [n]() { onSeqEnd(n); });
+}
+
+static void loadSeq(int n) {
+  SimSeq &s = seqs[n];
+  uint16_t count = 0;
+  uint32_t refresh = 0;
+  if (stream_chunks_left > 0) {
+    stream_chunks_left--;
+    count = stream_fill(s.values, PWM_STREAM_VALUES, &refresh);
+    uint32_t periods = count * (refresh + 1);
+    stream_stats.chunks++;
+    if (stream_chunks_left > 0 && periods < stream_stats.minRefillPeriods) {
+      stream_stats.minRefillPeriods = periods;
+    }
+  }
+  if (count == 0) {
+    s.values[0] = 0;
+    count = 1;
+    refresh = 0;
+  }
+  stream_min[n] = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (s.values[i] > out_top) s.values[i] = out_top;
+    if (s.values[i] > 0 && (stream_min[n] == 0 || s.values[i] < stream_min[n])) stream_min[n] = s.values[i];
+  }
+  if (refresh > PWM_REFRESH_CNT_MAX) refresh = PWM_REFRESH_CNT_MAX;
+  s.count = count;
+  s.refresh = refresh;
+  stream_seqs_left--;
+}
+
+static void streamStarted(int n) {
+  if (stream_starts_left == 0) return;
+  stream_starts_left--;
+  if (stream_started) stream_started(stream_min[n]);
+}
+
+static void onStopped() {
+  uint64_t t = simNowNs();
+  stream_seqs_left = 0;
+  stream_fill = 0;
+  stream_starts_left = 0;
+  busy = false;
+  stopping = false;
+  onHandoffStart(t);
+  onPeriodsStop(t);
+  pwm_done_t cb = done_cb;
+  done_cb = 0;
+  if (cb) cb();
+}
+
+// SEQEND[n]: the other sequence starts right away (LOOP), n is refilled.
+static void onSeqEnd(int n) {
+  PT_IRQ_ENTRY();
+  if (--seqs_to_play == 0) {
+    onStopped();
+    return;
+  }
+  playSeq(n ^ 1, simNowNs());
+  streamStarted(n ^ 1);
+  if (stream_seqs_left > 0) loadSeq(n);
+}
+
+static void start(uint32_t prescaler, uint16_t top, int pin, pwm_done_t done) {
+  digitalWrite(pin, LOW);
+  busy = true;
+  stopping = false;
+  done_cb = done;
+  out_pin = pin;
+  out_top = top;
+  last_logged = -1;
+  period_ns = ((uint64_t)top << prescaler) * 1000000000ULL / PWM_CLOCK_HZ;
+  if (pin == MOTOR_PWM) motor_top = top;
+  onPeriodsStart(simNowNs());
+  playSeq(0, simNowNs());
+}
+
+void hwPWMInit() {
+  busy = false;
+  done_cb = 0;
+  motor.clear();
+  motor.push_back({0, 0});
+  stream_stats = SimStreamStats{0, UINT32_MAX};
+}
+
+const SimStreamStats &simStreamStats() {
+  return stream_stats;
+}
+
+static int pwmStart(uint32_t prescaler, uint32_t top, uint32_t onTicks, uint32_t cycles,
+                    int pin, pwm_done_t done) {
+  if (cycles == 0) {
+    if (done) done();
+    return 1;
+  }
+  if (cycles > PWM_REFRESH_CNT_MAX + 1) cycles = PWM_REFRESH_CNT_MAX + 1;
+  if (onTicks > top) onTicks = top;
+  seqs[0].values[0] = onTicks;
+  seqs[0].count = 1;
+  seqs[0].refresh = cycles - 1;
+  seqs[1].values[0] = 0;
+  seqs[1].count = 1;
+  seqs[1].refresh = 0;
+  seqs_to_play = 2;
+  stream_seqs_left = 0;
+  stream_starts_left = 0;
+  start(prescaler, top, pin, done);
+  return 1;
+}
+
+int hwPWM(int durationMs, int PWM, int frequencyKhz, int pin, pwm_done_t done) {
+  if (busy || frequencyKhz <= 0) return 0;
+  uint32_t frequencyHz = frequencyKhz * 1000UL;
+  uint32_t cycles = durationMs > 0 ? durationMs * frequencyHz / 1000 : 0;
+  uint32_t prescaler = 0;
+  while (prescaler < 7 && (PWM_CLOCK_HZ >> prescaler) / frequencyHz > PWM_MAX_TOP) {
+    prescaler++;
+  }
+  uint32_t top = (PWM_CLOCK_HZ >> prescaler) / frequencyHz;
+  if (top > PWM_MAX_TOP) top = PWM_MAX_TOP;
+  if (PWM < 0) PWM = 0;
+  if (PWM > 255) PWM = 255;
+  return pwmStart(prescaler, top, top * PWM / 255, cycles, pin, done);
+}
+
+int hwPWMHiRes(int durationMs, uint16_t duty, uint16_t countertop, int pin, pwm_done_t done) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP) return 0;
+  if (duty > PWM_DUTY_FULL) duty = PWM_DUTY_FULL;
+  uint32_t onTicks = ((uint32_t)countertop * duty + PWM_DUTY_FULL / 2) / PWM_DUTY_FULL;
+  uint32_t cycles = durationMs > 0 ? (uint64_t)durationMs * (PWM_CLOCK_HZ / 1000) / countertop : 0;
+  return pwmStart(0, countertop, onTicks, cycles, pin, done);
+}
+
+int hwPWMTicks(uint32_t cycles, uint16_t onTicks, uint16_t countertop, int pin, pwm_done_t done) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP) return 0;
+  return pwmStart(0, countertop, onTicks, cycles, pin, done);
+}
+
+int hwPWMStream(uint32_t chunks, uint16_t countertop, int pin, pwm_fill_t fill, pwm_done_t done,
+                pwm_start_t started) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP || fill == 0) return 0;
+  uint32_t loops = (chunks + 2) / 2;
+  if (loops > PWM_LOOP_CNT_MAX) return 0;
+  out_top = countertop;
+  stream_fill = fill;
+  stream_chunks_left = chunks;
+  stream_seqs_left = loops * 2;
+  seqs_to_play = loops * 2;
+  stream_started = started;
+  stream_starts_left = chunks;
+  loadSeq(0);
+  loadSeq(1);
+  streamStarted(0);
+  start(0, countertop, pin, done);
+  return 1;
+}
+
+bool hwPWMBusy() {
+  return busy;
+}
+
+void hwPWMWait() {
+  while (busy) {
+    __WFE();
+  }
+}
+
+// TASKS_STOP: the running period is finished, then STOPPED.
+void hwPWMStop() {
+  if (!busy || stopping) return;
+  stopping = true;
+  uint64_t t0 = seqs[playing].startNs;
+  uint64_t t = t0 + ((simNowNs() - t0) / period_ns + 1) * period_ns;
+  simCancel(seq_end_event);
+  simPwmTruncate(out_pin, t);
+  while (!motor.empty() && motor.back().tNs >= t) motor.pop_back();
+  last_logged = -1;
+  logLevel(t, 0);
+  seqs_to_play = 0;
+  stream_seqs_left = 0;
+  simAt(t, onStopped);
+}
+
+// handoff.h: TIMER2 started by STOPPED, compares on the solenoid lines.
+
+static bool handoff_armed = false;
+static uint32_t handoff_gap_us;
+static uint32_t handoff_open_us;
+static handoff_done_t handoff_cb = 0;
+static uint32_t handoff_events[2];
+static bool handoff_running = false;
+
+void handoffInit() {
+  handoff_armed = false;
+  handoff_running = false;
+}
+
+void handoffArm(uint32_t gapUs, uint32_t openUs, handoff_done_t done) {
+  handoff_gap_us = gapUs;
+  handoff_open_us = openUs;
+  handoff_cb = done;
+  handoff_armed = true;
+}
+
+void handoffDisarm() {
+  if (handoff_running) {
+    simCancel(handoff_events[0]);
+    simCancel(handoff_events[1]);
+  }
+  handoff_armed = false;
+  handoff_running = false;
+  handoff_cb = 0;
+  SolOn::low();
+}
+
+static void onHandoffStart(uint64_t t) {
+  if (!handoff_armed || handoff_running) return;
+  handoff_running = true;
+  handoff_events[0] = simAt(t + handoff_gap_us * 1000ULL, []() { SolOn::high(); });
+  handoff_events[1] = simAt(t + (handoff_gap_us + (uint64_t)handoff_open_us) * 1000ULL, []() {
+    SolOn::low();
+    handoff_armed = false;
+    handoff_running = false;
+    handoff_done_t cb = handoff_cb;
+    handoff_cb = 0;
+    PT_IRQ_ENTRY();
+    if (cb) cb();
+  });
+}
+
+// current_sense.h. CURRENT_SYNC: every PWM0 period end is followed by a
+// sample delay_ticks later, so the n-th period of a drive is sampled at
+// t0 + n * period + delay. Samples are only computed when the block is
+// due: one event per block instead of one per period.
+
+static current_block_cb_t block_cb = 0;
+static int16_t block[CURRENT_BLOCK_SAMPLES];
+static uint16_t block_len = CURRENT_BLOCK_SAMPLES;
+static uint16_t block_have;
+static uint32_t block_count;
+static bool sampling = false;
+static bool sync_mode;
+static uint64_t sample_period_ns;
+static uint16_t delay_ticks = 1;
+static uint64_t periods_from;  // first period end not sampled yet
+static uint64_t periods_until; // drive end, UINT64_MAX while running
+static bool periods_running;
+static uint32_t block_event;
+static bool block_pending = false;
+static SimSampleStats sample_stats;
+
+static uint16_t motorAt(uint64_t t) {
+  while (motor.size() > 1 && motor[1].tNs <= t) motor.pop_front();
+  return motor.front().onTicks;
+}
+
+static uint64_t delayNs() {
+  return (uint64_t)delay_ticks * 1000000000ULL / PWM_CLOCK_HZ;
+}
+
+// Time of the n-th sample (1 based) from periods_from.
+static uint64_t sampleAt(uint32_t n) {
+  return periods_from + n * sample_period_ns + (sync_mode ? delayNs() : 0);
+}
+
+static void takeSamples(uint32_t n) {
+  for (uint32_t i = 1; i <= n; i++) {
+    uint64_t t = sampleAt(i);
+    uint16_t on = motorAt(t);
+    if (sync_mode && on > 0) {
+      sample_stats.driven++;
+      if (delay_ticks >= on) sample_stats.offTime++;
+    }
+    block[block_have++] = simCurrentSample(t, on, motor_top);
+  }
+  periods_from += n * sample_period_ns;
+}
+
+static void scheduleBlock();
+
+static void onBlock() {
+  block_pending = false;
+  takeSamples(block_len - block_have);
+  block_have = 0;
+  block_count++;
+  if (block_cb) block_cb(block, block_len);
+  scheduleBlock();
+}
+
+static void scheduleBlock() {
+  if (!sampling || !periods_running) return;
+  uint32_t need = block_len - block_have;
+  if (periods_from + need * sample_period_ns > periods_until) return;
+  block_pending = true;
+  block_event = simAt(sampleAt(need), onBlock);
+}
+
+static void onPeriodsStart(uint64_t t0) {
+  if (!sampling || !sync_mode) return;
+  sample_period_ns = period_ns;
+  periods_from = t0;
+  periods_until = UINT64_MAX;
+  periods_running = true;
+  scheduleBlock();
+}
+
+static void onPeriodsStop(uint64_t tStop) {
+  if (!sampling || !sync_mode || !periods_running) return;
+  periods_until = tStop;
+  uint32_t left = (tStop - periods_from) / sample_period_ns;
+  // The pending block still completes on the last period ends.
+  if (block_pending && left >= (uint32_t)(block_len - block_have)) return;
+  if (block_pending) simCancel(block_event);
+  block_pending = false;
+  takeSamples(left);
+  periods_running = false;
+}
+
+void currentInit(current_block_cb_t cb) {
+  block_cb = cb;
+  sample_stats = SimSampleStats{0, 0};
+}
+
+const SimSampleStats &simSampleStats() {
+  return sample_stats;
+}
+
+// The samples already taken by the hardware keep the old delay, the block
+// event moves with the new one unless it is due right now.
+void currentSetDelay(uint16_t ticks) {
+  bool move = block_pending;
+  if (sampling && sync_mode && periods_running) {
+    uint32_t due = 0;
+    while (block_have + due + 1 < block_len && sampleAt(due + 1) <= simNowNs()) due++;
+    takeSamples(due);
+    if (sampleAt(block_len - block_have) <= simNowNs()) move = false;
+  }
+  delay_ticks = ticks > 0 ? ticks : 1;
+  if (move) {
+    simCancel(block_event);
+    block_pending = false;
+    scheduleBlock();
+  }
+}
+
+void currentStart(current_trigger_t trigger, uint32_t rateHz, uint16_t blockSamples) {
+  currentStop();
+  block_len = blockSamples > 0 && blockSamples <= CURRENT_BLOCK_SAMPLES ? blockSamples : CURRENT_BLOCK_SAMPLES;
+  block_count = 0;
+  block_have = 0;
+  sampling = true;
+  sync_mode = trigger == CURRENT_SYNC;
+  if (sync_mode) {
+    periods_running = false;
+    if (busy) onPeriodsStart(simNowNs());
+    return;
+  }
+  if (rateHz == 0 || rateHz > CURRENT_MAX_RATE_HZ) rateHz = CURRENT_MAX_RATE_HZ;
+  sample_period_ns = 1000000000ULL / rateHz;
+  periods_from = simNowNs();
+  periods_until = UINT64_MAX;
+  periods_running = true;
+  scheduleBlock();
+}
+
+void currentStop() {
+  if (block_pending) simCancel(block_event);
+  block_pending = false;
+  sampling = false;
+  periods_running = false;
+}
+
+uint32_t currentBlocks() {
+  return block_count;
+}
+
+void currentRealign() {
+  if (!sampling || !sync_mode) return;
+  block_have = 0;
+  if (block_pending) {
+    simCancel(block_event);
+    block_pending = false;
+    scheduleBlock();
+  }
+}
@@ -0,0 +1,110 @@
+#include <Arduino.h>
+#include "sim.h"
+#include "hw_timer.h"
+#include "button.h"
+#include "pins.h"
+#include "phase_timing.h"
+
+// TIMER1 and the button for the host build (sim.h), behind the same
+// headers as hw_timer.cpp and button.cpp. The time base is the virtual
+// clock in us, wrapping at 32 bit like the hardware.
+
+static timer_cb_t callbacks[HW_TIMER_CHANNELS];
+static uint32_t events[HW_TIMER_CHANNELS];
+static uint32_t captured_us;
+
+void hwTimerInit() {
+  for (int ch = 0; ch < HW_TIMER_CHANNELS; ch++) hwTimerCancel(ch);
+}
+
+uint32_t hwTimerNowUs() {
+  return (uint32_t)(simNowNs() / 1000);
+}
+
+void hwTimerAt(int ch, uint32_t atUs, timer_cb_t cb) {
+  hwTimerCancel(ch);
+  int32_t delta = (int32_t)(atUs - hwTimerNowUs());
+  uint64_t t = delta <= 0 ? simNowNs() : (simNowNs() / 1000 + delta) * 1000;
+  callbacks[ch] = cb;
+  events[ch] = simAt(t, [ch]() {
+    timer_cb_t fn = callbacks[ch];
+    callbacks[ch] = 0;
+    events[ch] = 0;
+    PT_IRQ_ENTRY();
+    if (fn) fn();
+  });
+}
+
+void hwTimerCancel(int ch) {
+  if (events[ch]) simCancel(events[ch]);
+  events[ch] = 0;
+  callbacks[ch] = 0;
+}
+
+uint32_t hwTimerCaptureTask() {
+  return 0;
+}
+
+uint32_t hwTimerCapturedUs() {
+  return captured_us;
+}
+
+// Button: same debounce and long press logic as button.cpp, the GPIOTE
+// edge comes from simPinInput(BUTTON, ...) and is stamped right away.
+
+static uint32_t debounce_us;
+static uint32_t long_us;
+static button_cb_t button_cb = 0;
+static bool pressed = false;
+static bool settling = false;
+static uint32_t edge_at;
+static uint32_t pressed_at;
+static bool long_sent;
+
+static void onLongPress() {
+  if (pressed && !long_sent) {
+    long_sent = true;
+    if (button_cb) button_cb(BUTTON_LONG, pressed_at);
+  }
+}
+
+static void onDebounce() {
+  settling = false;
+  bool level = Button::read();
+  if (level == pressed) {
+    if (pressed && !long_sent) hwTimerAt(TIMER_CH_BUTTON, pressed_at + long_us, onLongPress);
+    return;
+  }
+  pressed = level;
+  if (level) {
+    pressed_at = edge_at;
+    long_sent = false;
+    hwTimerAt(TIMER_CH_BUTTON, pressed_at + long_us, onLongPress);
+  } else if (!long_sent) {
+    if (button_cb) button_cb(BUTTON_SHORT, pressed_at);
+  }
+}
+
+static void onPinInput(uint8_t pin, bool level) {
+  (void)level;
+  if (pin != BUTTON) return;
+  captured_us = hwTimerNowUs();
+  if (!settling) {
+    settling = true;
+    edge_at = captured_us;
+  }
+  hwTimerAt(TIMER_CH_BUTTON, captured_us + debounce_us, onDebounce);
+}
+
+void buttonInit(uint32_t debounceMs, uint32_t longMs, button_cb_t cb) {
+  debounce_us = debounceMs * 1000UL;
+  long_us = longMs * 1000UL;
+  button_cb = cb;
+  pressed = Button::read();
+  long_sent = true;
+  simPinHook(onPinInput);
+}
+
+bool buttonPressed() {
+  return pressed;
+}
@@ -0,0 +1,196 @@
+#include <string.h>
+#include "trace.h"
+#include "pins.h"
+
+static const uint8_t signal_pins[TRACE_SIGNALS] = {MOTOR_PWM, SOL_ON_EN, SOL_ON_PWM, BUTTON};
+static const char *const signal_names[TRACE_SIGNALS] = {"MOTOR_PWM", "SOL_ON_EN", "SOL_ON_PWM", "BUTTON"};
+static const char trace_magic[4] = {'P', 'T', 'R', 'C'};
+
+int traceSignal(uint8_t pin) {
+  for (int s = 0; s < TRACE_SIGNALS; s++) {
+    if (signal_pins[s] == pin) return s;
+  }
+  return -1;
+}
+
+const char *traceSignalName(int sig) {
+  return sig >= 0 && sig < TRACE_SIGNALS ? signal_names[sig] : "?";
+}
+
+static void put(std::vector<uint8_t> &b, uint64_t v) {
+  while (v >= 0x80) {
+    b.push_back((uint8_t)(v | 0x80));
+    v >>= 7;
+  }
+  b.push_back((uint8_t)v);
+}
+
+static const uint8_t *get(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+  uint64_t x = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    uint8_t c = *p++;
+    x |= (uint64_t)(c & 0x7F) << shift;
+    if (!(c & 0x80)) {
+      *v = x;
+      return p;
+    }
+  }
+  return 0;
+}
+
+void traceBegin(Trace &t) {
+  t.bytes.clear();
+  t.edges = 0;
+  t.lastNs = 0;
+  for (int s = 0; s < TRACE_SIGNALS; s++) t.top[s] = 1;
+}
+
+void traceAdd(Trace &t, const TraceEdge &e) {
+  bool top_change = e.top != t.top[e.sig];
+  put(t.bytes, e.tNs - t.lastNs);
+  put(t.bytes, e.sig | (uint64_t)top_change << 2 | (uint64_t)e.value << 3);
+  if (top_change) put(t.bytes, e.top);
+  t.top[e.sig] = e.top;
+  t.lastNs = e.tNs;
+  t.edges++;
+}
+
+bool traceDecode(const Trace &t, std::vector<TraceEdge> &out) {
+  out.clear();
+  out.reserve(t.edges);
+  uint16_t top[TRACE_SIGNALS] = {1, 1, 1, 1};
+  uint64_t now = 0;
+  const uint8_t *p = t.bytes.data();
+  const uint8_t *end = p + t.bytes.size();
+  while (p < end) {
+    uint64_t dt, head, top_value;
+    if (!(p = get(p, end, &dt)) || !(p = get(p, end, &head))) return false;
+    uint8_t sig = head & 3;
+    if (head & 4) {
+      if (!(p = get(p, end, &top_value))) return false;
+      top[sig] = (uint16_t)top_value;
+    }
+    now += dt;
+    out.push_back({now, sig, (uint16_t)(head >> 3), top[sig]});
+  }
+  return out.size() == t.edges;
+}
+
+bool traceSave(const Trace &t, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  uint8_t head[9];
+  memcpy(head, trace_magic, 4);
+  head[4] = TRACE_VERSION;
+  for (int i = 0; i < 4; i++) head[5 + i] = (uint8_t)(t.edges >> (8 * i));
+  bool ok = fwrite(head, 1, sizeof(head), f) == sizeof(head) &&
+            fwrite(t.bytes.data(), 1, t.bytes.size(), f) == t.bytes.size();
+  return fclose(f) == 0 && ok;
+}
+
+bool traceLoad(Trace &t, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  traceBegin(t);
+  uint8_t head[9];
+  bool ok = fread(head, 1, sizeof(head), f) == sizeof(head) && memcmp(head, trace_magic, 4) == 0 &&
+            head[4] == TRACE_VERSION;
+  if (ok) {
+    for (int i = 0; i < 4; i++) t.edges |= (uint32_t)head[5 + i] << (8 * i);
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) t.bytes.insert(t.bytes.end(), buf, buf + n);
+  }
+  fclose(f);
+  return ok;
+}
+
+void traceWriteVcd(const Trace &t, FILE *out) {
+  std::vector<TraceEdge> edges;
+  traceDecode(t, edges);
+  fprintf(out, "$timescale 1ns $end\n$scope module firmware $end\n");
+  for (int s = 0; s < TRACE_SIGNALS; s++) {
+    fprintf(out, "$var wire 1 %c %s $end\n", '!' + 2 * s, signal_names[s]);
+    fprintf(out, "$var real 64 %c %s_duty $end\n", '!' + 2 * s + 1, signal_names[s]);
+  }
+  fprintf(out, "$upscope $end\n$enddefinitions $end\n#0\n$dumpvars\n");
+  for (int s = 0; s < TRACE_SIGNALS; s++) {
+    fprintf(out, "0%c\nr0 %c\n", '!' + 2 * s, '!' + 2 * s + 1);
+  }
+  fprintf(out, "$end\n");
+  uint64_t at = 0;
+  for (const TraceEdge &e : edges) {
+    if (e.tNs != at) {
+      fprintf(out, "#%llu\n", (unsigned long long)e.tNs);
+      at = e.tNs;
+    }
+    fprintf(out, "%c%c\nr%.6g %c\n", e.value ? '1' : '0', '!' + 2 * e.sig,
+            e.top ? (double)e.value / e.top : 0.0, '!' + 2 * e.sig + 1);
+  }
+}
+
+// Level changes of one signal, repeats dropped.
+static void changes(const std::vector<TraceEdge> &all, int sig, std::vector<TraceEdge> &out) {
+  out.clear();
+  for (const TraceEdge &e : all) {
+    if (e.sig != sig) continue;
+    // Same duty (0 is 0 whatever the top): not a change.
+    if (!out.empty() && (uint32_t)e.value * out.back().top == (uint32_t)out.back().value * e.top) continue;
+    if (out.empty() && e.value == 0) continue; // every signal starts LOW
+    out.push_back(e);
+  }
+}
+
+static void printTime(FILE *f, uint64_t ns) {
+  fprintf(f, "%llu.%09llu s", (unsigned long long)(ns / 1000000000ULL),
+          (unsigned long long)(ns % 1000000000ULL));
+}
+
+uint32_t traceDiff(const Trace &golden, const Trace &run, const TraceDiffOptions &o,
+                   TraceDiffResult &r, FILE *report) {
+  memset(&r, 0, sizeof(r));
+  std::vector<TraceEdge> all[2], ch[2];
+  if (!traceDecode(golden, all[0]) || !traceDecode(run, all[1])) {
+    if (report) fprintf(report, "corrupt trace\n");
+    return r.mismatches = 1;
+  }
+  for (int s = 0; s < TRACE_SIGNALS; s++) {
+    changes(all[0], s, ch[0]);
+    changes(all[1], s, ch[1]);
+    r.changes[0][s] = ch[0].size();
+    r.changes[1][s] = ch[1].size();
+    uint32_t reported = 0;
+    size_t n = ch[0].size() < ch[1].size() ? ch[0].size() : ch[1].size();
+    for (size_t i = 0; i < n; i++) {
+      const TraceEdge &g = ch[0][i];
+      const TraceEdge &e = ch[1][i];
+      int64_t dev = (int64_t)(e.tNs - g.tNs);
+      if (o.intervals && i > 0) dev -= (int64_t)(ch[1][i - 1].tNs - ch[0][i - 1].tNs);
+      uint64_t adev = dev < 0 ? -dev : dev;
+      if (adev > r.maxDevNs[s]) r.maxDevNs[s] = adev;
+      int diff_ticks = (int)e.value - (int)g.value;
+      bool value_bad = e.top != g.top || diff_ticks > o.tolTicks || -diff_ticks > o.tolTicks;
+      if (!value_bad && adev <= o.tolNs) continue;
+      r.mismatches++;
+      if (report && reported++ < o.maxReports) {
+        fprintf(report, "%s change %zu at ", signal_names[s], i);
+        printTime(report, g.tNs);
+        if (value_bad) fprintf(report, ": %u/%u, expected %u/%u", e.value, e.top, g.value, g.top);
+        if (adev > o.tolNs) fprintf(report, ": %s%lld ns%s", dev < 0 ? "" : "+", (long long)dev,
+                                   o.intervals ? " on the interval" : "");
+        fprintf(report, "\n");
+      }
+    }
+    if (ch[0].size() != ch[1].size()) {
+      r.mismatches++;
+      if (report) {
+        fprintf(report, "%s: %zu changes, expected %zu", signal_names[s], ch[1].size(), ch[0].size());
+        const TraceEdge &first = ch[0].size() > n ? ch[0][n] : ch[1][n];
+        fprintf(report, ", first %s one at ", ch[0].size() > n ? "missing" : "extra");
+        printTime(report, first.tNs);
+        fprintf(report, "\n");
+      }
+    }
+  }
+  return r.mismatches;
+}
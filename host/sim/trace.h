@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+// Pin trace of a firmware_sim run: every change of MOTOR_PWM, SOL_ON_EN,
+// SOL_ON_PWM and BUTTON, kept as a byte stream, saved as a .trc file, exported
+// to VCD and compared against a golden run.
+//
+// Record: varint time since the previous record (ns, 64 bit), then
+// varint(signal | top follows << 2 | value << 3), then varint top when it
+// follows. A GPIO level is value 0/1 with top 1, a PWM record the on-time
+// in counter ticks with the countertop; the top is only stored when it
+// changes. About 4 bytes per record on a stage run.
+// File: "PTRC", version byte, u32 record count (LE), the records.
+
+#define TRACE_SIGNALS 4
+#define TRACE_VERSION 1
+
+struct TraceEdge {
+  uint64_t tNs;
+  uint8_t sig;
+  uint16_t value;
+  uint16_t top;
+};
+
+struct Trace {
+  std::vector<uint8_t> bytes;
+  uint32_t edges;
+  uint64_t lastNs;
+  uint16_t top[TRACE_SIGNALS];
+};
+
+int traceSignal(uint8_t pin); // -1 for pins that are not traced
+const char *traceSignalName(int sig);
+
+void traceBegin(Trace &t);
+void traceAdd(Trace &t, const TraceEdge &e); // in time order
+// false on a truncated or corrupt stream.
+bool traceDecode(const Trace &t, std::vector<TraceEdge> &out);
+bool traceSave(const Trace &t, const char *path);
+bool traceLoad(Trace &t, const char *path);
+
+// One real (duty 0-1) and one wire (on/off) per signal, 1 ns timescale.
+void traceWriteVcd(const Trace &t, FILE *out);
+
+// Comparison per signal, n-th change against n-th change; repeats of the
+// same level are not changes. A value differs when the tops differ or the
+// on-times are more than tolTicks apart; a time when it is more than tolNs
+// off, absolute or (intervals) measured from the previous change of the
+// same signal, so one late edge does not fail everything after it.
+struct TraceDiffOptions {
+  uint64_t tolNs;
+  uint16_t tolTicks;
+  bool intervals;
+  uint32_t maxReports; // mismatch lines printed per signal
+};
+
+struct TraceDiffResult {
+  uint32_t changes[2][TRACE_SIGNALS];
+  uint64_t maxDevNs[TRACE_SIGNALS];
+  uint32_t mismatches;
+};
+
+// Mismatches are described on report (may be nullptr). Returns the count.
+uint32_t traceDiff(const Trace &golden, const Trace &run, const TraceDiffOptions &o,
+                   TraceDiffResult &r, FILE *report);
+
+#endif
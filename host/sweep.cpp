@@ -0,0 +1,243 @@
+// Parameter sweep of the stage drive on the pump model (sim/pump_cycle.h),
+// one independent cycle per combination, spread over all cores by the
+// work-stealing loop of sim/parallel.h.
+//   make -C host && host/build/sweep [options]
+//   -b from:to:step   build-up ms, kick included   (default 200:900:10)
+//   -d from:to:step   build-up duty %               (default 20:90:2)
+//   -k from:to:step   kick mV                       (default 1500:1500:1)
+//   -f from:to:step   PWM carrier Hz                (default 20000:20000:1)
+//   -j threads        0 = one per hardware thread   (default 0)
+//   -g grain          cycles per batch, taken and   (default 64)
+//                     stolen whole
+//   -i isa            best, scalar, avx2, avx512    (default best)
+//   -V                also runs the grid on the scalar solver and prints
+//                     the largest difference per result
+//   -o prefix         little endian columns (numpy.fromfile), one value
+//                     per cycle: <prefix>.build_up_ms.u16 .duty_pct.u8
+//                     .kick_mv.u16 .freq_hz.u32 .peak_mmhg.f32
+//                     .charge_mas.f32 .peak_a.f32 .end_rad_s.f32
+//   -c                the same as CSV on stdout
+//   -S                scaling run: 1, 2, 4 ... threads, no output; with
+//                     -V the scalar solver against the batched one
+// Every cycle starts from a pump at rest. The index runs over duty fastest,
+// then build-up, kick and carrier.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "parallel.h"
+#include "pump_cycle.h"
+#include "sweep_schedule.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct Range {
+  uint32_t from, to, step;
+  uint32_t count() const { return to < from ? 0 : (to - from) / step + 1; }
+  uint32_t at(uint32_t k) const { return from + k * step; }
+};
+
+struct Job {
+  uint16_t buildUpMs;
+  uint8_t dutyPct;
+  uint16_t kickMv;
+  uint32_t freqHz;
+};
+
+static Range ranges[4]; // duty, build-up, kick, carrier
+
+static bool parseRange(const char *arg, Range &r) {
+  unsigned a, b, s = 1;
+  int n = sscanf(arg, "%u:%u:%u", &a, &b, &s);
+  if (n < 1 || s == 0) return false;
+  r.from = a;
+  r.to = n >= 2 ? b : a;
+  r.step = s;
+  return r.count() > 0;
+}
+
+static uint64_t jobCount() {
+  uint64_t n = 1;
+  for (const Range &r : ranges) n *= r.count();
+  return n;
+}
+
+static Job job(uint64_t index) {
+  uint32_t k[4];
+  for (int i = 0; i < 4; i++) {
+    k[i] = index % ranges[i].count();
+    index /= ranges[i].count();
+  }
+  return Job{(uint16_t)ranges[1].at(k[1]), (uint8_t)ranges[0].at(k[0]), (uint16_t)ranges[2].at(k[2]),
+             ranges[3].at(k[3])};
+}
+
+static std::vector<CycleResult> results;
+
+// Cycles [from, to) in one call of the batched solver.
+static void runBlock(const PlantParams &p, uint64_t from, uint64_t to, PlantIsa isa) {
+  uint32_t n = (uint32_t)(to - from);
+  std::vector<CycleSpec> specs(n);
+  std::vector<PlantState> states(n);
+  for (uint32_t k = 0; k < n; k++) {
+    Job j = job(from + k);
+    specs[k] = cycleSpec(j.buildUpMs, j.dutyPct, j.kickMv / 1000.0, p.supplyV, j.freqHz);
+    plantInit(states[k]);
+  }
+  runCycles(p, states.data(), specs.data(), &results[from], n, isa);
+}
+
+// The loop hands out blocks of grain cycles, stolen whole.
+static double runAll(const PlantParams &p, uint32_t threads, uint32_t grain, PlantIsa isa, ParallelStats *stats) {
+  Clock::time_point t0 = Clock::now();
+  uint64_t count = jobCount();
+  uint64_t blocks = (count + grain - 1) / grain;
+  ParallelStats st = parallelFor(blocks, threads, 1, [&](uint64_t b, uint32_t) {
+    runBlock(p, b * grain, b * grain + grain < count ? b * grain + grain : count, isa);
+  });
+  if (stats) *stats = st;
+  return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+template <typename T> static bool writeColumn(const char *prefix, const char *ext, T (*get)(uint64_t)) {
+  std::string name = std::string(prefix) + ext;
+  FILE *f = fopen(name.c_str(), "wb");
+  if (!f) {
+    perror(name.c_str());
+    return false;
+  }
+  std::vector<T> col(results.size());
+  for (uint64_t i = 0; i < col.size(); i++) col[i] = get(i);
+  bool ok = fwrite(col.data(), sizeof(T), col.size(), f) == col.size();
+  return fclose(f) == 0 && ok;
+}
+
+static bool writeColumns(const char *prefix) {
+  return writeColumn<uint16_t>(prefix, ".build_up_ms.u16", [](uint64_t i) { return job(i).buildUpMs; }) &&
+         writeColumn<uint8_t>(prefix, ".duty_pct.u8", [](uint64_t i) { return job(i).dutyPct; }) &&
+         writeColumn<uint16_t>(prefix, ".kick_mv.u16", [](uint64_t i) { return job(i).kickMv; }) &&
+         writeColumn<uint32_t>(prefix, ".freq_hz.u32", [](uint64_t i) { return job(i).freqHz; }) &&
+         writeColumn<float>(prefix, ".peak_mmhg.f32", [](uint64_t i) { return results[i].peakMmHg; }) &&
+         writeColumn<float>(prefix, ".charge_mas.f32", [](uint64_t i) { return results[i].chargeMas; }) &&
+         writeColumn<float>(prefix, ".peak_a.f32", [](uint64_t i) { return results[i].peakA; }) &&
+         writeColumn<float>(prefix, ".end_rad_s.f32", [](uint64_t i) { return results[i].endRadS; });
+}
+
+static void writeCsv() {
+  printf("build_up_ms,duty_pct,kick_mv,freq_hz,peak_mmhg,charge_mas,peak_a,end_rad_s\n");
+  for (uint64_t i = 0; i < results.size(); i++) {
+    Job j = job(i);
+    const CycleResult &r = results[i];
+    printf("%u,%u,%u,%u,%.2f,%.3f,%.4f,%.1f\n", j.buildUpMs, j.dutyPct, j.kickMv, j.freqHz, r.peakMmHg,
+           r.chargeMas, r.peakA, r.endRadS);
+  }
+}
+
+// Runs the grid again on the scalar solver; true when no result differs.
+static bool compareScalar(const PlantParams &p, uint32_t threads, uint32_t grain) {
+  std::vector<CycleResult> batched;
+  batched.swap(results);
+  results.resize(batched.size());
+  double s = runAll(p, threads, grain, PLANT_ISA_SCALAR, 0);
+  float most[4] = {0, 0, 0, 0};
+  uint64_t differ = 0;
+  for (uint64_t k = 0; k < results.size(); k++) {
+    const CycleResult &a = results[k], &b = batched[k];
+    float d[4] = {fabsf(a.peakMmHg - b.peakMmHg), fabsf(a.chargeMas - b.chargeMas), fabsf(a.peakA - b.peakA),
+                  fabsf(a.endRadS - b.endRadS)};
+    bool any = false;
+    for (int c = 0; c < 4; c++) {
+      if (d[c] > most[c]) most[c] = d[c];
+      any |= d[c] != 0;
+    }
+    differ += any;
+  }
+  fprintf(stderr, "scalar: %.3f s, %llu of %llu cycles differ, largest %g mmHg %g mAs %g A %g rad/s\n", s,
+          (unsigned long long)differ, (unsigned long long)results.size(), most[0], most[1], most[2], most[3]);
+  results.swap(batched);
+  return differ == 0;
+}
+
+int main(int argc, char **argv) {
+  ranges[0] = {20, 90, 2};
+  ranges[1] = {200, 900, 10};
+  ranges[2] = {1500, 1500, 1};
+  ranges[3] = {20000, 20000, 1};
+  uint32_t threads = 0;
+  uint32_t grain = 64;
+  PlantIsa isa = PLANT_ISA_BEST;
+  bool verify = false;
+  const char *prefix = 0;
+  bool csv = false;
+  bool scaling = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:d:k:f:j:g:i:o:cSV")) != -1) {
+    bool ok = true;
+    switch (opt) {
+      case 'b': ok = parseRange(optarg, ranges[1]); break;
+      case 'd': ok = parseRange(optarg, ranges[0]); break;
+      case 'k': ok = parseRange(optarg, ranges[2]); break;
+      case 'f': ok = parseRange(optarg, ranges[3]); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'g': grain = atoi(optarg); break;
+      case 'i': ok = plantIsaParse(optarg, isa); break;
+      case 'o': prefix = optarg; break;
+      case 'c': csv = true; break;
+      case 'S': scaling = true; break;
+      case 'V': verify = true; break;
+      default: ok = false; break;
+    }
+    if (!ok) {
+      fprintf(stderr, "usage: %s [-b ms] [-d pct] [-k mV] [-f Hz] [-j threads] [-g grain] [-i isa] [-o prefix] [-c] [-S] [-V]\n"
+                      "       ranges are from[:to[:step]]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (grain == 0) grain = 1;
+  if (isa == PLANT_ISA_BEST) isa = plantIsaBest();
+  if (!plantIsaSupported(isa)) {
+    fprintf(stderr, "%s not supported on this CPU\n", plantIsaName(isa));
+    return 2;
+  }
+  if (ranges[1].from <= SEQ_KICK_MS || ranges[3].from < 500 || ranges[0].to > 100) {
+    fprintf(stderr, "build-up must exceed the kick, carrier >= 500 Hz, duty <= 100%%\n");
+    return 2;
+  }
+
+  PlantParams p = plantDefaults();
+  results.resize(jobCount());
+  if (scaling && verify) {
+    uint32_t t = threads ? threads : parallelThreads();
+    double scalar = runAll(p, t, grain, PLANT_ISA_SCALAR, 0);
+    double batched = runAll(p, t, grain, isa, 0);
+    printf("scalar %8.3f s, %s %8.3f s: %.2fx\n", scalar, plantIsaName(isa), batched, scalar / batched);
+    return 0;
+  }
+  if (scaling) {
+    uint32_t most = threads ? threads : parallelThreads();
+    double base = 0;
+    for (uint32_t t = 1;; t = t * 2 > most && t < most ? most : t * 2) {
+      ParallelStats st;
+      double s = runAll(p, t, grain, isa, &st);
+      if (t == 1) base = s;
+      printf("%3u threads: %8.3f s, %8.0f cycles/s, speed-up %.2f (%.0f%%), %llu steals\n", t, s, jobCount() / s,
+             base / s, base / s / t * 100, (unsigned long long)st.steals);
+      if (t >= most) break;
+    }
+    return 0;
+  }
+
+  ParallelStats st;
+  double s = runAll(p, threads, grain, isa, &st);
+  fprintf(stderr, "%llu cycles in %.3f s on %u threads (%s): %.0f cycles/s, %llu steals\n",
+          (unsigned long long)jobCount(), s, st.threads, plantIsaName(isa), jobCount() / s,
+          (unsigned long long)st.steals);
+  if (verify && !compareScalar(p, threads, grain)) return 1;
+  if (prefix && !writeColumns(prefix)) return 1;
+  if (csv) writeCsv();
+  return 0;
+}
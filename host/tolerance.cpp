@@ -0,0 +1,330 @@
+// Monte Carlo tolerance analysis of a pump profile: how many units, with
+// motors spread over their winding resistance and torque constant
+// tolerance, still reach the vacuum of the nominal unit on every stage.
+//   make -C host
+//   host/build/tolerance [options]
+//   -m swing|solo  profile of src/main.cpp     (default solo)
+//   -s file        where the tables are        (default src/main.cpp of
+//                                              this tree, from any directory)
+//   -N samples                                 (default 10000)
+//   -r pct         resistance tolerance        (default 15)
+//   -k pct         Ke = Kt tolerance           (default 15)
+//   -G             normal spread, tolerance = 3 sigma, instead of uniform
+//   -y pct         pass window per stage around the nominal vacuum (default 10)
+//   -S seed        (default 1)
+//   -j threads     0 = one per hardware thread (default 0)
+//   -i isa         batched solver, see sweep   (default best)
+//   -o file        per-stage statistics as CSV
+// Every sample plays all 18 stages with all their sweep steps, one after
+// the other as the firmware does (pump_cycle.h), on the batched solver over
+// all threads. Sample k draws from its own seed, so results do not depend
+// on the threads. A stage passes when its j = 0 vacuum is within the window;
+// a unit passes when all stages do. Nothing is kept per sample: every
+// worker streams into its own running mean/variance (Welford), histograms
+// and yield map, merged at the end, so a million samples take no more
+// memory than ten.
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <unistd.h>
+#include "parallel.h"
+#include "profile_tables.h"
+#include "pump_cycle.h"
+
+typedef std::chrono::steady_clock Clock;
+
+#define HIST_MMHG 400      // histogram range from 0
+#define HIST_BINS 1600     // 0.25 mmHg
+#define MAP_BINS 5         // yield map over the R x Ke tolerance
+#define PROGRESS_S 10
+
+struct StageStats {
+  uint64_t n;
+  double mean, m2, min, max;
+  uint64_t fails;
+  uint64_t hist[HIST_BINS];
+};
+
+struct Stats {
+  uint64_t samples, pass;
+  uint64_t mapSamples[MAP_BINS][MAP_BINS], mapPass[MAP_BINS][MAP_BINS]; // [R][Ke]
+  StageStats stage[PROFILE_STAGES];
+};
+
+static void statsInit(Stats &s) {
+  memset(&s, 0, sizeof(s));
+  for (StageStats &t : s.stage) {
+    t.min = INFINITY;
+    t.max = -INFINITY;
+  }
+}
+
+static void stageAdd(StageStats &t, double x) {
+  t.n++;
+  double d = x - t.mean;
+  t.mean += d / t.n;
+  t.m2 += d * (x - t.mean);
+  if (x < t.min) t.min = x;
+  if (x > t.max) t.max = x;
+  int bin = (int)(x * (HIST_BINS / HIST_MMHG));
+  t.hist[bin < 0 ? 0 : bin >= HIST_BINS ? HIST_BINS - 1 : bin]++;
+}
+
+// Chan et al.: the mean and M2 of the union of two sets.
+static void stageMerge(StageStats &a, const StageStats &b) {
+  if (b.n == 0) return;
+  uint64_t n = a.n + b.n;
+  double d = b.mean - a.mean;
+  a.m2 += b.m2 + d * d * a.n * b.n / n;
+  a.mean += d * b.n / n;
+  a.n = n;
+  a.min = fmin(a.min, b.min);
+  a.max = fmax(a.max, b.max);
+  a.fails += b.fails;
+  for (int k = 0; k < HIST_BINS; k++) a.hist[k] += b.hist[k];
+}
+
+static void statsMerge(Stats &a, const Stats &b) {
+  a.samples += b.samples;
+  a.pass += b.pass;
+  for (int r = 0; r < MAP_BINS; r++) {
+    for (int k = 0; k < MAP_BINS; k++) {
+      a.mapSamples[r][k] += b.mapSamples[r][k];
+      a.mapPass[r][k] += b.mapPass[r][k];
+    }
+  }
+  for (int s = 0; s < PROFILE_STAGES; s++) stageMerge(a.stage[s], b.stage[s]);
+}
+
+// Linear within the bin the q-th sample falls in.
+static double quantile(const StageStats &t, double q) {
+  double want = q * t.n, seen = 0;
+  for (int k = 0; k < HIST_BINS; k++) {
+    if (t.hist[k] == 0) continue;
+    if (seen + t.hist[k] >= want) {
+      return (k + (want - seen) / t.hist[k]) * ((double)HIST_MMHG / HIST_BINS);
+    }
+    seen += t.hist[k];
+  }
+  return t.max;
+}
+
+// ---------------------------------------------------------------------------
+// Sampling
+
+static uint64_t splitmix(uint64_t &x) {
+  uint64_t z = (x += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+static double uniform(uint64_t &x) { // (0, 1)
+  return ((splitmix(x) >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double tol_r = 0.15, tol_ke = 0.15;
+static bool gaussian = false;
+static uint64_t seed = 1;
+
+// Deviation in units of the tolerance: [-1, 1], or sigma = 1/3 (clipped at
+// 5 sigma so no motor gets a negative resistance).
+static double draw(uint64_t &x) {
+  if (!gaussian) return 2 * uniform(x) - 1;
+  double g = sqrt(-2 * log(uniform(x))) * cos(2 * M_PI * uniform(x)) / 3;
+  return g < -5.0 / 3 ? -5.0 / 3 : g > 5.0 / 3 ? 5.0 / 3 : g;
+}
+
+static int mapBin(double u) {
+  int b = (int)((u + 1) / 2 * MAP_BINS);
+  return b < 0 ? 0 : b >= MAP_BINS ? MAP_BINS - 1 : b;
+}
+
+// ---------------------------------------------------------------------------
+
+static PlantParams nominal;
+static std::vector<PlantOp> ops; // all 18 stages, the same for every sample
+static double nominal_mmHg[PROFILE_STAGES];
+static double window = 0.10;
+static PlantIsa isa = PLANT_ISA_BEST;
+
+#define MARKS (PROFILE_STAGES * STAGE_MARKS)
+
+static double stageMmHg(const PlantState *marks, int stage) {
+  return cycleResult(marks + stage * STAGE_MARKS + SEQ_SWEEP_CENTER * CYCLE_MARKS).peakMmHg;
+}
+
+static void buildOps(const ProfileTables &t, int mode) {
+  ops.resize(PROFILE_STAGES * STAGE_OPS);
+  uint32_t n = 0;
+  for (int s = 0; s < PROFILE_STAGES; s++) {
+    n += stageOps(t.buildUpMs[mode][s], t.dutyPct[mode][s], SEQ_SWEEPS, &ops[n]);
+  }
+  ops.resize(n);
+}
+
+// Samples [from, to) into st.
+static void runBlock(uint64_t from, uint64_t to, Stats &st) {
+  uint32_t n = (uint32_t)(to - from);
+  std::vector<PlantParams> params(n, nominal);
+  std::vector<PlantState> states(n), marks((size_t)n * MARKS);
+  std::vector<PlantProgram> programs(n);
+  std::vector<double> ur(n), uk(n);
+  for (uint32_t k = 0; k < n; k++) {
+    uint64_t x = seed * 0x2545F4914F6CDD1Dull + from + k;
+    splitmix(x);
+    ur[k] = draw(x);
+    uk[k] = draw(x);
+    params[k].rOhm *= 1 + ur[k] * tol_r;
+    params[k].keVsPerRad *= 1 + uk[k] * tol_ke;
+    plantInit(states[k]);
+    programs[k] = PlantProgram{&params[k], ops.data(), (uint32_t)ops.size(), &states[k], &marks[(size_t)k * MARKS]};
+  }
+  plantRun(programs.data(), n, isa);
+  for (uint32_t k = 0; k < n; k++) {
+    bool pass = true;
+    for (int s = 0; s < PROFILE_STAGES; s++) {
+      double v = stageMmHg(&marks[(size_t)k * MARKS], s);
+      stageAdd(st.stage[s], v);
+      if (fabs(v - nominal_mmHg[s]) > window * nominal_mmHg[s]) {
+        st.stage[s].fails++;
+        pass = false;
+      }
+    }
+    int r = mapBin(ur[k]), e = mapBin(uk[k]);
+    st.samples++;
+    st.pass += pass;
+    st.mapSamples[r][e]++;
+    st.mapPass[r][e] += pass;
+  }
+}
+
+static bool writeCsv(const char *path, const Stats &st) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  fprintf(f, "stage,nominal_mmhg,mean,sd,min,p01,p50,p99,max,fail\n");
+  for (int s = 0; s < PROFILE_STAGES; s++) {
+    const StageStats &t = st.stage[s];
+    fprintf(f, "%d,%.2f,%.3f,%.3f,%.2f,%.2f,%.2f,%.2f,%.2f,%llu\n", s, nominal_mmHg[s], t.mean,
+            t.n > 1 ? sqrt(t.m2 / (t.n - 1)) : 0, t.min, quantile(t, 0.01), quantile(t, 0.5), quantile(t, 0.99),
+            t.max, (unsigned long long)t.fails);
+  }
+  return fclose(f) == 0;
+}
+
+static void report(const Stats &st) {
+  printf("yield %.2f%% (%llu of %llu), window +-%.0f%% of nominal\n", 100.0 * st.pass / st.samples,
+         (unsigned long long)st.pass, (unsigned long long)st.samples, window * 100);
+  printf("stage nominal    mean     sd     min     p1    p50    p99     max   fail%%\n");
+  for (int s = 0; s < PROFILE_STAGES; s++) {
+    const StageStats &t = st.stage[s];
+    printf("%5d %7.1f %7.2f %6.2f %7.1f %6.1f %6.1f %6.1f %7.1f %7.2f\n", s, nominal_mmHg[s], t.mean,
+           t.n > 1 ? sqrt(t.m2 / (t.n - 1)) : 0, t.min, quantile(t, 0.01), quantile(t, 0.5), quantile(t, 0.99),
+           t.max, 100.0 * t.fails / st.samples);
+  }
+  printf("yield %% by R (rows, low to high) and Ke (columns), %d bins over the tolerance\n", MAP_BINS);
+  for (int r = 0; r < MAP_BINS; r++) {
+    printf("  ");
+    for (int k = 0; k < MAP_BINS; k++) {
+      if (st.mapSamples[r][k] == 0) {
+        printf("      -");
+      } else {
+        printf(" %6.1f", 100.0 * st.mapPass[r][k] / st.mapSamples[r][k]);
+      }
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *start = profileDefaultSource();
+  const char *csv = 0;
+  int mode = 1;
+  uint64_t samples = 10000;
+  uint32_t threads = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "m:s:N:r:k:Gy:S:j:i:o:")) != -1) {
+    bool ok = true;
+    switch (opt) {
+      case 'm': ok = (mode = profileModeParse(optarg)) >= 0; break;
+      case 's': start = optarg; break;
+      case 'N': samples = strtoull(optarg, 0, 10); break;
+      case 'r': tol_r = atof(optarg) / 100; break;
+      case 'k': tol_ke = atof(optarg) / 100; break;
+      case 'G': gaussian = true; break;
+      case 'y': window = atof(optarg) / 100; break;
+      case 'S': seed = strtoull(optarg, 0, 10); break;
+      case 'j': threads = atoi(optarg); break;
+      case 'i': ok = plantIsaParse(optarg, isa); break;
+      case 'o': csv = optarg; break;
+      default: ok = false; break;
+    }
+    if (!ok) {
+      fprintf(stderr, "usage: %s [-m swing|solo] [-s main.cpp] [-N samples] [-r pct] [-k pct] [-G] [-y pct]\n"
+                      "       [-S seed] [-j threads] [-i isa] [-o stats.csv]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (samples == 0 || tol_r >= 1 || tol_ke >= 1) {
+    fprintf(stderr, "need samples and tolerances below 100%%\n");
+    return 2;
+  }
+  ProfileTables tables;
+  if (!profileReadTables(start, tables)) return 1;
+  if (!tables.have[mode]) {
+    fprintf(stderr, "%s: no %s tables\n", start, profileModeName(mode));
+    return 1;
+  }
+  nominal = plantDefaults();
+  buildOps(tables, mode);
+  {
+    PlantState s, marks[MARKS];
+    plantInit(s);
+    PlantProgram program{&nominal, ops.data(), (uint32_t)ops.size(), &s, marks};
+    plantRun(&program, 1, isa);
+    for (int k = 0; k < PROFILE_STAGES; k++) nominal_mmHg[k] = stageMmHg(marks, k);
+  }
+
+  if (threads == 0) threads = parallelThreads();
+  std::vector<std::unique_ptr<Stats>> perWorker(threads);
+  for (auto &p : perWorker) {
+    p.reset(new Stats);
+    statsInit(*p);
+  }
+  const uint64_t block = 4 * PLANT_LANES;
+  std::atomic<uint64_t> done(0);
+  Clock::time_point t0 = Clock::now(), shown = t0;
+  ParallelStats ps = parallelFor((samples + block - 1) / block, threads, 1, [&](uint64_t b, uint32_t worker) {
+    uint64_t from = b * block, to = from + block < samples ? from + block : samples;
+    runBlock(from, to, *perWorker[worker]);
+    uint64_t d = done.fetch_add(to - from) + (to - from);
+    if (worker != 0) return; // only the calling thread prints
+    Clock::time_point now = Clock::now();
+    if (now - shown < std::chrono::seconds(PROGRESS_S)) return;
+    shown = now;
+    double s = std::chrono::duration<double>(now - t0).count();
+    fprintf(stderr, "%llu / %llu samples, %.0f/s, %.0f s left\n", (unsigned long long)d,
+            (unsigned long long)samples, d / s, (samples - d) * s / d);
+  });
+  double s = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  Stats &st = *perWorker[0];
+  for (uint32_t w = 1; w < ps.threads; w++) statsMerge(st, *perWorker[w]);
+  fprintf(stderr, "%llu samples of %s in %.1f s (%.0f/s, %s, %u threads)\n", (unsigned long long)samples,
+          profileModeName(mode), s, samples / s, plantIsaName(isa == PLANT_ISA_BEST ? plantIsaBest() : isa),
+          ps.threads);
+  printf("%s profile, R %s%.0f%%, Ke %s%.0f%%\n", profileModeName(mode), gaussian ? "3 sigma " : "+-",
+         tol_r * 100, gaussian ? "3 sigma " : "+-", tol_ke * 100);
+  report(st);
+  if (csv && !writeCsv(csv, st)) return 1;
+  return 0;
+}
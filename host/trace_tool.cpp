@@ -0,0 +1,81 @@
+// Pin traces recorded by firmware_sim -r (sim/trace.h).
+//   host/build/trace_tool info run.trc
+//   host/build/trace_tool vcd run.trc > run.vcd          (GTKWave)
+//   host/build/trace_tool diff [-t ns] [-v ticks] [-i] [-n lines] golden.trc run.trc
+// diff compares every level change of each signal, with a timing tolerance
+// of -t ns (default 1000) absolute or, with -i, on the interval from the
+// previous change, and -v ticks (default 0) on PWM on-times. Exit status 1
+// when the traces differ.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "trace.h"
+
+static int usage(const char *name) {
+  fprintf(stderr, "usage: %s info|vcd file.trc\n       %s diff [-t ns] [-v ticks] [-i] [-n lines] golden.trc run.trc\n",
+          name, name);
+  return 2;
+}
+
+static bool load(Trace &t, const char *path) {
+  if (traceLoad(t, path)) return true;
+  fprintf(stderr, "%s: not a trace file\n", path);
+  return false;
+}
+
+static int info(const char *path) {
+  Trace t;
+  std::vector<TraceEdge> edges;
+  if (!load(t, path)) return 1;
+  if (!traceDecode(t, edges)) {
+    fprintf(stderr, "%s: corrupt\n", path);
+    return 1;
+  }
+  uint32_t count[TRACE_SIGNALS] = {0};
+  for (const TraceEdge &e : edges) count[e.sig]++;
+  printf("%u records in %zu bytes, %.6f s\n", t.edges, t.bytes.size(),
+         edges.empty() ? 0.0 : edges.back().tNs / 1e9);
+  for (int s = 0; s < TRACE_SIGNALS; s++) printf("  %-10s %u\n", traceSignalName(s), count[s]);
+  return 0;
+}
+
+static int diff(int argc, char **argv) {
+  TraceDiffOptions o = {1000, 0, false, 10};
+  int opt;
+  while ((opt = getopt(argc, argv, "t:v:in:")) != -1) {
+    switch (opt) {
+      case 't': o.tolNs = strtoull(optarg, 0, 10); break;
+      case 'v': o.tolTicks = atoi(optarg); break;
+      case 'i': o.intervals = true; break;
+      case 'n': o.maxReports = atoi(optarg); break;
+      default: return usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2) return usage(argv[0]);
+  Trace golden, run;
+  if (!load(golden, argv[optind]) || !load(run, argv[optind + 1])) return 1;
+  TraceDiffResult r;
+  uint32_t bad = traceDiff(golden, run, o, r, stdout);
+  for (int s = 0; s < TRACE_SIGNALS; s++) {
+    printf("%-10s %u/%u changes, max deviation %llu ns\n", traceSignalName(s), r.changes[1][s],
+           r.changes[0][s], (unsigned long long)r.maxDevNs[s]);
+  }
+  printf("%s: %u mismatches\n", bad ? "FAIL" : "ok", bad);
+  return bad ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) return usage(argv[0]);
+  const char *cmd = argv[1];
+  if (strcmp(cmd, "info") == 0) return info(argv[2]);
+  if (strcmp(cmd, "vcd") == 0) {
+    Trace t;
+    if (!load(t, argv[2])) return 1;
+    traceWriteVcd(t, stdout);
+    return 0;
+  }
+  if (strcmp(cmd, "diff") == 0) return diff(argc - 1, argv + 1);
+  return usage(argv[0]);
+}
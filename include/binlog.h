@@ -0,0 +1,68 @@
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry.h"
+
+// Binary telemetry log, a fraction of the CSV size (5-7x smaller).
+//
+// Wire: every frame is 0x00, COBS(payload, crc16), 0x00. A receiver that
+// drops bytes resyncs on the next 0x00, text printed on the same port
+// between two frames cannot run into either of them, and a damaged frame
+// fails the CRC (CRC-16/CCITT-FALSE, little endian) instead of producing
+// bad rows.
+//
+// Payload: BINLOG_VERSION, then records. Every record starts with its type
+// and the zigzag varint of its time minus the previous record's time in
+// the same frame (the first one against 0, i.e. absolute), so frames decode
+// on their own and the interleaved rings may go back in time a little.
+//   event   (type = telemetry_type_t): varint a, varint b, zigzag varint value
+//   samples (type = BINLOG_SAMPLES):   varint count, zigzag varint of the
+//            first sample, then zigzag varint sample-to-sample deltas
+// Varints are LEB128, 7 bits per byte, least significant group first.
+// host/binlog_decode.cpp turns a capture back into CSV or columns.
+
+#define BINLOG_VERSION 1
+#define BINLOG_SAMPLES 0x80
+#define BINLOG_PAYLOAD_MAX 256
+#define BINLOG_RECORD_MAX (1 + 5 + 1 + 3 * TEL_SAMPLES_MAX) // largest record, a sample block
+#define BINLOG_FRAME_RECORDS ((BINLOG_PAYLOAD_MAX - 1) / BINLOG_RECORD_MAX)
+// COBS adds one byte per started 254, plus the two delimiters.
+#define BINLOG_FRAME_MAX (BINLOG_PAYLOAD_MAX + 2 + (BINLOG_PAYLOAD_MAX + 2) / 254 + 1 + 2)
+
+struct BinlogWriter {
+  uint8_t payload[BINLOG_PAYLOAD_MAX + 2]; // + CRC
+  uint16_t len;
+  uint32_t lastTimeUs;
+};
+
+inline uint32_t zigzagEncode(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+inline int32_t zigzagDecode(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// Writes v at p, returns the byte count (1-5).
+uint8_t varintPut(uint8_t *p, uint32_t v);
+// Reads one varint, returns the byte after it or 0 on a truncated or
+// over-long encoding.
+const uint8_t *varintGet(const uint8_t *p, const uint8_t *end, uint32_t *v);
+
+uint16_t binlogCrc16(const uint8_t *p, size_t n, uint16_t crc = 0xFFFF);
+// out needs n + n / 254 + 1 bytes, no delimiter is written.
+size_t cobsEncode(const uint8_t *in, size_t n, uint8_t *out);
+// In place is fine (out == in). Returns the decoded length, 0 on a bad frame.
+size_t cobsDecode(const uint8_t *in, size_t n, uint8_t *out);
+
+void binlogBegin(BinlogWriter &w);
+// false (and nothing written) once the record would not fit the frame.
+bool binlogEvent(BinlogWriter &w, const TelemetryEvent &ev);
+bool binlogSamples(BinlogWriter &w, uint32_t timeUs, const int16_t *samples, uint8_t count);
+// Appends the CRC, COBS encodes to out (BINLOG_FRAME_MAX bytes) between
+// the delimiters and returns the frame length.
+size_t binlogFinish(BinlogWriter &w, uint8_t *out);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef BUTTON_H
+#define BUTTON_H
+
+#include <stdint.h>
+
+// Interrupt driven BUTTON handling.
+// Both edges raise a GPIOTE event that PPI routes to a TIMER1 capture, so the
+// edge time is stamped in hardware even if the interrupt is late; the first
+// edge also stops further captures until its debounce window ends. An edge
+// is accepted once the pin still shows the new level debounceMs later; a
+// press held for longMs gives BUTTON_LONG (once), a shorter one gives
+// BUTTON_SHORT on release. The callback runs in interrupt context.
+// The pin is hooked with attachInterrupt(BUTTON, .., CHANGE): the core's
+// GPIOTE_IRQHandler (WInterrupts.c) dispatches it, and the GPIOTE interrupt
+// priority is set to 2 for every attachInterrupt() user.
+
+enum button_event_t {
+  BUTTON_SHORT,
+  BUTTON_LONG
+};
+
+// atUs is the TIMER1 time of the press edge (see hw_timer.h).
+typedef void (*button_cb_t)(button_event_t event, uint32_t atUs);
+
+// hwTimerInit() must have run first.
+void buttonInit(uint32_t debounceMs, uint32_t longMs, button_cb_t cb);
+bool buttonPressed();
+
+#endif
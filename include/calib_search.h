@@ -0,0 +1,39 @@
+#ifndef CALIB_SEARCH_H
+#define CALIB_SEARCH_H
+
+#include <stdint.h>
+
+// Build-up calibration search. Instead of playing the 7 fixed sweep steps,
+// every pump cycle measures the charge of one build-up (ctrlCharge(), see
+// control.h) and the next build-up time is chosen from it:
+//   - one side of the target known: scale by target / charge (the charge
+//     grows about linearly with the build-up time),
+//   - bracketed: regula falsi between the two closest points, bisection
+//     when the interpolated point falls outside the bracket.
+// It stops within CALIB_TOL_PERMILLE of the target, on a bracket of
+// CALIB_RES_MS or after CALIB_MAX_TRIES cycles, typically in 3-4 cycles.
+// Times are Build_up_* table values (kick included), in ms.
+
+#define CALIB_RANGE_PERMILLE 250 // search nominal +-25%
+#define CALIB_TOL_PERMILLE 10
+#define CALIB_RES_MS 1
+#define CALIB_MAX_TRIES 6
+
+struct CalibSearch {
+  uint32_t target;
+  uint16_t minMs, maxMs;  // search range
+  uint16_t loMs, hiMs;    // charge(loMs) < target <= charge(hiMs)
+  uint32_t loCharge, hiCharge;
+  bool haveLo, haveHi;
+  uint16_t nextMs;        // build-up to run next
+  uint16_t bestMs;        // closest to the target so far
+  uint32_t bestError;
+  uint8_t tries;
+  bool done;
+};
+
+void calibBegin(CalibSearch &s, uint16_t nominalMs, uint32_t target);
+// Charge measured with nextMs; returns true once the search is over.
+bool calibUpdate(CalibSearch &s, uint32_t charge);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <stdint.h>
+
+// Command protocol on the serial port, next to the telemetry it shares the
+// port with. A request is framed like the binary log (binlog.h):
+//   0x00, COBS(payload, crc16), 0x00
+// and answered with one reply frame in the same framing.
+//   request: cmd, seq, arguments
+//   reply:   CMD_REPLY, seq, cmd, status, data
+// Multi-byte fields are little endian, profiles are PROFILE_WIRE_SIZE
+// bytes (profile_store.h). Outside a frame, single bytes are terminal
+// commands and go to the text handler ('l', 't', ...).
+//
+//   CMD_PING                          -> OK
+//   CMD_UPLOAD   mode, profile        -> OK, or ERR_RANGE + first bad stage
+//   CMD_ACTIVATE mode, crc16(profile) -> OK once queued, ERR_STATE if that
+//                                        profile is not the staged one
+//   CMD_QUERY    mode                 -> OK + source, crc16, profile
+//   CMD_SET_TARGETS   mode, targets   -> OK once queued
+//   CMD_QUERY_TARGETS mode            -> OK + targets
+// Activation takes effect between stage runs (TEL_PROFILE telemetry), so
+// do the calibration targets (TEL_TARGETS), which are kept in flash
+// (target_store.h, TARGET_WIRE_SIZE bytes).
+
+#define CMD_FRAME_MAX 96
+#define CMD_REPLY 0xA5 // never a binlog version, decoders can tell them apart
+
+enum cmd_t {
+  CMD_PING = 1,
+  CMD_UPLOAD = 2,
+  CMD_ACTIVATE = 3,
+  CMD_QUERY = 4,
+  CMD_SET_TARGETS = 5,
+  CMD_QUERY_TARGETS = 6,
+};
+
+enum cmd_status_t {
+  CMD_OK = 0,
+  CMD_ERR_CRC = 1,     // frame CRC or COBS
+  CMD_ERR_LENGTH = 2,
+  CMD_ERR_RANGE = 3,
+  CMD_ERR_STATE = 4,
+  CMD_ERR_UNKNOWN = 5,
+};
+
+typedef void (*cmd_text_t)(char c);
+
+void cmdInit(cmd_text_t onText);
+// Reads what the serial port has received, handles complete requests.
+void cmdPoll();
+
+#endif
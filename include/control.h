@@ -0,0 +1,51 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <stdint.h>
+
+// Closed-loop build-up. The tick is the current block interrupt: with
+// CURRENT_SYNC and CTRL_BLOCK_SAMPLES samples per block it comes every
+// CTRL_BLOCK_SAMPLES carrier periods (400 us at 20 kHz), paced by the PWM.
+//
+// Every drive accumulates the charge drawn by the motor (sum of the raw
+// current samples, one per period), the pressure estimate used as target.
+// In closed loop a fixed-point PI sets the build-up duty so the current
+// follows targetCharge / nominalCycles, and the drive is ended through
+// onTarget as soon as the charge reaches targetCharge. nominalCycles from
+// the open-loop schedule only bounds the drive (CTRL_TIMEOUT_PCT).
+// The tick is integer only (block sum, two multiplies, two hardware
+// divides), well under a few microseconds at 64 MHz.
+
+#define CTRL_BLOCK_SAMPLES 8
+// Duty update period, in carrier periods. One chunk per refill, so it must
+// not be shorter than WAVE_FLAT_MIN (waveform.h): the PI runs twice per
+// chunk and the refill takes the latest duty.
+#define CTRL_CHUNK_CYCLES 16
+#define CTRL_TIMEOUT_PCT 150
+
+// PI gains in Q16 duty ticks per raw current LSB (per tick for Ki).
+#define CTRL_KP_Q16 (65536 / 8)
+#define CTRL_KI_Q16 (65536 / 64)
+
+struct CtrlConfig {
+  bool closedLoop;
+  uint32_t targetCharge;  // raw LSB x periods, kick included
+  uint32_t nominalCycles; // open-loop kick + build-up, periods
+  uint32_t kickCycles;    // no regulation during the kick
+  uint16_t startTicks;    // feed forward: open-loop build-up duty
+  uint16_t minTicks;
+  uint16_t maxTicks;
+};
+
+typedef void (*ctrl_stop_t)(void);
+
+void ctrlBegin(const CtrlConfig &cfg, ctrl_stop_t onTarget);
+void ctrlEnd();
+void ctrlOnBlock(const int16_t *block, uint16_t count); // interrupt context
+uint16_t ctrlDuty();
+uint32_t ctrlCharge();  // of the running or last drive
+uint32_t ctrlCycles();  // periods sampled in the running or last drive
+bool ctrlReachedTarget();
+bool ctrlClosedLoop(); // of the running or last drive
+
+#endif
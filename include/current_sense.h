@@ -0,0 +1,49 @@
+#ifndef CURRENT_SENSE_H
+#define CURRENT_SENSE_H
+
+#include <stdint.h>
+
+// Motor current sampling on MOTOR_UI with the SAADC. MOTOR_UI (pins.h) is
+// an Arduino pin number and has to land on an analog input through the
+// variant's pin map (fast_pin.h), P0.02-05 / AIN0-3 or P0.28-31 / AIN4-7;
+// currentInit() halts with a message on the serial port otherwise.
+// Samples are triggered in hardware and written by EasyDMA into two
+// buffers of up to CURRENT_BLOCK_SAMPLES that alternate (SAADC END -> START
+// via PPI), so the CPU only sees one interrupt per full block and the motor
+// PWM is never touched. Short blocks give a fixed rate tick for the
+// build-up control loop (control.h), long ones keep high rates cheap.
+//
+// CURRENT_SYNC: PWM0 PWMPERIODEND starts TIMER3 (16 MHz, same clock as the
+//   PWM counter), its compare fires SAMPLE, so there is one sample per
+//   carrier period at a fixed delay into the on-time. The sequencer moves
+//   it to the middle of the shortest on-time of each drive chunk as the
+//   chunk starts (hwPWMStream() started callback).
+// CURRENT_FREE_RUN: TIMER3 fires SAMPLE periodically, up to 200 ksps.
+
+#define CURRENT_BLOCK_SAMPLES 256
+#define CURRENT_MAX_RATE_HZ 200000UL
+
+// 12 bit, gain 1/6, 0.6 V reference: 3.6 V full scale.
+#define CURRENT_UV_PER_LSB 879
+
+enum current_trigger_t {
+  CURRENT_SYNC,
+  CURRENT_FREE_RUN
+};
+
+// block stays valid until the next callback, runs in interrupt context.
+typedef void (*current_block_cb_t)(const int16_t *block, uint16_t count);
+
+void currentInit(current_block_cb_t cb);
+// rateHz is only used by CURRENT_FREE_RUN; blockSamples 0 = CURRENT_BLOCK_SAMPLES.
+void currentStart(current_trigger_t trigger, uint32_t rateHz = 0, uint16_t blockSamples = 0);
+void currentStop();
+// CURRENT_SYNC only: sample delay after the start of the period, in PWM ticks.
+// Can be moved while driving, from the next sample on.
+void currentSetDelay(uint16_t ticks);
+uint32_t currentBlocks(); // completed blocks since currentStart()
+// CURRENT_SYNC, between drives: drops a partly filled block, so the next
+// block starts with the next sample instead of the tail of the last drive.
+void currentRealign();
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef FAST_PIN_H
+#define FAST_PIN_H
+
+#include <Arduino.h>
+
+// Compile time pin access. FastPin<SOL_ON_EN>::high() is a single store to
+// the P0 OUTSET register, without digitalWrite()'s checks, so the edge
+// lands at a fixed number of cycles after the call.
+// The pin numbers in pins.h are Arduino pin numbers, as digitalWrite()
+// takes them. gpioPin() translates them to P0.xx through the variant's
+// g_ADigitalPinMap, for the masks here and for every peripheral PSEL; the
+// masks are worked out once, before setup(). For a variant whose map is
+// the identity, -DFAST_PIN_IDENTITY_MAP makes them compile time constants.
+// Host builds (no nRF52 headers) fall back to digitalWrite()/digitalRead().
+
+#if defined(NRF52) || defined(NRF52_SERIES)
+#define FAST_PIN_NATIVE 1
+#ifdef NRF_P0
+#define FAST_PIN_PORT NRF_P0
+#else
+#define FAST_PIN_PORT NRF_GPIO
+#endif
+#else
+#define FAST_PIN_NATIVE 0
+#endif
+
+#if FAST_PIN_NATIVE && !defined(FAST_PIN_IDENTITY_MAP)
+#define FAST_PIN_MAPPED 1
+#else
+#define FAST_PIN_MAPPED 0
+#endif
+
+// P0.xx of an Arduino pin number.
+inline uint32_t gpioPin(uint8_t pin) {
+#if FAST_PIN_MAPPED
+  return g_ADigitalPinMap[pin];
+#else
+  return pin;
+#endif
+}
+
+template <uint8_t... Pins> struct PinMask;
+template <> struct PinMask<> {
+  static const uint32_t value = 0;
+};
+template <uint8_t Pin, uint8_t... Rest> struct PinMask<Pin, Rest...> {
+  static_assert(Pin < 32, "FastPin only covers port P0");
+  static const uint32_t value = (1UL << Pin) | PinMask<Rest...>::value;
+};
+
+template <uint8_t... Pins> inline uint32_t pinMaskMapped() {
+  uint32_t mask = 0;
+  int unused[] = {0, (mask |= 1UL << gpioPin(Pins), 0)...};
+  (void)unused;
+  return mask;
+}
+
+// Several pins switched by the same register write, e.g. SOL_ON_EN together
+// with SOL_ON_PWM, so both edges happen on the same clock cycle.
+template <uint8_t... Pins>
+struct FastPins {
+#if FAST_PIN_MAPPED
+  static const uint32_t mask; // from the pin map, below
+#else
+  static const uint32_t mask = PinMask<Pins...>::value;
+#endif
+
+  static inline void high() {
+#if FAST_PIN_NATIVE
+    FAST_PIN_PORT->OUTSET = mask;
+#else
+    int unused[] = {0, (digitalWrite(Pins, HIGH), 0)...};
+    (void)unused;
+#endif
+  }
+
+  static inline void low() {
+#if FAST_PIN_NATIVE
+    FAST_PIN_PORT->OUTCLR = mask;
+#else
+    int unused[] = {0, (digitalWrite(Pins, LOW), 0)...};
+    (void)unused;
+#endif
+  }
+};
+
+#if FAST_PIN_MAPPED
+template <uint8_t... Pins> const uint32_t FastPins<Pins...>::mask = pinMaskMapped<Pins...>();
+#endif
+
+template <uint8_t Pin>
+struct FastPin : FastPins<Pin> {
+  static inline void write(bool level) {
+    if (level) {
+      FastPins<Pin>::high();
+    } else {
+      FastPins<Pin>::low();
+    }
+  }
+
+  static inline bool read() {
+#if FAST_PIN_NATIVE
+    return (FAST_PIN_PORT->IN & FastPins<Pin>::mask) != 0;
+#else
+    return digitalRead(Pin) == HIGH;
+#endif
+  }
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include "nvmc.h"
+
+// Append-only results log in internal flash, kept across power cycles.
+//
+// FLASH_LOG_PAGES pages are used as a ring. A page starts with a header
+// (magic, page sequence number) and holds fixed size records written in
+// order; when the head page is full the log moves on to the next page,
+// which overwrites the oldest one, so every page gets erased equally often.
+// One page ahead of the head is kept erased, so an append never waits for
+// an erase.
+//
+// Records are queued from the interrupts and written by flashLogService()
+// from loop(), at most FLASH_LOG_SERVICE_WORDS words per call (a bounded
+// CPU stall, see nvmc.h). Page erases happen only when the caller allows
+// them, i.e. while the sequencer is idle. Word 0 of a record is written
+// last, so a record cut by a power loss is never taken as valid.
+//
+// flashLogInit() finds the head from the page headers (one read per page)
+// and a binary search for the first free slot of the head page. The boot
+// count is one more than the newest record's, and every boot queues a
+// FLASH_LOG_BOOT record.
+
+// 0x6D000-0x74000 is the Bluefruit InternalFS area, unused by this sketch:
+// the log, then the two charge target pages (target_store.h).
+#define FLASH_LOG_BASE 0x6D000UL
+#define FLASH_LOG_PAGES 5
+#define FLASH_LOG_MAGIC 0x474F4C46UL // "FLOG"
+#define FLASH_LOG_HEADER_WORDS 4
+#define FLASH_LOG_RECORD_WORDS 4
+#define FLASH_LOG_SLOTS ((NVMC_PAGE_WORDS - FLASH_LOG_HEADER_WORDS) / FLASH_LOG_RECORD_WORDS)
+#define FLASH_LOG_QUEUE 32
+#define FLASH_LOG_SERVICE_WORDS 4 // about 170 us of stall per call
+
+enum flash_log_kind_t {
+  FLASH_LOG_CYCLE = 1, // arg = sweep | closed loop << 6 | on target << 7,
+                       // value0 = build-up periods, value1 = charge
+  FLASH_LOG_CALIB = 2, // arg = tries, value0 = build-up ms, value1 = target charge
+  FLASH_LOG_BOOT = 3,  // queued by flashLogInit(), so a power cycle that logs
+                       // nothing else still counts
+};
+
+struct FlashLogRecord {
+  uint8_t kind;   // word 0, never 0xFF
+  uint8_t mode;   // pump_mode
+  uint8_t stage;
+  uint8_t arg;
+  uint32_t value0;
+  uint32_t value1;
+  uint32_t boot;  // set by the log: power cycle count
+};
+
+void flashLogInit();
+// Interrupt context (priority 2, the telemetry producers). false when the
+// queue is full, the record is counted as dropped.
+bool flashLogAppend(const FlashLogRecord &r);
+// Thread context. mayErase: an 85 ms stall is acceptable right now.
+void flashLogService(bool mayErase);
+bool flashLogPending();  // records queued or half written
+uint32_t flashLogCount();
+bool flashLogRead(uint32_t index, FlashLogRecord *r); // 0 = oldest
+uint32_t flashLogBoot();
+uint32_t flashLogDropped();
+
+#endif
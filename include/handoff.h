@@ -0,0 +1,22 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <stdint.h>
+
+// Hardware hand-off from the motor build-up to the solenoid release.
+// Once armed, the end of the next PWM0 drive (STOPPED, which follows
+// LOOPSDONE at a normal end and also an early stop by the build-up control)
+// starts TIMER2 through PPI; TIMER2 compares then set and clear SOL_ON_EN/SOL_ON_PWM via
+// GPIOTE, so the gap and the solenoid open time are exact to the 1 MHz tick
+// and independent of what the CPU is doing.
+// done runs from the TIMER2 interrupt after the solenoid has closed and the
+// pins are handed back to GPIO (LOW).
+
+typedef void (*handoff_done_t)(void);
+
+void handoffInit();
+// Must be called before the build-up sequence is started.
+void handoffArm(uint32_t gapUs, uint32_t openUs, handoff_done_t done);
+void handoffDisarm();
+
+#endif
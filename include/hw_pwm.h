@@ -0,0 +1,53 @@
+#ifndef HW_PWM_H
+#define HW_PWM_H
+
+#include <stdint.h>
+
+// Hardware PWM on the nRF52 PWM0 peripheral.
+// A request is played from an EasyDMA sequence, so once hwPWM() returns the
+// waveform needs no CPU at all. Only one request plays at a time.
+
+typedef void (*pwm_done_t)(void);
+
+void hwPWMInit();
+
+// Same arguments as the old bit-banged myPWM(): duration in ms, PWM 0-255
+// (PWM/255 * 100% duty), carrier frequency in kHz and output pin.
+// Returns 1 when the request was started, 0 when one is already playing.
+// done (optional) is called from the PWM interrupt once the pin is back LOW.
+int hwPWM(int durationMs, int PWM, int frequencyKhz, int pin, pwm_done_t done = 0);
+
+// High resolution mode: the counter runs on the undivided 16 MHz clock and
+// wraps at countertop (carrier = 16 MHz / countertop, 15 bit max), duty is in
+// 0.01% steps (0-10000) and rounded to the nearest tick. At 20 kHz
+// (countertop 800) one tick is 0.125% so every duty lands within 0.0625%.
+#define PWM_HIRES_CLOCK_HZ 16000000UL
+#define PWM_TOP_FOR_HZ(hz) (PWM_HIRES_CLOCK_HZ / (hz))
+#define PWM_DUTY_FULL 10000
+int hwPWMHiRes(int durationMs, uint16_t duty, uint16_t countertop, int pin, pwm_done_t done = 0);
+// Same mode with everything precomputed: number of periods and on-time ticks.
+int hwPWMTicks(uint32_t cycles, uint16_t onTicks, uint16_t countertop, int pin, pwm_done_t done = 0);
+
+// Streaming mode for long, non constant waveforms (see waveform.h). The
+// sequences are played from two RAM buffers of PWM_STREAM_VALUES values
+// each: while one plays, the PWM interrupt refills the other through fill().
+// fill() writes up to max on-time ticks to buf, sets *refresh to the number
+// of extra periods each value is held and returns the value count.
+// chunks is the exact number of fill() calls the waveform needs; the stream
+// ends with a 0% period and LOOPSDONE, like a plain request. hwPWMStop()
+// cuts it short at the end of the running period (STOPPED, same done path).
+// started(), if given, runs as each chunk begins to play (before the start
+// for the first one, then from the PWM interrupt) with the shortest non zero
+// on-time of that chunk, e.g. to keep the current sample point inside it.
+#define PWM_STREAM_VALUES 64
+#define PWM_SEQ_REFRESH_MAX 0xFFFFFF
+typedef uint16_t (*pwm_fill_t)(uint16_t *buf, uint16_t max, uint32_t *refresh);
+typedef void (*pwm_start_t)(uint16_t minTicks);
+int hwPWMStream(uint32_t chunks, uint16_t countertop, int pin, pwm_fill_t fill, pwm_done_t done = 0,
+                pwm_start_t started = 0);
+
+bool hwPWMBusy();
+void hwPWMWait();
+void hwPWMStop();
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HW_TIMER_H
+#define HW_TIMER_H
+
+#include <stdint.h>
+
+// Free running 1 MHz time base on TIMER1 (32 bit, wraps after ~71 minutes).
+// Each channel is a one-shot compare: the callback runs from the TIMER1
+// interrupt when the counter reaches the requested absolute time.
+// Deadlines are absolute so a chain of phases never accumulates drift.
+
+#define TIMER_CH_SEQ 0
+#define TIMER_CH_BUTTON 1
+#define HW_TIMER_CHANNELS 2
+
+typedef void (*timer_cb_t)(void);
+
+void hwTimerInit();
+uint32_t hwTimerNowUs();
+// A deadline already in the past fires right away.
+void hwTimerAt(int ch, uint32_t atUs, timer_cb_t cb);
+void hwTimerCancel(int ch);
+
+// CAPTURE task for PPI: an event wired to it stamps the time base in
+// hardware, read back with hwTimerCapturedUs().
+uint32_t hwTimerCaptureTask();
+uint32_t hwTimerCapturedUs();
+
+#endif
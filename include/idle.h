@@ -0,0 +1,19 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdint.h>
+
+// System ON idle. idleSleep() puts the core in WFE until the next interrupt;
+// the phases keep running from the PWM/TIMER interrupts meanwhile.
+// The time spent asleep is accounted per pump cycle: the sequencer calls
+// idleCycleMark() at every kick, which closes the previous cycle.
+
+void idleSleep();
+void idleCycleMark(); // interrupt context
+
+// Last complete cycle: time asleep and cycle length, both in us.
+void idleLastCycle(uint32_t *sleepUs, uint32_t *cycleUs);
+// Same as a fraction, 0-1000.
+uint16_t idleLastCyclePermille();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef NVMC_H
+#define NVMC_H
+
+#include <stdint.h>
+
+// Internal flash through the NVMC, one word or one page at a time.
+// The CPU stalls while the NVMC works when it runs from flash: up to 41 us
+// per word and up to 85 ms per page erase (nRF52832 PS, tWRITE/tERASEPAGE),
+// so callers decide when they can afford it. Direct NVMC access is only
+// allowed while the SoftDevice is disabled, which it is in this sketch.
+// host/nvmc_sim.cpp implements the same calls on a RAM image.
+
+#define NVMC_PAGE_SIZE 4096
+#define NVMC_PAGE_WORDS (NVMC_PAGE_SIZE / 4)
+
+void nvmcErasePage(uint32_t pageAddr);
+void nvmcWriteWord(uint32_t addr, uint32_t value);
+// Flash is memory mapped, reads need no NVMC.
+const uint32_t *nvmcPtr(uint32_t addr);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef PHASE_TIMING_H
+#define PHASE_TIMING_H
+
+#include <stdint.h>
+
+// Timing instrumentation, compiled out unless PHASE_TIMING is defined
+// (build_flags = -DPHASE_TIMING). Two kinds of histograms:
+//   phase: length of every sequencer phase minus its nominal length, in us
+//          from TIMER1. These are the edge to edge intervals on the pins
+//          (motor on/off, solenoid open/close). A schedule drive is split
+//          at the start of its build-up chunk into kick and build_up (open
+//          loop only, a closed-loop build-up has no nominal length); drive
+//          is a whole seqSetDrive() waveform. The last one includes the 0%
+//          tail of the PWM stream, so it sits at +1 or +2 periods (50/100 us).
+//   edge:  DWT CYCCNT cycles from entering the interrupt to the software
+//          edge (PWM start, solenoid write), the latency the code adds.
+// CYCCNT stops while the core sleeps in WFE, so it only times spans inside
+// an interrupt; the phases use TIMER1, which keeps running.
+// ptDump() prints count/min/max/mean/p99 per histogram as CSV lines.
+// host/build/firmware_sim_pt runs the sketch with it (make -C host phase-timing).
+
+#define PT_PHASE_KICK 8      // after the seq_phase_t values
+#define PT_PHASE_BUILD_UP 9
+#define PT_PHASES 10
+#define PT_PHASE_BINS 64
+#define PT_PHASE_BIN_US 4    // -128..+124 us, outliers land in the end bins
+#define PT_EDGE_BINS 64
+#define PT_EDGE_BIN_CYCLES 16 // 0..1023 cycles (16 us at 64 MHz)
+
+enum pt_edge_t {
+  PT_EDGE_DRIVE_ON,  // PWM stream started
+  PT_EDGE_SOL_OPEN,
+  PT_EDGE_SOL_CLOSE,
+  PT_EDGES
+};
+
+#ifdef PHASE_TIMING
+#include <nrf.h>
+
+extern volatile uint32_t pt_irq_entry;
+
+void ptInit();
+// Closes the running phase and opens id; nominalUs 0 is not recorded.
+void ptPhase(uint8_t id, uint32_t nominalUs);
+void ptEdge(uint8_t edge);
+void ptReset();
+void ptDump();
+
+#define PT_INIT() ptInit()
+#define PT_IRQ_ENTRY() (pt_irq_entry = DWT->CYCCNT)
+#define PT_PHASE(id, nominalUs) ptPhase((id), (nominalUs))
+#define PT_EDGE(edge) ptEdge(edge)
+#define PT_DUMP() ptDump()
+#else
+#define PT_INIT() do {} while (0)
+#define PT_IRQ_ENTRY() do {} while (0)
+#define PT_PHASE(id, nominalUs) do {} while (0)
+#define PT_EDGE(edge) do {} while (0)
+#define PT_DUMP() do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef PINS_H
+#define PINS_H
+
+#include "fast_pin.h"
+
+#define MOTOR_PWM 21
+#define SOL_ON_EN 24
+#define SOL_DEG_EN 9
+#define SOL_DEG_PWM 8
+#define SOL_ON_PWM 20
+#define MOTOR_UI 4
+#define BUTTON 22
+
+typedef FastPins<SOL_ON_EN, SOL_ON_PWM> SolOn; // both solenoid lines in one register write
+typedef FastPin<SOL_ON_EN> SolOnEn;
+typedef FastPin<BUTTON> Button;
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef PROFILE_STORE_H
+#define PROFILE_STORE_H
+
+#include <stdint.h>
+#include "pump_profile.h"
+#include "sweep_schedule.h"
+
+// Active pump profile per mode (0 swing, 1 solo). The constexpr tables in
+// main.cpp are the defaults; a profile uploaded at run time (command.h) is
+// staged first and only replaces the active one in profileService(), which
+// loop() calls between stage runs, so a running phase never sees a table
+// change under it. Uploaded profiles live in RAM, a reset goes back to the
+// defaults.
+
+#define PROFILE_MODES 2
+// Serialized: buildUpMs as 18 little endian uint16, then dutyPct as 18 bytes.
+#define PROFILE_WIRE_SIZE (PROFILE_STAGES * 3)
+
+enum profile_source_t {
+  PROFILE_FLASH = 0,    // the compiled-in default
+  PROFILE_UPLOADED = 1,
+};
+
+void profileStoreInit(const PumpProfile *defaults, const PumpSchedule *defaultSchedules);
+// Range checked; returns -1 when staged, else the first bad stage.
+int profileStage(uint8_t mode, const PumpProfile &p);
+// Queues the staged profile for activation if its CRC is crc.
+bool profileActivate(uint8_t mode, uint16_t crc);
+// Applies queued activations; call only while no stage is running.
+// Returns a bit per mode that changed.
+uint8_t profileService();
+
+const PumpProfile &profileActive(uint8_t mode);
+const PumpSchedule *profileSchedule(uint8_t mode);
+profile_source_t profileSource(uint8_t mode);
+
+void profileSerialize(const PumpProfile &p, uint8_t *out);
+void profileDeserialize(const uint8_t *in, PumpProfile *p);
+uint16_t profileCrc(const PumpProfile &p);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef PUMP_PROFILE_H
+#define PUMP_PROFILE_H
+
+#include <stdint.h>
+
+// Build-up time and duty per stage for one pump mode. Profiles are declared
+// constexpr so they live in flash, and are checked at compile time with
+//   static_assert(profileValid(p), "...");
+// A missing entry is zero-initialized and fails the range check, an extra
+// one does not compile.
+
+#define STIMULATION_STAGES 9
+#define EXPRESSION_STAGES 9
+#define PROFILE_STAGES (STIMULATION_STAGES + EXPRESSION_STAGES)
+
+// Build-up includes the 35 ms kick and is swept by -12%, so it must stay
+// above the kick; duty is in % of the motor supply.
+#define PROFILE_BUILD_UP_MIN_MS 36
+#define PROFILE_BUILD_UP_MAX_MS 2000
+#define PROFILE_DUTY_MIN 1
+#define PROFILE_DUTY_MAX 100
+
+struct PumpProfile {
+  uint16_t buildUpMs[PROFILE_STAGES]; // first 9 are Stimulation, Last 9 are Expression
+  uint8_t dutyPct[PROFILE_STAGES];
+};
+
+constexpr bool buildUpValid(int ms) {
+  return ms >= PROFILE_BUILD_UP_MIN_MS && ms <= PROFILE_BUILD_UP_MAX_MS;
+}
+
+constexpr bool dutyValid(int pct) {
+  return pct >= PROFILE_DUTY_MIN && pct <= PROFILE_DUTY_MAX;
+}
+
+constexpr bool profileValid(const PumpProfile &p, int stage = 0) {
+  return stage >= PROFILE_STAGES ||
+         (buildUpValid(p.buildUpMs[stage]) && dutyValid(p.dutyPct[stage]) &&
+          profileValid(p, stage + 1));
+}
+
+#endif
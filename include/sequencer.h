@@ -0,0 +1,84 @@
+#ifndef SEQUENCER_H
+#define SEQUENCER_H
+
+#include <stdint.h>
+#include "sweep_schedule.h"
+#include "waveform.h"
+#include "calib_search.h"
+
+// Event driven pump test cycle. Every phase is started from an interrupt:
+// the PWM phases end on the PWM STOPPED event and the waits end on a TIMER1
+// compare, so the CPU is free while a stage runs.
+//
+// Stage i:  500 ms gap, then for each sweep j = -120..120 step 40
+//           kick 35 ms at 1.5V, build-up (buildUpMs[i]-35)*(1+j/1000) ms at dutyPct[i]%,
+//           read from the precomputed PumpSchedule (see sweep_schedule.h),
+//           50 ms gap, solenoid open 300 ms.
+// Calib:    stage i with the sweep replaced by a search (calib_search.h),
+//           one cycle per tried build-up until it converges.
+// Debug:    cycles x (100 ms gap, kick, build-up, 50 ms gap, solenoid PWM 400 ms at 60%).
+
+#define SEQ_STAGES PROFILE_STAGES
+#define SEQ_GAP_MS 50
+#define SEQ_SOL_OPEN_MS 300
+#define SEQ_STAGE_GAP_MS 500
+#define SEQ_DEBUG_GAP_MS 100
+#define SEQ_DEBUG_SOL_MS 400
+#define SEQ_DEBUG_SOL_DUTY DUTY_PCT(60)
+
+typedef void (*seq_done_t)(void);
+
+// Summary of one stage drive, see seqSetCycleHook().
+struct SeqCycle {
+  uint8_t stage;
+  uint8_t sweep;          // sweep index, or the try of a calibration run
+  bool closedLoop;
+  bool reachedTarget;
+  uint32_t buildUpCycles; // nominal build-up, periods
+  uint32_t charge;        // measured, see control.h
+};
+typedef void (*seq_cycle_t)(const SeqCycle &cycle);
+
+enum seq_phase_t {
+  SEQ_IDLE,
+  SEQ_WAIT,       // plain hold, seqWait()
+  SEQ_STAGE_GAP,
+  SEQ_DEBUG_GAP,
+  SEQ_DRIVE,      // kick + build-up waveform on MOTOR_PWM
+  SEQ_GAP,
+  SEQ_SOL_OPEN,
+  SEQ_SOL_PWM     // debug only, solenoid driven by PWM
+};
+// -DPHASE_TIMING records the phase lengths and edge latencies against
+// their nominal values, see phase_timing.h.
+
+void seqInit();
+// Stage runs only: the 50 ms gap and the solenoid open/close edges are
+// timed by TIMER2/PPI/GPIOTE from the end of the build-up (see handoff.h)
+// instead of from the interrupts. Change it only while idle.
+void seqSetHwHandoff(bool on);
+// Replaces the kick + build-up pair with a custom waveform (the same for
+// every sweep step), e.g. a soft start ramp or an overdrive and taper.
+// segs must stay valid while set; count 0 goes back to the schedule.
+void seqSetDrive(const WaveSegment *segs, uint8_t count);
+// Closed-loop build-up (control.h) for stage runs: targets holds one
+// charge target per stage of the profile about to run, 0 = open loop. An
+// open-loop j = 0 drive fills a 0 entry with its own charge (teach), so the
+// following runs reproduce it whatever the supply voltage or motor
+// temperature. Sweep step j regulates to target * (1000 + j) / 1000.
+// nullptr = open loop everywhere (the default).
+void seqSetClosedLoop(uint32_t *targets);
+// Called from the interrupt at the end of every stage drive (not debug).
+void seqSetCycleHook(seq_cycle_t hook);
+void seqWait(uint32_t ms);
+void seqStartStage(const PumpSchedule *schedule, int stage);
+// Calibration run of one stage: search must be set up with calibBegin()
+// and stay valid until done (interrupt context), its bestMs is the result.
+// Runs open loop whatever seqSetClosedLoop() says.
+void seqStartCalib(const PumpSchedule *schedule, int stage, CalibSearch *search, seq_done_t done);
+// The kick of schedule, then the j = 0 build-up entry of debug.
+void seqStartDebug(const PumpSchedule *schedule, const StageSchedule *debug, int cycles);
+bool seqBusy();
+seq_phase_t seqPhase();
+
+#endif
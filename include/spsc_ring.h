@@ -0,0 +1,69 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Lock-free single producer / single consumer ring.
+// N must be a power of two; head and tail run freely and wrap with the
+// 32 bit arithmetic, so all N slots are usable. The producer only writes
+// head, the consumer only writes tail, so neither side ever disables
+// interrupts. A push into a full ring is dropped and counted.
+//
+// On the host the indices sit on their own cache lines so the benchmark
+// does not measure false sharing; on the nRF52 word alignment is enough.
+
+#if defined(NRF52) || defined(NRF52_SERIES)
+#define SPSC_ALIGN 4
+#else
+#define SPSC_ALIGN 64
+#endif
+
+template <typename T, uint32_t N>
+class SpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+ public:
+  SpscRing() : head_(0), tail_(0), dropped_(0) {}
+
+  // Producer side.
+  bool push(const T &item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    buf_[head & (N - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side.
+  bool pop(T &item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire)) return false;
+    item = buf_[tail & (N - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  uint32_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  static uint32_t capacity() {
+    return N;
+  }
+
+ private:
+  alignas(SPSC_ALIGN) std::atomic<uint32_t> head_;
+  alignas(SPSC_ALIGN) std::atomic<uint32_t> tail_;
+  std::atomic<uint32_t> dropped_; // written by the producer only
+  alignas(SPSC_ALIGN) T buf_[N];
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef SWEEP_SCHEDULE_H
+#define SWEEP_SCHEDULE_H
+
+#include <stdint.h>
+#include "hw_pwm.h"
+#include "pump_profile.h"
+
+// Compile time schedule of every stage x sweep step of a profile, in the
+// units the PWM peripheral takes (periods and counter ticks), so starting
+// a phase is one table lookup and no floating point runs at all.
+//   constexpr PumpSchedule s = makeSchedule(profile);
+// Durations are rounded to the nearest carrier period (50 us at 20 kHz)
+// with integer math only, so every compiler produces the same table.
+
+// 16 MHz / 800 = 20 kHz carrier, duties are in 0.01% (see hw_pwm.h)
+#define PWM_TOP PWM_TOP_FOR_HZ(20000)
+#define DUTY_PCT(p) ((p) * 100)
+#define KICK_DUTY (PWM_DUTY_FULL * 3 / 8) // We need to apply 1.5V (of 4V) for 35ms
+
+#define SEQ_KICK_MS 35
+#define SEQ_SWEEP_FIRST -120 // build-up offset j in 0.1%
+#define SEQ_SWEEP_LAST 120
+#define SEQ_SWEEP_STEP 40
+#define SEQ_SWEEPS ((SEQ_SWEEP_LAST - SEQ_SWEEP_FIRST) / SEQ_SWEEP_STEP + 1)
+#define SEQ_SWEEP_CENTER ((0 - SEQ_SWEEP_FIRST) / SEQ_SWEEP_STEP) // j = 0
+
+struct StageSchedule {
+  uint16_t dutyTicks;                 // build-up on-time per period
+  uint32_t buildUpCycles[SEQ_SWEEPS]; // build-up length per sweep step, kick excluded
+};
+
+struct PumpSchedule {
+  uint16_t kickTicks;
+  uint32_t kickCycles;
+  StageSchedule stage[PROFILE_STAGES];
+};
+
+constexpr uint32_t divRound(uint32_t a, uint32_t b) {
+  return (a + b / 2) / b;
+}
+
+constexpr uint32_t msToCycles(uint32_t ms) {
+  return divRound(ms * (PWM_HIRES_CLOCK_HZ / 1000), PWM_TOP);
+}
+
+constexpr uint16_t dutyToTicks(uint32_t duty) {
+  return (uint16_t)divRound(PWM_TOP * duty, PWM_DUTY_FULL);
+}
+
+constexpr int sweepOffset(int k) {
+  return SEQ_SWEEP_FIRST + k * SEQ_SWEEP_STEP;
+}
+
+// (buildUpMs - kick) * (1 + j/1000) in periods.
+constexpr uint32_t buildUpCycles(uint32_t buildUpMs, int j) {
+  return divRound((buildUpMs - SEQ_KICK_MS) * (uint32_t)(1000 + j) * (PWM_HIRES_CLOCK_HZ / 1000000),
+                  PWM_TOP);
+}
+
+// C++11 has no constexpr loops, the tables are expanded from index packs.
+template <int... I> struct IndexSeq {};
+template <int N, int... I> struct MakeIndexSeq : MakeIndexSeq<N - 1, N - 1, I...> {};
+template <int... I> struct MakeIndexSeq<0, I...> {
+  typedef IndexSeq<I...> type;
+};
+
+template <int... K>
+constexpr StageSchedule makeStageSchedule(uint32_t buildUpMs, uint32_t dutyPct, IndexSeq<K...>) {
+  return StageSchedule{dutyToTicks(DUTY_PCT(dutyPct)), {buildUpCycles(buildUpMs, sweepOffset(K))...}};
+}
+
+constexpr StageSchedule makeStageSchedule(uint32_t buildUpMs, uint32_t dutyPct) {
+  return makeStageSchedule(buildUpMs, dutyPct, MakeIndexSeq<SEQ_SWEEPS>::type());
+}
+
+template <int... S>
+constexpr PumpSchedule makeSchedule(const PumpProfile &p, IndexSeq<S...>) {
+  return PumpSchedule{dutyToTicks(KICK_DUTY), msToCycles(SEQ_KICK_MS),
+                      {makeStageSchedule(p.buildUpMs[S], p.dutyPct[S])...}};
+}
+
+constexpr PumpSchedule makeSchedule(const PumpProfile &p) {
+  return makeSchedule(p, MakeIndexSeq<PROFILE_STAGES>::type());
+}
+
+#endif
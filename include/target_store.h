@@ -0,0 +1,43 @@
+#ifndef TARGET_STORE_H
+#define TARGET_STORE_H
+
+#include <stdint.h>
+#include "flash_log.h"
+#include "profile_store.h"
+
+// Charge targets per mode and stage for the calibration runs, set from
+// outside the device (CMD_SET_TARGETS, command.h) and kept in flash across
+// power cycles. 0 means no target: that stage is not calibrated.
+//
+// Two flash pages right after the log, one in use at a time. It holds whole
+// tables appended in order, a record per table: the targets first, the
+// header (magic | mode) last, so a record cut by a power loss is skipped.
+// The newest record of a mode wins. A full page is compacted into the other
+// one: current tables first, then its page header (magic, sequence) commits
+// the copy, and only then is the old page erased. A power loss at any point
+// keeps either the old or the new copy, see flash_log_sim; the erase itself
+// stalls the CPU for up to 85 ms (nvmc.h), hence mayErase.
+//
+// Like the profiles (profile_store.h), a table is staged by the command
+// handler and written by targetStoreService(), which loop() calls between
+// runs.
+
+#define TARGET_STORE_ADDR (FLASH_LOG_BASE + FLASH_LOG_PAGES * NVMC_PAGE_SIZE)
+#define TARGET_STORE_PAGES 2
+#define TARGET_PAGE_MAGIC 0x50544754UL  // "TGTP", then the page sequence
+#define TARGET_PAGE_HEADER_WORDS 2
+#define TARGET_STORE_MAGIC 0x54470000UL // "TG", mode in the low byte
+#define TARGET_RECORD_WORDS (1 + PROFILE_STAGES)
+#define TARGET_STORE_SLOTS ((NVMC_PAGE_WORDS - TARGET_PAGE_HEADER_WORDS) / TARGET_RECORD_WORDS)
+// Serialized: PROFILE_STAGES little endian uint32.
+#define TARGET_WIRE_SIZE (PROFILE_STAGES * 4)
+
+void targetStoreInit();
+// Queues a table of PROFILE_STAGES targets for mode.
+void targetStoreSet(uint8_t mode, const uint32_t *targets);
+// Writes the queued tables; mayErase as for flashLogService(). Returns a
+// bit per mode that changed.
+uint8_t targetStoreService(bool mayErase);
+const uint32_t *targetStoreGet(uint8_t mode);
+
+#endif
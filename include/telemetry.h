@@ -0,0 +1,56 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+
+// Timestamped events from the interrupt handlers to the serial port.
+// Producers push into lock-free SPSC rings (spsc_ring.h): one for all
+// interrupt handlers, which share priority 2 and therefore never preempt
+// each other, and one for thread context. loop() drains both at the lowest
+// priority with telemetryDrain().
+//
+// The drain writes CSV lines (time,type,a,b,value) or, after
+// telemetrySetBinary(true), binlog.h frames, which also carry raw current
+// sample blocks (telemetryPushSamples(), binary only).
+
+enum telemetry_type_t {
+  TEL_PHASE = 1,   // a = seq_phase_t, b = stage << 8 | sweep
+  TEL_BUTTON = 2,  // a = button_event_t, value = press time (us)
+  TEL_CURRENT = 3, // b = peak, value = mean of a current block (raw SAADC)
+  TEL_IDLE = 4,    // value = sleep fraction of the last cycle, 0-1000
+  TEL_DRIVE = 5,   // a = ended on the charge target, value = charge (control.h)
+  TEL_DROPPED = 6, // value = events dropped so far (binary; CSV prints "dropped,N")
+  TEL_RUN = 7,     // a = pump_mode, b = stage, value = control_mode | calib_mode << 1
+  TEL_PROFILE = 8, // a = pump_mode, value = crc16 of the profile just activated
+  TEL_TARGETS = 9, // a = pump_mode, value = stages with a calibration target
+  TEL_NO_TARGET = 10, // a = pump_mode, b = stage: no target, not calibrated
+};
+
+struct alignas(4) TelemetryEvent {
+  uint32_t timeUs; // TIMER1 time base, see hw_timer.h
+  uint8_t type;
+  uint8_t a;
+  uint16_t b;
+  int32_t value;
+};
+
+#define TELEMETRY_ISR_EVENTS 256
+#define TELEMETRY_THREAD_EVENTS 32
+#define TELEMETRY_SAMPLE_BLOCKS 32
+#define TEL_SAMPLES_MAX 8
+
+struct TelemetrySamples {
+  uint32_t timeUs;
+  uint8_t count;
+  int16_t samples[TEL_SAMPLES_MAX];
+};
+
+bool telemetryPush(uint8_t type, uint8_t a, uint16_t b, int32_t value);
+// Writes at most maxEvents events, returns how many were written.
+int telemetryDrain(int maxEvents);
+// Interrupt context only. Dropped (false) while the drain writes CSV.
+bool telemetryPushSamples(const int16_t *samples, uint8_t count);
+void telemetrySetBinary(bool on);
+uint32_t telemetryDropped();
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <stdint.h>
+#include "hw_pwm.h"
+
+// Piecewise linear motor drive. A waveform is a short list of segments,
+// each a duty ramp from fromTicks to toTicks over cycles carrier periods
+// (fromTicks == toTicks is a flat step). The player streams it to PWM0
+// through the hwPWMStream() double buffer, so a profile of any length
+// needs only the segment list plus 2 x PWM_STREAM_VALUES values of RAM.
+//
+// Flat runs go out as a single value held with REFRESH, ramps and short
+// segments as one value per period. Every chunk but the last plays for at
+// least WAVE_FLAT_MIN periods (800 us at 20 kHz), the time the refill
+// interrupt has: flat runs shorter than that are expanded, and a ramp
+// chunk that would end early takes the head of the following flat run.
+//
+// kick + build-up as a waveform:
+//   {kickCycles, kickTicks, kickTicks}, {buildUpCycles, dutyTicks, dutyTicks}
+
+#define WAVE_MAX_SEGMENTS 16
+#define WAVE_FLAT_MIN 16 // periods, shorter flat runs are expanded
+
+struct WaveSegment {
+  uint32_t cycles;
+  uint16_t fromTicks;
+  uint16_t toTicks;
+};
+
+struct WaveCursor {
+  const WaveSegment *segs;
+  uint8_t count;
+  uint8_t seg;  // current segment
+  uint32_t pos; // period within the segment
+};
+
+void waveRewind(WaveCursor *c, const WaveSegment *segs, uint8_t count);
+// Next chunk into buf (at most max values), *refresh as for pwm_fill_t.
+// Returns 0 once the waveform is exhausted.
+uint16_t waveNextChunk(WaveCursor *c, uint16_t *buf, uint16_t max, uint32_t *refresh);
+uint32_t waveCountChunks(const WaveSegment *segs, uint8_t count, uint16_t max);
+uint32_t waveCycles(const WaveSegment *segs, uint8_t count);
+
+// segs must stay valid until done runs. Returns 0 if the PWM is busy or the
+// waveform is empty or too long. started is passed on to hwPWMStream().
+int wavePlay(const WaveSegment *segs, uint8_t count, uint16_t countertop, int pin, pwm_done_t done = 0,
+             pwm_start_t started = 0);
+
+#endif
@@ -0,0 +1,123 @@
+#include "binlog.h"
+
+uint8_t varintPut(uint8_t *p, uint32_t v) {
+  uint8_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+const uint8_t *varintGet(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35 && p < end; shift += 7) {
+    uint8_t b = *p++;
+    result |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = result;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// Nibble table, 32 bytes of flash and two lookups per byte.
+static const uint16_t crc_nibble[16] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+uint16_t binlogCrc16(const uint8_t *p, size_t n, uint16_t crc) {
+  while (n--) {
+    crc = (uint16_t)(crc << 4) ^ crc_nibble[(crc >> 12) ^ (*p >> 4)];
+    crc = (uint16_t)(crc << 4) ^ crc_nibble[(crc >> 12) ^ (*p & 0x0F)];
+    p++;
+  }
+  return crc;
+}
+
+size_t cobsEncode(const uint8_t *in, size_t n, uint8_t *out) {
+  size_t code_at = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < n; i++) {
+    if (in[i] != 0) {
+      out[o++] = in[i];
+      code++;
+    }
+    if (in[i] == 0 || code == 0xFF) {
+      out[code_at] = code;
+      code_at = o++;
+      code = 1;
+    }
+  }
+  out[code_at] = code;
+  return o;
+}
+
+size_t cobsDecode(const uint8_t *in, size_t n, uint8_t *out) {
+  size_t i = 0;
+  size_t o = 0;
+  while (i < n) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > n) return 0;
+    for (uint8_t k = 1; k < code; k++) {
+      out[o++] = in[i++];
+    }
+    if (code != 0xFF && i < n) out[o++] = 0;
+  }
+  return o;
+}
+
+void binlogBegin(BinlogWriter &w) {
+  w.payload[0] = BINLOG_VERSION;
+  w.len = 1;
+  w.lastTimeUs = 0;
+}
+
+static uint8_t putTime(BinlogWriter &w, uint8_t *p, uint8_t type, uint32_t timeUs) {
+  p[0] = type;
+  return 1 + varintPut(p + 1, zigzagEncode((int32_t)(timeUs - w.lastTimeUs)));
+}
+
+bool binlogEvent(BinlogWriter &w, const TelemetryEvent &ev) {
+  uint8_t rec[BINLOG_RECORD_MAX];
+  uint8_t n = putTime(w, rec, ev.type, ev.timeUs);
+  n += varintPut(rec + n, ev.a);
+  n += varintPut(rec + n, ev.b);
+  n += varintPut(rec + n, zigzagEncode(ev.value));
+  if (w.len + n > BINLOG_PAYLOAD_MAX) return false;
+  for (uint8_t i = 0; i < n; i++) w.payload[w.len + i] = rec[i];
+  w.len += n;
+  w.lastTimeUs = ev.timeUs;
+  return true;
+}
+
+bool binlogSamples(BinlogWriter &w, uint32_t timeUs, const int16_t *samples, uint8_t count) {
+  if (count > TEL_SAMPLES_MAX) count = TEL_SAMPLES_MAX;
+  uint8_t rec[BINLOG_RECORD_MAX];
+  uint8_t n = putTime(w, rec, BINLOG_SAMPLES, timeUs);
+  n += varintPut(rec + n, count);
+  int32_t prev = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    n += varintPut(rec + n, zigzagEncode(samples[i] - prev));
+    prev = samples[i];
+  }
+  if (w.len + n > BINLOG_PAYLOAD_MAX) return false;
+  for (uint8_t i = 0; i < n; i++) w.payload[w.len + i] = rec[i];
+  w.len += n;
+  w.lastTimeUs = timeUs;
+  return true;
+}
+
+size_t binlogFinish(BinlogWriter &w, uint8_t *out) {
+  uint16_t crc = binlogCrc16(w.payload, w.len);
+  w.payload[w.len] = (uint8_t)crc;
+  w.payload[w.len + 1] = (uint8_t)(crc >> 8);
+  out[0] = 0;
+  size_t n = 1 + cobsEncode(w.payload, w.len + 2, out + 1);
+  out[n++] = 0;
+  return n;
+}
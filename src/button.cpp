@@ -0,0 +1,94 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "button.h"
+#include "hw_timer.h"
+#include "pins.h"
+
+#define PPI_CH_BUTTON 3    // GPIOTE IN[n] -> TIMER1 CAPTURE (fork: disable PPI_GROUP_BUTTON)
+#define PPI_GROUP_BUTTON 0 // PPI_CH_BUTTON alone
+
+static uint32_t debounce_us;
+static uint32_t long_us;
+static button_cb_t button_cb = 0;
+
+static volatile bool pressed = false; // debounced level
+static bool settling = false;         // edge seen, debounce window running
+static uint32_t edge_at;              // first edge of the pending transition
+static int gpiote_ch = -1;            // the channel attachInterrupt() took
+static uint32_t pressed_at;
+static bool long_sent;
+
+static void onLongPress() {
+  if (pressed && !long_sent) {
+    long_sent = true;
+    if (button_cb) button_cb(BUTTON_LONG, pressed_at);
+  }
+}
+
+static void onDebounce() {
+  settling = false;
+  NRF_PPI->TASKS_CHG[PPI_GROUP_BUTTON].EN = 1; // stamp the next edge
+  bool level = Button::read();
+  if (level == pressed) {
+    // Bounced back, nothing changed. Keep a running long press timer.
+    if (pressed && !long_sent) hwTimerAt(TIMER_CH_BUTTON, pressed_at + long_us, onLongPress);
+    return;
+  }
+  pressed = level;
+  if (level) {
+    pressed_at = edge_at;
+    long_sent = false;
+    hwTimerAt(TIMER_CH_BUTTON, pressed_at + long_us, onLongPress);
+  } else if (!long_sent) {
+    if (button_cb) button_cb(BUTTON_SHORT, pressed_at);
+  }
+}
+
+// Called from the core's GPIOTE interrupt (WInterrupts.c) on every edge.
+// The first edge's capture also disabled PPI_GROUP_BUTTON, so the captured
+// time stays that edge's whatever bounces follow; they only restart the
+// debounce window.
+static void onEdge() {
+  uint32_t now = hwTimerNowUs();
+  if (!settling) {
+    settling = true;
+    edge_at = gpiote_ch >= 0 ? hwTimerCapturedUs() : now;
+  }
+  hwTimerAt(TIMER_CH_BUTTON, now + debounce_us, onDebounce);
+}
+
+// attachInterrupt() picks the GPIOTE channel, find it by its PSEL.
+static int findChannel() {
+  for (int ch = 0; ch < GPIOTE_CH_NUM; ch++) {
+    uint32_t config = NRF_GPIOTE->CONFIG[ch];
+    if ((config & GPIOTE_CONFIG_MODE_Msk) == (GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos) &&
+        (config & GPIOTE_CONFIG_PSEL_Msk) >> GPIOTE_CONFIG_PSEL_Pos == gpioPin(BUTTON)) {
+      return ch;
+    }
+  }
+  return -1;
+}
+
+void buttonInit(uint32_t debounceMs, uint32_t longMs, button_cb_t cb) {
+  debounce_us = debounceMs * 1000UL;
+  long_us = longMs * 1000UL;
+  button_cb = cb;
+  pressed = Button::read();
+  long_sent = true; // a button held at boot is not a press
+
+  // The core owns GPIOTE_IRQHandler, so the interrupt goes through it.
+  attachInterrupt(BUTTON, onEdge, CHANGE);
+  NVIC_SetPriority(GPIOTE_IRQn, 2); // same level as TIMER1, the two never nest
+  gpiote_ch = findChannel();
+  if (gpiote_ch < 0) return; // stamped in onEdge() instead, late by the interrupt latency
+
+  NRF_PPI->CH[PPI_CH_BUTTON].EEP = (uint32_t)&NRF_GPIOTE->EVENTS_IN[gpiote_ch];
+  NRF_PPI->CH[PPI_CH_BUTTON].TEP = hwTimerCaptureTask();
+  NRF_PPI->FORK[PPI_CH_BUTTON].TEP = (uint32_t)&NRF_PPI->TASKS_CHG[PPI_GROUP_BUTTON].DIS;
+  NRF_PPI->CHG[PPI_GROUP_BUTTON] = 1UL << PPI_CH_BUTTON;
+  NRF_PPI->TASKS_CHG[PPI_GROUP_BUTTON].EN = 1;
+}
+
+bool buttonPressed() {
+  return pressed;
+}
@@ -0,0 +1,77 @@
+#include "calib_search.h"
+#include "pump_profile.h"
+
+static uint16_t clampMs(const CalibSearch &s, uint32_t ms) {
+  if (ms < s.minMs) return s.minMs;
+  if (ms > s.maxMs) return s.maxMs;
+  return (uint16_t)ms;
+}
+
+void calibBegin(CalibSearch &s, uint16_t nominalMs, uint32_t target) {
+  uint32_t span = ((uint32_t)nominalMs * CALIB_RANGE_PERMILLE + 500) / 1000;
+  uint32_t lo = nominalMs > span ? nominalMs - span : 0;
+  uint32_t hi = nominalMs + span;
+  s.minMs = lo < PROFILE_BUILD_UP_MIN_MS ? PROFILE_BUILD_UP_MIN_MS : lo;
+  s.maxMs = hi > PROFILE_BUILD_UP_MAX_MS ? PROFILE_BUILD_UP_MAX_MS : hi;
+  s.target = target;
+  s.haveLo = s.haveHi = false;
+  s.loMs = s.hiMs = 0;
+  s.loCharge = s.hiCharge = 0;
+  s.nextMs = clampMs(s, nominalMs);
+  s.bestMs = s.nextMs;
+  s.bestError = UINT32_MAX;
+  s.tries = 0;
+  // Nothing to search for without a target, the nominal time stays.
+  s.done = target == 0;
+}
+
+bool calibUpdate(CalibSearch &s, uint32_t charge) {
+  if (s.done) return true;
+
+  uint16_t ms = s.nextMs;
+  uint32_t error = charge > s.target ? charge - s.target : s.target - charge;
+  s.tries++;
+  if (error < s.bestError) {
+    s.bestError = error;
+    s.bestMs = ms;
+  }
+  if (charge < s.target) {
+    s.haveLo = true;
+    s.loMs = ms;
+    s.loCharge = charge;
+  } else {
+    s.haveHi = true;
+    s.hiMs = ms;
+    s.hiCharge = charge;
+  }
+
+  if ((uint64_t)error * 1000 <= (uint64_t)s.target * CALIB_TOL_PERMILLE ||
+      s.tries >= CALIB_MAX_TRIES) {
+    s.done = true;
+    return true;
+  }
+
+  uint32_t next;
+  if (s.haveLo && s.haveHi) {
+    if (s.hiMs - s.loMs <= CALIB_RES_MS) {
+      s.done = true;
+      return true;
+    }
+    uint32_t dq = s.hiCharge - s.loCharge;
+    next = dq > 0 ? s.loMs + (uint64_t)(s.target - s.loCharge) * (s.hiMs - s.loMs) / dq : 0;
+    if (next <= s.loMs || next >= s.hiMs) {
+      next = (s.loMs + s.hiMs) / 2;
+    }
+  } else if (charge == 0) {
+    next = s.maxMs; // no current measured at all, try the far end
+  } else {
+    next = ((uint64_t)ms * s.target + charge / 2) / charge;
+  }
+
+  s.nextMs = clampMs(s, next);
+  // Pinned at the end of the range: the target is out of reach.
+  if (s.nextMs == ms) {
+    s.done = true;
+  }
+  return s.done;
+}
@@ -0,0 +1,155 @@
+#include <Arduino.h>
+#include "command.h"
+#include "binlog.h"
+#include "profile_store.h"
+#include "target_store.h"
+
+static uint8_t frame[CMD_FRAME_MAX];
+static uint16_t frame_len = 0;
+static bool in_frame = false;
+static bool overflow = false;
+static cmd_text_t text_cb = 0;
+
+static void reply(uint8_t seq, uint8_t cmd, uint8_t status, const uint8_t *data = 0,
+                  uint16_t len = 0) {
+  static BinlogWriter w; // payload buffer and framing of the binary log
+  static uint8_t out[BINLOG_FRAME_MAX];
+  w.payload[0] = CMD_REPLY;
+  w.payload[1] = seq;
+  w.payload[2] = cmd;
+  w.payload[3] = status;
+  for (uint16_t i = 0; i < len; i++) {
+    w.payload[4 + i] = data[i];
+  }
+  w.len = 4 + len;
+  Serial.write(out, binlogFinish(w, out));
+}
+
+static bool modeOk(uint8_t mode) {
+  return mode < PROFILE_MODES;
+}
+
+static void handle(const uint8_t *p, uint16_t n) {
+  uint8_t cmd = p[0];
+  uint8_t seq = p[1];
+  const uint8_t *arg = p + 2;
+  uint16_t argLen = n - 2;
+
+  switch (cmd) {
+    case CMD_PING:
+      reply(seq, cmd, CMD_OK);
+      break;
+
+    case CMD_UPLOAD: {
+      if (argLen != 1 + PROFILE_WIRE_SIZE || !modeOk(arg[0])) {
+        reply(seq, cmd, CMD_ERR_LENGTH);
+        break;
+      }
+      PumpProfile profile;
+      profileDeserialize(arg + 1, &profile);
+      int bad = profileStage(arg[0], profile);
+      if (bad >= 0) {
+        uint8_t stage = (uint8_t)bad;
+        reply(seq, cmd, CMD_ERR_RANGE, &stage, 1);
+      } else {
+        reply(seq, cmd, CMD_OK);
+      }
+      break;
+    }
+
+    case CMD_ACTIVATE:
+      if (argLen != 3 || !modeOk(arg[0])) {
+        reply(seq, cmd, CMD_ERR_LENGTH);
+      } else if (!profileActivate(arg[0], (uint16_t)(arg[1] | arg[2] << 8))) {
+        reply(seq, cmd, CMD_ERR_STATE);
+      } else {
+        reply(seq, cmd, CMD_OK);
+      }
+      break;
+
+    case CMD_QUERY: {
+      if (argLen != 1 || !modeOk(arg[0])) {
+        reply(seq, cmd, CMD_ERR_LENGTH);
+        break;
+      }
+      uint8_t data[3 + PROFILE_WIRE_SIZE];
+      const PumpProfile &profile = profileActive(arg[0]);
+      uint16_t crc = profileCrc(profile);
+      data[0] = profileSource(arg[0]);
+      data[1] = (uint8_t)crc;
+      data[2] = (uint8_t)(crc >> 8);
+      profileSerialize(profile, data + 3);
+      reply(seq, cmd, CMD_OK, data, sizeof(data));
+      break;
+    }
+
+    case CMD_SET_TARGETS: {
+      if (argLen != 1 + TARGET_WIRE_SIZE || !modeOk(arg[0])) {
+        reply(seq, cmd, CMD_ERR_LENGTH);
+        break;
+      }
+      uint32_t targets[PROFILE_STAGES];
+      for (int i = 0; i < PROFILE_STAGES; i++) {
+        const uint8_t *b = arg + 1 + 4 * i;
+        targets[i] = b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+      }
+      targetStoreSet(arg[0], targets);
+      reply(seq, cmd, CMD_OK);
+      break;
+    }
+
+    case CMD_QUERY_TARGETS: {
+      if (argLen != 1 || !modeOk(arg[0])) {
+        reply(seq, cmd, CMD_ERR_LENGTH);
+        break;
+      }
+      uint8_t data[TARGET_WIRE_SIZE];
+      const uint32_t *targets = targetStoreGet(arg[0]);
+      for (int i = 0; i < PROFILE_STAGES; i++) {
+        for (int k = 0; k < 4; k++) data[4 * i + k] = (uint8_t)(targets[i] >> (8 * k));
+      }
+      reply(seq, cmd, CMD_OK, data, sizeof(data));
+      break;
+    }
+
+    default:
+      reply(seq, cmd, CMD_ERR_UNKNOWN);
+      break;
+  }
+}
+
+static void frameDone() {
+  size_t n = overflow ? 0 : cobsDecode(frame, frame_len, frame);
+  if (n < 4 || binlogCrc16(frame, n - 2) != (uint16_t)(frame[n - 2] | frame[n - 1] << 8)) {
+    reply(0, 0, CMD_ERR_CRC);
+    return;
+  }
+  handle(frame, n - 2);
+}
+
+void cmdInit(cmd_text_t onText) {
+  text_cb = onText;
+}
+
+void cmdPoll() {
+  while (Serial.available()) {
+    int c = Serial.read();
+    if (c == 0) {
+      // Closes a frame, or opens one when nothing is pending.
+      if (frame_len > 0 || overflow) {
+        frameDone();
+        in_frame = false;
+      } else {
+        in_frame = true;
+      }
+      frame_len = 0;
+      overflow = false;
+    } else if (!in_frame) {
+      if (text_cb) text_cb((char)c);
+    } else if (frame_len < CMD_FRAME_MAX) {
+      frame[frame_len++] = (uint8_t)c;
+    } else {
+      overflow = true;
+    }
+  }
+}
@@ -0,0 +1,83 @@
+#include "control.h"
+
+static CtrlConfig cfg;
+static ctrl_stop_t stop_cb = 0;
+static volatile bool active = false;
+static volatile bool reached = false;
+static volatile uint16_t duty;
+static uint32_t setpoint;     // raw LSB
+static int32_t integral_q16;  // Ki * sum(error), duty ticks in Q16
+static volatile uint32_t charge;
+static volatile uint32_t cycles;
+
+void ctrlBegin(const CtrlConfig &c, ctrl_stop_t onTarget) {
+  cfg = c;
+  stop_cb = onTarget;
+  charge = 0;
+  cycles = 0;
+  reached = false;
+  integral_q16 = 0;
+  duty = c.startTicks;
+  setpoint = c.nominalCycles > 0 ? c.targetCharge / c.nominalCycles : 0;
+  active = true;
+}
+
+void ctrlEnd() {
+  active = false;
+}
+
+void ctrlOnBlock(const int16_t *block, uint16_t count) {
+  if (!active) return;
+
+  int32_t sum = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    sum += block[i] > 0 ? block[i] : 0;
+  }
+  charge += sum;
+  cycles += count;
+
+  if (!cfg.closedLoop) return;
+
+  if (charge >= cfg.targetCharge) {
+    reached = true;
+    active = false;
+    if (stop_cb) stop_cb();
+    return;
+  }
+  if (cycles <= cfg.kickCycles) return;
+
+  // PI on the block mean error.
+  int32_t error_sum = (int32_t)setpoint * count - sum;
+  int32_t p_q16 = CTRL_KP_Q16 * error_sum / count;
+  int32_t i_step = CTRL_KI_Q16 * error_sum / count;
+  int32_t out = cfg.startTicks + ((p_q16 + integral_q16 + i_step) >> 16);
+
+  // Conditional integration: the integrator only moves when the output is
+  // not pinned against the limit it is pushing towards.
+  if (!((out >= cfg.maxTicks && i_step > 0) || (out <= cfg.minTicks && i_step < 0))) {
+    integral_q16 += i_step;
+  }
+  if (out > cfg.maxTicks) out = cfg.maxTicks;
+  if (out < cfg.minTicks) out = cfg.minTicks;
+  duty = (uint16_t)out;
+}
+
+uint16_t ctrlDuty() {
+  return duty;
+}
+
+uint32_t ctrlCharge() {
+  return charge;
+}
+
+uint32_t ctrlCycles() {
+  return cycles;
+}
+
+bool ctrlReachedTarget() {
+  return reached;
+}
+
+bool ctrlClosedLoop() {
+  return cfg.closedLoop;
+}
@@ -0,0 +1,181 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "current_sense.h"
+#include "pins.h"
+
+#define SAMPLE_TIMER NRF_TIMER3
+#define SAMPLE_PWM NRF_PWM0 // the motor PWM, see hw_pwm.cpp
+#define SAMPLE_CLOCK_HZ 16000000UL
+#define PPI_CH_PERIOD 4 // PWM0 PWMPERIODEND -> TIMER3 START
+#define PPI_CH_SAMPLE 5 // TIMER3 COMPARE0   -> SAADC SAMPLE
+#define PPI_CH_RESTART 6 // SAADC END        -> SAADC START (next buffer)
+#define PPI_MASK ((1UL << PPI_CH_PERIOD) | (1UL << PPI_CH_SAMPLE) | (1UL << PPI_CH_RESTART))
+
+static int16_t blocks[2][CURRENT_BLOCK_SAMPLES];
+// Buffers strictly alternate starting with blocks[0]: the n-th START
+// latches blocks[n & 1] and the n-th END completes it.
+static uint32_t start_count;
+static uint16_t block_len = CURRENT_BLOCK_SAMPLES;
+static current_block_cb_t block_cb = 0;
+static volatile uint32_t block_count;
+static bool sync_running = false; // currentStart(CURRENT_SYNC) in effect
+
+// SAADC input of a P0 pin: P0.02-05 are AIN0-3, P0.28-31 AIN4-7.
+static uint32_t saadcInput(uint32_t p0) {
+  if (p0 >= 2 && p0 <= 5) return SAADC_CH_PSELP_PSELP_AnalogInput0 + (p0 - 2);
+  if (p0 >= 28 && p0 <= 31) return SAADC_CH_PSELP_PSELP_AnalogInput4 + (p0 - 28);
+  return SAADC_CH_PSELP_PSELP_NC;
+}
+
+// Any other pin would read 0 forever, and the closed loop and the
+// calibration would quietly run on that: stop before the motor is driven.
+static void haltNotAnalog(uint32_t p0) {
+  Serial.print("current_sense: MOTOR_UI is P0.");
+  Serial.print((unsigned long)p0);
+  Serial.println(", not an analog input (AIN0-7), halted");
+  Serial.flush();
+  __disable_irq();
+  while (true) {
+  }
+}
+
+void currentInit(current_block_cb_t cb) {
+  block_cb = cb;
+
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+  NRF_SAADC->RESOLUTION = SAADC_RESOLUTION_VAL_12bit;
+  NRF_SAADC->OVERSAMPLE = SAADC_OVERSAMPLE_OVERSAMPLE_Bypass;
+  NRF_SAADC->SAMPLERATE = SAADC_SAMPLERATE_MODE_Task << SAADC_SAMPLERATE_MODE_Pos;
+  for (int ch = 0; ch < 8; ch++) {
+    NRF_SAADC->CH[ch].PSELP = 0;
+    NRF_SAADC->CH[ch].PSELN = 0;
+  }
+  // 3 us acquisition + 2 us conversion keeps 200 ksps possible.
+  NRF_SAADC->CH[0].CONFIG = (SAADC_CH_CONFIG_RESP_Bypass << SAADC_CH_CONFIG_RESP_Pos) |
+                            (SAADC_CH_CONFIG_RESN_Bypass << SAADC_CH_CONFIG_RESN_Pos) |
+                            (SAADC_CH_CONFIG_GAIN_Gain1_6 << SAADC_CH_CONFIG_GAIN_Pos) |
+                            (SAADC_CH_CONFIG_REFSEL_Internal << SAADC_CH_CONFIG_REFSEL_Pos) |
+                            (SAADC_CH_CONFIG_TACQ_3us << SAADC_CH_CONFIG_TACQ_Pos) |
+                            (SAADC_CH_CONFIG_MODE_SE << SAADC_CH_CONFIG_MODE_Pos) |
+                            (SAADC_CH_CONFIG_BURST_Disabled << SAADC_CH_CONFIG_BURST_Pos);
+  uint32_t input = saadcInput(gpioPin(MOTOR_UI));
+  if (input == SAADC_CH_PSELP_PSELP_NC) haltNotAnalog(gpioPin(MOTOR_UI));
+  NRF_SAADC->CH[0].PSELP = input;
+  NRF_SAADC->CH[0].PSELN = SAADC_CH_PSELN_PSELN_NC;
+
+  SAMPLE_TIMER->TASKS_STOP = 1;
+  SAMPLE_TIMER->MODE = TIMER_MODE_MODE_Timer;
+  SAMPLE_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  SAMPLE_TIMER->PRESCALER = 0; // 16 MHz, one tick per PWM counter tick
+
+  NRF_PPI->CH[PPI_CH_PERIOD].EEP = (uint32_t)&SAMPLE_PWM->EVENTS_PWMPERIODEND;
+  NRF_PPI->CH[PPI_CH_PERIOD].TEP = (uint32_t)&SAMPLE_TIMER->TASKS_START;
+  NRF_PPI->CH[PPI_CH_SAMPLE].EEP = (uint32_t)&SAMPLE_TIMER->EVENTS_COMPARE[0];
+  NRF_PPI->CH[PPI_CH_SAMPLE].TEP = (uint32_t)&NRF_SAADC->TASKS_SAMPLE;
+  NRF_PPI->CH[PPI_CH_RESTART].EEP = (uint32_t)&NRF_SAADC->EVENTS_END;
+  NRF_PPI->CH[PPI_CH_RESTART].TEP = (uint32_t)&NRF_SAADC->TASKS_START;
+  NRF_PPI->CHENCLR = PPI_MASK;
+
+  NVIC_SetPriority(SAADC_IRQn, 2); // same as all telemetry producers
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  NVIC_EnableIRQ(SAADC_IRQn);
+}
+
+void currentSetDelay(uint16_t ticks) {
+  uint32_t cc = ticks > 0 ? ticks : 1;
+  SAMPLE_TIMER->CC[0] = cc;
+  if (!sync_running) return;
+  // Moved mid period below the running count: the compare is missed and the
+  // one shot would run on, so sample now and re-arm for the next period.
+  SAMPLE_TIMER->TASKS_CAPTURE[1] = 1;
+  if (SAMPLE_TIMER->CC[1] >= cc) {
+    SAMPLE_TIMER->TASKS_STOP = 1;
+    SAMPLE_TIMER->TASKS_CLEAR = 1;
+    NRF_SAADC->TASKS_SAMPLE = 1;
+  }
+}
+
+void currentStart(current_trigger_t trigger, uint32_t rateHz, uint16_t blockSamples) {
+  currentStop();
+  block_len = blockSamples > 0 && blockSamples <= CURRENT_BLOCK_SAMPLES ? blockSamples : CURRENT_BLOCK_SAMPLES;
+  block_count = 0;
+  start_count = 0;
+
+  SAMPLE_TIMER->TASKS_CLEAR = 1;
+  SAMPLE_TIMER->EVENTS_COMPARE[0] = 0;
+  uint32_t ppi = (1UL << PPI_CH_SAMPLE) | (1UL << PPI_CH_RESTART);
+  if (trigger == CURRENT_SYNC) {
+    // One shot per period, re-armed by the next PWMPERIODEND.
+    SAMPLE_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_STOP_Msk | TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+    ppi |= 1UL << PPI_CH_PERIOD;
+  } else {
+    if (rateHz == 0 || rateHz > CURRENT_MAX_RATE_HZ) rateHz = CURRENT_MAX_RATE_HZ;
+    SAMPLE_TIMER->SHORTS = TIMER_SHORTS_COMPARE0_CLEAR_Msk;
+    SAMPLE_TIMER->CC[0] = SAMPLE_CLOCK_HZ / rateHz;
+  }
+
+  NRF_SAADC->RESULT.PTR = (uint32_t)blocks[0];
+  NRF_SAADC->RESULT.MAXCNT = block_len;
+  NRF_SAADC->EVENTS_STARTED = 0;
+  NRF_SAADC->EVENTS_END = 0;
+  NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Enabled;
+  NRF_SAADC->TASKS_START = 1;
+
+  NRF_PPI->CHENSET = ppi;
+  if (trigger == CURRENT_FREE_RUN) SAMPLE_TIMER->TASKS_START = 1;
+  sync_running = trigger == CURRENT_SYNC;
+}
+
+void currentStop() {
+  sync_running = false;
+  NRF_PPI->CHENCLR = PPI_MASK;
+  SAMPLE_TIMER->TASKS_STOP = 1;
+  NRF_SAADC->INTENCLR = SAADC_INTENCLR_STARTED_Msk | SAADC_INTENCLR_END_Msk;
+  NRF_SAADC->TASKS_STOP = 1;
+  NRF_SAADC->ENABLE = SAADC_ENABLE_ENABLE_Disabled;
+}
+
+uint32_t currentBlocks() {
+  return block_count;
+}
+
+void currentRealign() {
+  if (!sync_running) return;
+  NRF_SAADC->INTENCLR = SAADC_INTENCLR_STARTED_Msk | SAADC_INTENCLR_END_Msk;
+  NRF_PPI->CHENCLR = 1UL << PPI_CH_RESTART;
+  SAMPLE_TIMER->TASKS_STOP = 1;
+  SAMPLE_TIMER->TASKS_CLEAR = 1;
+  SAMPLE_TIMER->EVENTS_COMPARE[0] = 0;
+  NRF_SAADC->EVENTS_STOPPED = 0;
+  NRF_SAADC->TASKS_STOP = 1;
+  while (!NRF_SAADC->EVENTS_STOPPED) {
+  }
+  // The stopped buffer is not a block: restart on the buffer block_count
+  // expects, with start_count in step so the alternation holds.
+  NRF_SAADC->EVENTS_STOPPED = 0;
+  NRF_SAADC->EVENTS_STARTED = 0;
+  NRF_SAADC->EVENTS_END = 0;
+  NVIC_ClearPendingIRQ(SAADC_IRQn);
+  start_count = block_count;
+  NRF_SAADC->RESULT.PTR = (uint32_t)blocks[block_count & 1];
+  NRF_SAADC->RESULT.MAXCNT = block_len;
+  NRF_SAADC->INTENSET = SAADC_INTENSET_STARTED_Msk | SAADC_INTENSET_END_Msk;
+  NRF_SAADC->TASKS_START = 1;
+  NRF_PPI->CHENSET = 1UL << PPI_CH_RESTART;
+}
+
+extern "C" void SAADC_IRQHandler(void) {
+  // STARTED: RESULT.PTR is latched, queue the other buffer for the next START.
+  if (NRF_SAADC->EVENTS_STARTED) {
+    NRF_SAADC->EVENTS_STARTED = 0;
+    start_count++;
+    NRF_SAADC->RESULT.PTR = (uint32_t)blocks[start_count & 1];
+  }
+  if (NRF_SAADC->EVENTS_END) {
+    NRF_SAADC->EVENTS_END = 0;
+    const int16_t *done = blocks[block_count & 1];
+    block_count++;
+    if (block_cb) block_cb(done, block_len);
+  }
+}
@@ -0,0 +1,202 @@
+#include <string.h>
+#include "flash_log.h"
+#include "spsc_ring.h"
+
+#define ERASED 0xFFFFFFFFUL
+
+static SpscRing<FlashLogRecord, FLASH_LOG_QUEUE> queue;
+static uint8_t head_page;   // page being filled
+static uint16_t head_slot;  // next free slot in it, FLASH_LOG_SLOTS when full
+static uint32_t head_seq;   // its sequence number, 0 before the first page
+static uint8_t valid_pages;
+static int8_t ahead = -1;   // page after the head: -1 not checked, 0 dirty, 1 erased
+static uint32_t boot;
+
+static FlashLogRecord pending;
+static uint32_t pending_words[FLASH_LOG_RECORD_WORDS];
+static int8_t pending_word = -1; // next word to write, -1 when idle
+static uint8_t pending_done;     // words written so far
+
+static uint32_t pageAddr(uint8_t page) {
+  return FLASH_LOG_BASE + (uint32_t)page * NVMC_PAGE_SIZE;
+}
+
+static uint32_t slotAddr(uint8_t page, uint16_t slot) {
+  return pageAddr(page) + (FLASH_LOG_HEADER_WORDS + (uint32_t)slot * FLASH_LOG_RECORD_WORDS) * 4;
+}
+
+static bool pageValid(uint8_t page) {
+  const uint32_t *h = nvmcPtr(pageAddr(page));
+  return h[0] == FLASH_LOG_MAGIC && h[1] != ERASED;
+}
+
+static bool pageErased(uint8_t page) {
+  const uint32_t *w = nvmcPtr(pageAddr(page));
+  for (uint32_t i = 0; i < NVMC_PAGE_WORDS; i++) {
+    if (w[i] != ERASED) return false;
+  }
+  return true;
+}
+
+static bool slotErased(uint8_t page, uint16_t slot) {
+  const uint32_t *w = nvmcPtr(slotAddr(page, slot));
+  for (int i = 0; i < FLASH_LOG_RECORD_WORDS; i++) {
+    if (w[i] != ERASED) return false;
+  }
+  return true;
+}
+
+static uint8_t nextPage(uint8_t page) {
+  return page + 1 < FLASH_LOG_PAGES ? page + 1 : 0;
+}
+
+static bool aheadErased() {
+  if (ahead < 0) ahead = pageErased(nextPage(head_page)) ? 1 : 0;
+  return ahead == 1;
+}
+
+static void eraseAhead() {
+  uint8_t next = nextPage(head_page);
+  if (pageValid(next)) valid_pages--; // the oldest page goes
+  nvmcErasePage(pageAddr(next));
+  ahead = 1;
+}
+
+static bool readSlot(uint8_t page, uint16_t slot, FlashLogRecord *r) {
+  const uint32_t *w = nvmcPtr(slotAddr(page, slot));
+  if (w[0] == ERASED) return false; // empty, or cut before word 0
+  memcpy(r, w, sizeof(*r));
+  return true;
+}
+
+void flashLogInit() {
+  static_assert(sizeof(FlashLogRecord) == FLASH_LOG_RECORD_WORDS * 4, "record size");
+
+  // Head: the valid page with the highest sequence number.
+  valid_pages = 0;
+  head_seq = 0;
+  head_page = FLASH_LOG_PAGES - 1;
+  for (uint8_t p = 0; p < FLASH_LOG_PAGES; p++) {
+    if (!pageValid(p)) continue;
+    valid_pages++;
+    uint32_t seq = nvmcPtr(pageAddr(p))[1];
+    if (seq >= head_seq) {
+      head_seq = seq;
+      head_page = p;
+    }
+  }
+
+  boot = 0;
+  ahead = -1;
+  pending_word = -1;
+  while (queue.pop(pending)) {
+  }
+  FlashLogRecord mark = {FLASH_LOG_BOOT, 0, 0, 0, 0, 0, 0};
+  if (valid_pages == 0) {
+    head_slot = FLASH_LOG_SLOTS; // first append opens page 0
+    flashLogAppend(mark);
+    return;
+  }
+
+  // Slots fill in order: first fully erased slot, by bisection.
+  uint16_t lo = 0;
+  uint16_t hi = FLASH_LOG_SLOTS;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (slotErased(head_page, mid)) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  head_slot = lo;
+
+  // Boot count: one more than the newest readable record.
+  FlashLogRecord r;
+  for (uint32_t i = flashLogCount(); i > 0; i--) {
+    if (flashLogRead(i - 1, &r)) {
+      boot = r.boot + 1;
+      break;
+    }
+  }
+  flashLogAppend(mark);
+}
+
+bool flashLogAppend(const FlashLogRecord &r) {
+  return queue.push(r);
+}
+
+// Opens the next page once the head is full: erase if needed (only when
+// allowed), then the header, sequence word first and magic last.
+static bool openNextPage(bool mayErase, int *budget) {
+  uint8_t next = nextPage(head_page);
+  if (!aheadErased()) {
+    if (mayErase) eraseAhead();
+    return false; // at most one erase stall per call
+  }
+  if (*budget < 2) return false;
+  nvmcWriteWord(pageAddr(next) + 4, head_seq + 1);
+  nvmcWriteWord(pageAddr(next), FLASH_LOG_MAGIC);
+  *budget -= 2;
+  head_seq++;
+  head_page = next;
+  head_slot = 0;
+  valid_pages++;
+  ahead = -1;
+  return true;
+}
+
+void flashLogService(bool mayErase) {
+  int budget = FLASH_LOG_SERVICE_WORDS;
+  while (budget > 0) {
+    if (pending_word < 0) {
+      if (!queue.pop(pending)) break;
+      pending.boot = boot;
+      memcpy(pending_words, &pending, sizeof(pending_words));
+      pending_done = 0;
+      pending_word = 1;
+    }
+    if (head_slot >= FLASH_LOG_SLOTS && !openNextPage(mayErase, &budget)) {
+      return;
+    }
+    // Words 1..n-1 first, word 0 commits the record.
+    nvmcWriteWord(slotAddr(head_page, head_slot) + pending_word * 4, pending_words[pending_word]);
+    budget--;
+    if (++pending_done == FLASH_LOG_RECORD_WORDS) {
+      pending_word = -1;
+      head_slot++;
+    } else {
+      pending_word = pending_word + 1 < FLASH_LOG_RECORD_WORDS ? pending_word + 1 : 0;
+    }
+  }
+
+  // Keep the page ahead erased while there is time for it.
+  if (mayErase && head_slot < FLASH_LOG_SLOTS && !aheadErased()) {
+    eraseAhead();
+  }
+}
+
+bool flashLogPending() {
+  return pending_word >= 0 || queue.size() > 0;
+}
+
+uint32_t flashLogCount() {
+  if (valid_pages == 0) return 0;
+  return (uint32_t)(valid_pages - 1) * FLASH_LOG_SLOTS + head_slot;
+}
+
+bool flashLogRead(uint32_t index, FlashLogRecord *r) {
+  if (index >= flashLogCount()) return false;
+  // Valid pages are consecutive and end at the head.
+  uint8_t page = (head_page + FLASH_LOG_PAGES - (valid_pages - 1)) % FLASH_LOG_PAGES;
+  page = (page + index / FLASH_LOG_SLOTS) % FLASH_LOG_PAGES;
+  return readSlot(page, index % FLASH_LOG_SLOTS, r);
+}
+
+uint32_t flashLogBoot() {
+  return boot;
+}
+
+uint32_t flashLogDropped() {
+  return queue.dropped();
+}
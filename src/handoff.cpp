@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "handoff.h"
+#include "pins.h"
+#include "phase_timing.h"
+
+#define HANDOFF_TIMER NRF_TIMER2
+#define HANDOFF_IRQ TIMER2_IRQn
+#define HANDOFF_PWM NRF_PWM0 // same instance as hw_pwm.cpp
+
+// GPIOTE/PPI channels kept clear of the ones the core hands out to
+// attachInterrupt() and analogWrite().
+#define GPIOTE_CH_EN 6
+#define GPIOTE_CH_PWM 7
+#define PPI_CH_START 0 // PWM0 STOPPED    -> TIMER2 START
+#define PPI_CH_OPEN 1  // TIMER2 COMPARE0 -> SET SOL_ON_EN (fork SET SOL_ON_PWM)
+#define PPI_CH_CLOSE 2 // TIMER2 COMPARE1 -> CLR SOL_ON_EN (fork CLR SOL_ON_PWM)
+#define PPI_MASK ((1UL << PPI_CH_START) | (1UL << PPI_CH_OPEN) | (1UL << PPI_CH_CLOSE))
+
+static handoff_done_t done_cb = 0;
+
+static uint32_t gpioteTask(uint8_t pin) {
+  return (GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos) |
+         (gpioPin(pin) << GPIOTE_CONFIG_PSEL_Pos) |
+         (GPIOTE_CONFIG_POLARITY_Toggle << GPIOTE_CONFIG_POLARITY_Pos) |
+         (GPIOTE_CONFIG_OUTINIT_Low << GPIOTE_CONFIG_OUTINIT_Pos);
+}
+
+static void releasePins() {
+  NRF_GPIOTE->CONFIG[GPIOTE_CH_EN] = GPIOTE_CONFIG_MODE_Disabled;
+  NRF_GPIOTE->CONFIG[GPIOTE_CH_PWM] = GPIOTE_CONFIG_MODE_Disabled;
+  SolOn::low();
+}
+
+void handoffInit() {
+  HANDOFF_TIMER->TASKS_STOP = 1;
+  HANDOFF_TIMER->MODE = TIMER_MODE_MODE_Timer;
+  HANDOFF_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  HANDOFF_TIMER->PRESCALER = 4; // 1 MHz
+  HANDOFF_TIMER->SHORTS = TIMER_SHORTS_COMPARE1_STOP_Msk | TIMER_SHORTS_COMPARE1_CLEAR_Msk;
+  HANDOFF_TIMER->INTENSET = TIMER_INTENSET_COMPARE1_Msk;
+
+  NRF_PPI->CH[PPI_CH_START].EEP = (uint32_t)&HANDOFF_PWM->EVENTS_STOPPED;
+  NRF_PPI->CH[PPI_CH_START].TEP = (uint32_t)&HANDOFF_TIMER->TASKS_START;
+  NRF_PPI->CH[PPI_CH_OPEN].EEP = (uint32_t)&HANDOFF_TIMER->EVENTS_COMPARE[0];
+  NRF_PPI->CH[PPI_CH_OPEN].TEP = (uint32_t)&NRF_GPIOTE->TASKS_SET[GPIOTE_CH_EN];
+  NRF_PPI->FORK[PPI_CH_OPEN].TEP = (uint32_t)&NRF_GPIOTE->TASKS_SET[GPIOTE_CH_PWM];
+  NRF_PPI->CH[PPI_CH_CLOSE].EEP = (uint32_t)&HANDOFF_TIMER->EVENTS_COMPARE[1];
+  NRF_PPI->CH[PPI_CH_CLOSE].TEP = (uint32_t)&NRF_GPIOTE->TASKS_CLR[GPIOTE_CH_EN];
+  NRF_PPI->FORK[PPI_CH_CLOSE].TEP = (uint32_t)&NRF_GPIOTE->TASKS_CLR[GPIOTE_CH_PWM];
+  NRF_PPI->CHENCLR = PPI_MASK;
+
+  NVIC_SetPriority(HANDOFF_IRQ, 2);
+  NVIC_ClearPendingIRQ(HANDOFF_IRQ);
+  NVIC_EnableIRQ(HANDOFF_IRQ);
+}
+
+void handoffArm(uint32_t gapUs, uint32_t openUs, handoff_done_t done) {
+  done_cb = done;
+  HANDOFF_TIMER->TASKS_STOP = 1;
+  HANDOFF_TIMER->TASKS_CLEAR = 1;
+  HANDOFF_TIMER->CC[0] = gapUs;
+  HANDOFF_TIMER->CC[1] = gapUs + openUs;
+  HANDOFF_TIMER->EVENTS_COMPARE[0] = 0;
+  HANDOFF_TIMER->EVENTS_COMPARE[1] = 0;
+
+  // GPIOTE takes the solenoid lines over, starting LOW like the GPIO.
+  NRF_GPIOTE->CONFIG[GPIOTE_CH_EN] = gpioteTask(SOL_ON_EN);
+  NRF_GPIOTE->CONFIG[GPIOTE_CH_PWM] = gpioteTask(SOL_ON_PWM);
+
+  NRF_PPI->CHENSET = PPI_MASK;
+}
+
+void handoffDisarm() {
+  NRF_PPI->CHENCLR = PPI_MASK;
+  HANDOFF_TIMER->TASKS_STOP = 1;
+  HANDOFF_TIMER->TASKS_CLEAR = 1;
+  releasePins();
+  done_cb = 0;
+}
+
+extern "C" void TIMER2_IRQHandler(void) {
+  PT_IRQ_ENTRY();
+  if (HANDOFF_TIMER->EVENTS_COMPARE[1]) {
+    HANDOFF_TIMER->EVENTS_COMPARE[1] = 0;
+    NRF_PPI->CHENCLR = PPI_MASK;
+    releasePins();
+    handoff_done_t cb = done_cb;
+    done_cb = 0;
+    if (cb) cb();
+  }
+}
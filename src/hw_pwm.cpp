@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "fast_pin.h"
+#include "hw_pwm.h"
+#include "phase_timing.h"
+
+// PWM0 is free, the sketch never calls analogWrite().
+#define PWM_DEV NRF_PWM0
+#define PWM_IRQ PWM0_IRQn
+#define PWM_CLOCK_HZ 16000000UL
+#define PWM_MAX_TOP 32767
+#define PWM_DISCONNECTED (PWM_PSEL_OUT_CONNECT_Disconnected << PWM_PSEL_OUT_CONNECT_Pos)
+// Bit 15 set: the period starts HIGH and falls at the compare value,
+// so the sequence value is the on-time in counter ticks.
+#define PWM_ACTIVE_HIGH 0x8000
+
+// EasyDMA reads these straight from RAM while the sequence plays.
+// seq 0 holds the requested duty and is repeated for the whole duration,
+// seq 1 is a single 0% period so the pin is LOW when the PWM stops.
+static uint16_t seq_on[1];
+static uint16_t seq_off[1];
+
+// Streaming double buffer, see hwPWMStream().
+static uint16_t stream_buf[2][PWM_STREAM_VALUES];
+static pwm_fill_t stream_fill = 0;
+static uint32_t stream_chunks_left; // fill() calls still due
+static uint32_t stream_seqs_left;   // sequences still to be programmed
+static pwm_start_t stream_started = 0;
+static uint32_t stream_starts_left; // chunks not started yet
+static uint16_t stream_min[2];      // shortest on-time per sequence
+
+static volatile bool busy = false;
+static pwm_done_t done_cb = 0;
+
+void hwPWMInit() {
+  PWM_DEV->ENABLE = PWM_ENABLE_ENABLE_Disabled;
+  for (int ch = 0; ch < 4; ch++) {
+    PWM_DEV->PSEL.OUT[ch] = PWM_DISCONNECTED;
+  }
+  PWM_DEV->MODE = PWM_MODE_UPDOWN_Up;
+  PWM_DEV->DECODER = (PWM_DECODER_LOAD_Common << PWM_DECODER_LOAD_Pos) |
+                     (PWM_DECODER_MODE_RefreshCount << PWM_DECODER_MODE_Pos);
+  PWM_DEV->SHORTS = PWM_SHORTS_LOOPSDONE_STOP_Msk;
+  PWM_DEV->INTENSET = PWM_INTENSET_STOPPED_Msk;
+
+  NVIC_SetPriority(PWM_IRQ, 2);
+  NVIC_ClearPendingIRQ(PWM_IRQ);
+  NVIC_EnableIRQ(PWM_IRQ);
+}
+
+static int pwmStart(uint32_t prescaler, uint32_t top, uint32_t onTicks, uint32_t cycles,
+                    int pin, pwm_done_t done) {
+  if (cycles == 0) {
+    if (done) done();
+    return 1;
+  }
+  if (cycles > PWM_SEQ_REFRESH_CNT_Msk + 1) cycles = PWM_SEQ_REFRESH_CNT_Msk + 1;
+  if (onTicks > top) onTicks = top;
+
+  seq_on[0] = (uint16_t)onTicks | PWM_ACTIVE_HIGH;
+  seq_off[0] = 0 | PWM_ACTIVE_HIGH;
+
+  // GPIO takes the pin back when the PWM is disabled, park it LOW.
+  digitalWrite(pin, LOW);
+
+  busy = true;
+  done_cb = done;
+
+  PWM_DEV->PRESCALER = prescaler;
+  PWM_DEV->COUNTERTOP = top;
+  PWM_DEV->SEQ[0].PTR = (uint32_t)seq_on;
+  PWM_DEV->SEQ[0].CNT = 1;
+  PWM_DEV->SEQ[0].REFRESH = cycles - 1;
+  PWM_DEV->SEQ[0].ENDDELAY = 0;
+  PWM_DEV->SEQ[1].PTR = (uint32_t)seq_off;
+  PWM_DEV->SEQ[1].CNT = 1;
+  PWM_DEV->SEQ[1].REFRESH = 0;
+  PWM_DEV->SEQ[1].ENDDELAY = 0;
+  PWM_DEV->LOOP = 1;
+  PWM_DEV->PSEL.OUT[0] = gpioPin(pin);
+  PWM_DEV->EVENTS_STOPPED = 0;
+  PWM_DEV->ENABLE = PWM_ENABLE_ENABLE_Enabled;
+  PWM_DEV->TASKS_SEQSTART[0] = 1;
+  return 1;
+}
+
+int hwPWM(int durationMs, int PWM, int frequencyKhz, int pin, pwm_done_t done) {
+  if (busy || frequencyKhz <= 0) return 0;
+
+  uint32_t frequencyHz = frequencyKhz * 1000UL;
+  uint32_t cycles = durationMs > 0 ? durationMs * frequencyHz / 1000 : 0;
+
+  // Smallest prescaler that still fits the period in the 15 bit counter.
+  uint32_t prescaler = PWM_PRESCALER_PRESCALER_DIV_1;
+  while (prescaler < PWM_PRESCALER_PRESCALER_DIV_128 &&
+         (PWM_CLOCK_HZ >> prescaler) / frequencyHz > PWM_MAX_TOP) {
+    prescaler++;
+  }
+  uint32_t top = (PWM_CLOCK_HZ >> prescaler) / frequencyHz;
+  if (top > PWM_MAX_TOP) top = PWM_MAX_TOP;
+
+  if (PWM < 0) PWM = 0;
+  if (PWM > 255) PWM = 255;
+  return pwmStart(prescaler, top, top * PWM / 255, cycles, pin, done);
+}
+
+int hwPWMHiRes(int durationMs, uint16_t duty, uint16_t countertop, int pin, pwm_done_t done) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP) return 0;
+
+  if (duty > PWM_DUTY_FULL) duty = PWM_DUTY_FULL;
+  uint32_t onTicks = ((uint32_t)countertop * duty + PWM_DUTY_FULL / 2) / PWM_DUTY_FULL;
+  // Whole periods in the duration, computed in ticks to keep odd tops exact.
+  uint32_t cycles = durationMs > 0 ? (uint64_t)durationMs * (PWM_CLOCK_HZ / 1000) / countertop : 0;
+  return pwmStart(PWM_PRESCALER_PRESCALER_DIV_1, countertop, onTicks, cycles, pin, done);
+}
+
+int hwPWMTicks(uint32_t cycles, uint16_t onTicks, uint16_t countertop, int pin, pwm_done_t done) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP) return 0;
+  return pwmStart(PWM_PRESCALER_PRESCALER_DIV_1, countertop, onTicks, cycles, pin, done);
+}
+
+// Programs sequence n with the next chunk, or with a 0% period once the
+// waveform is exhausted (tail, and padding to a whole seq0/seq1 pair).
+static void streamLoad(int n) {
+  uint16_t *buf = stream_buf[n];
+  uint16_t count = 0;
+  uint32_t refresh = 0;
+  if (stream_chunks_left > 0) {
+    stream_chunks_left--;
+    count = stream_fill(buf, PWM_STREAM_VALUES, &refresh);
+  }
+  if (count == 0) {
+    buf[0] = 0;
+    count = 1;
+    refresh = 0;
+  }
+  stream_min[n] = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    if (buf[i] > 0 && (stream_min[n] == 0 || buf[i] < stream_min[n])) stream_min[n] = buf[i];
+    buf[i] |= PWM_ACTIVE_HIGH;
+  }
+  if (refresh > PWM_SEQ_REFRESH_CNT_Msk) refresh = PWM_SEQ_REFRESH_CNT_Msk;
+  PWM_DEV->SEQ[n].PTR = (uint32_t)buf;
+  PWM_DEV->SEQ[n].CNT = count;
+  PWM_DEV->SEQ[n].REFRESH = refresh;
+  PWM_DEV->SEQ[n].ENDDELAY = 0;
+  stream_seqs_left--;
+}
+
+// Sequence n begins to play.
+static void streamStarted(int n) {
+  if (stream_starts_left == 0) return;
+  stream_starts_left--;
+  if (stream_started) stream_started(stream_min[n]);
+}
+
+int hwPWMStream(uint32_t chunks, uint16_t countertop, int pin, pwm_fill_t fill, pwm_done_t done,
+                pwm_start_t started) {
+  if (busy || countertop < 3 || countertop > PWM_MAX_TOP || fill == 0) return 0;
+
+  // chunks + the 0% tail, rounded up to whole seq0 -> seq1 loops.
+  uint32_t loops = (chunks + 2) / 2;
+  if (loops > PWM_LOOP_CNT_Msk) return 0;
+
+  digitalWrite(pin, LOW);
+  busy = true;
+  done_cb = done;
+  stream_fill = fill;
+  stream_chunks_left = chunks;
+  stream_seqs_left = loops * 2;
+  stream_started = started;
+  stream_starts_left = chunks;
+
+  PWM_DEV->PRESCALER = PWM_PRESCALER_PRESCALER_DIV_1;
+  PWM_DEV->COUNTERTOP = countertop;
+  streamLoad(0);
+  streamLoad(1);
+  PWM_DEV->LOOP = loops;
+  PWM_DEV->PSEL.OUT[0] = gpioPin(pin);
+  PWM_DEV->EVENTS_STOPPED = 0;
+  PWM_DEV->EVENTS_SEQEND[0] = 0;
+  PWM_DEV->EVENTS_SEQEND[1] = 0;
+  PWM_DEV->INTENSET = PWM_INTENSET_SEQEND0_Msk | PWM_INTENSET_SEQEND1_Msk;
+  PWM_DEV->ENABLE = PWM_ENABLE_ENABLE_Enabled;
+  streamStarted(0);
+  PWM_DEV->TASKS_SEQSTART[0] = 1;
+  return 1;
+}
+
+bool hwPWMBusy() {
+  return busy;
+}
+
+void hwPWMWait() {
+  while (busy) {
+    __WFE(); // woken by the STOPPED interrupt
+  }
+}
+
+void hwPWMStop() {
+  if (busy) {
+    PWM_DEV->TASKS_STOP = 1;
+  }
+}
+
+extern "C" void PWM0_IRQHandler(void) {
+  PT_IRQ_ENTRY();
+  // SEQEND[n]: sequence n has been read out, refill it while the other plays.
+  for (int n = 0; n < 2; n++) {
+    if (PWM_DEV->EVENTS_SEQEND[n]) {
+      PWM_DEV->EVENTS_SEQEND[n] = 0;
+      streamStarted(n ^ 1); // playing since the SEQEND, LOOP goes on by itself
+      if (stream_seqs_left > 0) streamLoad(n);
+    }
+  }
+  if (PWM_DEV->EVENTS_STOPPED) {
+    PWM_DEV->EVENTS_STOPPED = 0;
+    PWM_DEV->INTENCLR = PWM_INTENCLR_SEQEND0_Msk | PWM_INTENCLR_SEQEND1_Msk;
+    stream_seqs_left = 0;
+    stream_fill = 0;
+    stream_starts_left = 0;
+    PWM_DEV->ENABLE = PWM_ENABLE_ENABLE_Disabled;
+    PWM_DEV->PSEL.OUT[0] = PWM_DISCONNECTED;
+    busy = false;
+    pwm_done_t cb = done_cb;
+    done_cb = 0;
+    if (cb) cb();
+  }
+}
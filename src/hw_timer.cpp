@@ -0,0 +1,92 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "hw_timer.h"
+#include "phase_timing.h"
+
+// TIMER0 belongs to the SoftDevice/core, RTC1 drives millis().
+#define TIMER_DEV NRF_TIMER1
+#define TIMER_IRQ TIMER1_IRQn
+#define TIMER_CC_EVENT 2 // captured by PPI, see hwTimerCaptureTask()
+#define TIMER_CC_NOW 3   // capture register used by hwTimerNowUs()
+
+static timer_cb_t callbacks[HW_TIMER_CHANNELS];
+static volatile uint8_t overdue = 0; // channels whose deadline had already passed
+
+// overdue is changed from loop() and from interrupts of any priority; the
+// read-modify-write must not be cut by one of them, or a bit set or cleared
+// in between is lost (a missed deadline that never fires).
+static void setOverdue(int ch, bool on) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (on) {
+    overdue |= 1 << ch;
+  } else {
+    overdue &= ~(1 << ch);
+  }
+  if (!primask) __enable_irq();
+}
+
+void hwTimerInit() {
+  TIMER_DEV->TASKS_STOP = 1;
+  TIMER_DEV->MODE = TIMER_MODE_MODE_Timer;
+  TIMER_DEV->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+  TIMER_DEV->PRESCALER = 4; // 16 MHz / 2^4 = 1 MHz
+  TIMER_DEV->SHORTS = 0;
+  TIMER_DEV->TASKS_CLEAR = 1;
+
+  NVIC_SetPriority(TIMER_IRQ, 2);
+  NVIC_ClearPendingIRQ(TIMER_IRQ);
+  NVIC_EnableIRQ(TIMER_IRQ);
+  TIMER_DEV->TASKS_START = 1;
+}
+
+// If an interrupt captures in between, we return its (slightly later)
+// capture, which is still a valid "now".
+uint32_t hwTimerNowUs() {
+  TIMER_DEV->TASKS_CAPTURE[TIMER_CC_NOW] = 1;
+  return TIMER_DEV->CC[TIMER_CC_NOW];
+}
+
+void hwTimerAt(int ch, uint32_t atUs, timer_cb_t cb) {
+  uint32_t msk = 1UL << (TIMER_INTENSET_COMPARE0_Pos + ch);
+  TIMER_DEV->INTENCLR = msk;
+  callbacks[ch] = cb;
+  TIMER_DEV->CC[ch] = atUs;
+  TIMER_DEV->EVENTS_COMPARE[ch] = 0;
+  TIMER_DEV->INTENSET = msk;
+  if ((int32_t)(atUs - hwTimerNowUs()) <= 0) {
+    setOverdue(ch, true);
+    NVIC_SetPendingIRQ(TIMER_IRQ);
+  }
+}
+
+void hwTimerCancel(int ch) {
+  TIMER_DEV->INTENCLR = 1UL << (TIMER_INTENSET_COMPARE0_Pos + ch);
+  TIMER_DEV->EVENTS_COMPARE[ch] = 0;
+  setOverdue(ch, false);
+  callbacks[ch] = 0;
+}
+
+uint32_t hwTimerCaptureTask() {
+  return (uint32_t)&TIMER_DEV->TASKS_CAPTURE[TIMER_CC_EVENT];
+}
+
+uint32_t hwTimerCapturedUs() {
+  return TIMER_DEV->CC[TIMER_CC_EVENT];
+}
+
+extern "C" void TIMER1_IRQHandler(void) {
+  PT_IRQ_ENTRY();
+  for (int ch = 0; ch < HW_TIMER_CHANNELS; ch++) {
+    uint32_t msk = 1UL << (TIMER_INTENSET_COMPARE0_Pos + ch);
+    if (!(TIMER_DEV->INTENSET & msk)) continue;
+    if (TIMER_DEV->EVENTS_COMPARE[ch] || (overdue & (1 << ch))) {
+      TIMER_DEV->EVENTS_COMPARE[ch] = 0;
+      TIMER_DEV->INTENCLR = msk;
+      setOverdue(ch, false);
+      timer_cb_t cb = callbacks[ch];
+      callbacks[ch] = 0;
+      if (cb) cb();
+    }
+  }
+}
@@ -0,0 +1,55 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "idle.h"
+#include "hw_timer.h"
+
+static volatile bool sleeping = false;
+static volatile uint32_t sleep_from;
+static volatile uint32_t slept_us;     // running total, wraps
+static uint32_t cycle_from;
+static uint32_t cycle_slept_from;
+static volatile uint32_t last_sleep_us;
+static volatile uint32_t last_cycle_us;
+
+// Any interrupt taken since the last WFE leaves the event register set, so
+// a wake-up condition raised after the caller's checks is never slept over.
+void idleSleep() {
+  sleep_from = hwTimerNowUs();
+  sleeping = true;
+  __WFE();
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  slept_us += hwTimerNowUs() - sleep_from;
+  sleeping = false;
+  if (!primask) __enable_irq();
+}
+
+void idleCycleMark() {
+  uint32_t now = hwTimerNowUs();
+  if (sleeping) {
+    // Credit the sleep in progress to the cycle that is closing.
+    slept_us += now - sleep_from;
+    sleep_from = now;
+  }
+  if (cycle_from != 0) {
+    last_sleep_us = slept_us - cycle_slept_from;
+    last_cycle_us = now - cycle_from;
+  }
+  cycle_from = now;
+  cycle_slept_from = slept_us;
+}
+
+void idleLastCycle(uint32_t *sleepUs, uint32_t *cycleUs) {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  *sleepUs = last_sleep_us;
+  *cycleUs = last_cycle_us;
+  if (!primask) __enable_irq();
+}
+
+uint16_t idleLastCyclePermille() {
+  uint32_t sleepUs, cycleUs;
+  idleLastCycle(&sleepUs, &cycleUs);
+  if (cycleUs == 0) return 0;
+  return (uint16_t)((uint64_t)sleepUs * 1000 / cycleUs);
+}
@@ -1,4 +1,18 @@
 #include <Arduino.h>
+#include "hw_pwm.h"
+#include "pins.h"
+#include "sequencer.h"
+#include "button.h"
+#include "idle.h"
+#include "current_sense.h"
+#include "telemetry.h"
+#include "control.h"
+#include "calib_search.h"
+#include "phase_timing.h"
+#include "flash_log.h"
+#include "profile_store.h"
+#include "target_store.h"
+#include "command.h"
 
 // const uint32_t g_ADigitalPinMap[] = {
 //   // D0 - D7
@@ -39,19 +53,25 @@
 // };
 
 
-#define MOTOR_PWM 21
-#define SOL_ON_EN 24
-#define SOL_DEG_EN 9
-#define SOL_DEG_PWM 8
-#define SOL_ON_PWM 20
-#define MOTOR_UI 4
-#define BUTTON 22
+#define LONG_PRESS_MS 1100 // button held this long toggles pump_mode
+#define DEBOUNCE_MS 10
+#define TELEMETRY_BAUD 115200
+#define TELEMETRY_DRAIN_MAX 8 // events per loop() pass
+#define CURRENT_TEL_BLOCKS 32 // current blocks per TEL_CURRENT summary
+#define DEBUG_CYCLES 11
 
 
 int pump_mode = 1; // 0 is swing, 1 is solo
 int debug_mode = 1;
-int Build_up_debug = 845;
-int PWM_debug = 70;
+int handoff_mode = 1; // 1: gap and solenoid release timed in hardware (PPI)
+int control_mode = 0; // 1: build-up regulated on motor current, ends on a charge target
+int calib_mode = 0;   // 1: a short press calibrates the stages of pump_mode that have a stored target
+int binary_log = 1;   // 1: telemetry as binlog.h frames, 0: CSV lines
+int sample_log = 0;   // 1: raw current blocks in the binary log, 2500/s (needs ~1 Mbaud)
+constexpr int Build_up_debug = 845;
+constexpr int PWM_debug = 70;
+static_assert(buildUpValid(Build_up_debug) && dutyValid(PWM_debug), "debug build-up/PWM out of range");
+constexpr StageSchedule debug_schedule = makeStageSchedule(Build_up_debug, PWM_debug);
 
 // int pump_mode = 0; // 0 is swing, 1 is solo
 // int debug_mode =0;
@@ -60,38 +80,90 @@ int PWM_debug = 70;
 // int PWM_debug = 0;
 
 //int Build_up_swing[18] = {210, 240, 274, 282, 304, 324, 340, 352, 334, 240, 318, 392, 478, 568, 658, 722, 822, 898}; // first 9 are Stimulation, Last 9 are Expression
-int Build_up_swing[18] = {200, 225, 242, 255, 265, 276, 300, 325, 350, 235, 305, 385, 490, 535, 600, 680, 760, 845}; // first 9 are Stimulation, Last 9 are Expression
-int PWM_swing[18] = {40, 46, 50, 56, 62, 68, 72, 78, 84, 36, 40, 46, 48, 54, 58, 62, 66, 70}; // first 9 are Stimulation, Last 9 are Expression
+constexpr PumpProfile swing_profile = {
+  {200, 225, 242, 255, 265, 276, 300, 325, 350, 235, 305, 385, 490, 535, 600, 680, 760, 845}, // Build_up_swing
+  {40, 46, 50, 56, 62, 68, 72, 78, 84, 36, 40, 46, 48, 54, 58, 62, 66, 70}                     // PWM_swing
+};
+static_assert(profileValid(swing_profile), "swing profile out of range");
+constexpr PumpSchedule swing_schedule = makeSchedule(swing_profile);
 
 //int Build_up_solo[18] = {196, 254, 254, 260, 314, 300, 379, 354, 340, 238, 332, 370, 456, 532, 592, 694, 800, 854}; // first 9 are Stimulation, Last 9 are Expression
-int Build_up_solo[18] = {250, 245, 254, 285, 290, 280, 320, 340, 360, 260, 392, 522, 682, 630, 725, 555, 710, 870}; // first 9 are Stimulation, Last 9 are Expression
-int PWM_solo[18] = {26, 30, 32, 34, 38, 40, 42, 44, 46, 26, 28, 30, 32, 36, 38, 40, 42, 46}; // first 9 are Stimulation, Last 9 are Expression
+constexpr PumpProfile solo_profile = {
+  {250, 245, 254, 285, 290, 280, 320, 340, 360, 260, 392, 522, 682, 630, 725, 555, 710, 870}, // Build_up_solo
+  {26, 30, 32, 34, 38, 40, 42, 44, 46, 26, 28, 30, 32, 36, 38, 40, 42, 46}                     // PWM_solo
+};
+static_assert(profileValid(solo_profile), "solo profile out of range");
+constexpr PumpSchedule solo_schedule = makeSchedule(solo_profile);
 
 
-// int Build_up_[18] = {};
-// int PWM_[18] = {};
-// int Build_up_[18] = {};
-// int PWM_[18] = {};
-// int Build_up_[18] = {};
+// constexpr PumpProfile _profile = {
+//   {},
+//   {}
+// };
+// static_assert(profileValid(_profile), "");
+// constexpr PumpSchedule _schedule = makeSchedule(_profile);
+
+// Defaults per pump_mode, a profile uploaded over serial replaces them
+// until the next reset (profile_store.h).
+constexpr PumpProfile default_profiles[PROFILE_MODES] = {swing_profile, solo_profile};
+constexpr PumpSchedule default_schedules[PROFILE_MODES] = {swing_schedule, solo_schedule};
+
+const PumpSchedule *schedule = &default_schedules[0];
+
+// Closed-loop charge targets per mode (0 swing, 1 solo), taught at run time
+// and cleared when a new profile of that mode is activated.
+uint32_t charge_target[2][PROFILE_STAGES];
 
-int *Build_up = Build_up_swing;
-int *PWM = PWM_swing;
+// Calibration run: build-up found per stage, printed as a PumpProfile block.
+// The targets come from target_store.h (set over the command protocol),
+// never from charge_target: a target taught from the profile itself would
+// only find the profile's own build-up again.
+CalibSearch calib_search;
+uint16_t calib_ms[PROFILE_STAGES];
+volatile int calib_stage = -1; // stage being calibrated, -1 when not running
+volatile bool calib_stage_done = false;
 
 // put function declarations here:
 int myFunction(int, int);
-int myPWM(int, int, int,int);
+void onButton(button_event_t event, uint32_t atUs);
+void startStage();
+void onCurrentBlock(const int16_t *block, uint16_t count);
+bool startCalibStage();
+void calibContinue();
+void onCalibStageDone();
+void printCalibTable();
+void onCycle(const SeqCycle &cycle);
+void onTextCommand(char c);
+void printFlashLog();
+
+int stage = 0;
+volatile bool start_pending = false; // set by the button, consumed by loop()
 
 
 void setup() {
   // put your setup code here, to run once:
+  Serial.begin(TELEMETRY_BAUD);
+  telemetrySetBinary(binary_log == 1);
 
   pinMode(MOTOR_PWM, OUTPUT);
-  pinMode(MOTOR_UI, OUTPUT);
+  // MOTOR_UI is an analog input now, owned by the SAADC (current_sense.cpp)
   pinMode(SOL_ON_EN, OUTPUT);
   // pinMode(SOL_DEG_EN, OUTPUT);
   // pinMode(SOL_DEG_PWM, OUTPUT);
   pinMode(SOL_ON_PWM, OUTPUT);
   pinMode(BUTTON, INPUT);
+  hwPWMInit();
+  seqInit();
+  seqSetHwHandoff(handoff_mode == 1);
+  seqSetCycleHook(onCycle);
+  flashLogInit();
+  targetStoreInit();
+  profileStoreInit(default_profiles, default_schedules);
+  cmdInit(onTextCommand);
+  seqWait(1010); // start-up delay(1000) + delay(10)
+  buttonInit(DEBOUNCE_MS, LONG_PRESS_MS, onButton);
+  currentInit(onCurrentBlock);
+  currentStart(CURRENT_SYNC, 0, CTRL_BLOCK_SAMPLES);
   // for (int i = 0; i < 22; i++) {
   //   pinMode(i, OUTPUT);
   // }
@@ -103,98 +175,225 @@ void setup() {
 
 void loop() {
   // put your main code here, to run repeatedly:
-  // digitalWrite(SOL_DEG_EN, LOW);
-  // digitalWrite(SOL_DEG_PWM, LOW);
-  delay(1000);
-  // digitalWrite(MOTOR_PWM, HIGH);
-  // digitalWrite(MOTOR_PWM, HIGH);
-  // digitalWrite(SOL_ON_EN, HIGH);
-  // digitalWrite(SOL_ON_PWM, HIGH);
-
-// PWM is 0-255, means 0 to 100% duty cycle, example 50 is 20% duty cycle (The formula is PWM/255 * 100%)
-// Durata is in ms, example 1000 is 1 second
-  int counter=0;
-  int j=0;
-  delay(10);
-  while(1){
-
-    if (debug_mode == 1) {
-        digitalWrite(SOL_ON_EN, HIGH);
-        for (int i = 0; i <= 10; i++) {
-        delay(100);
-        // analogWrite(MOTOR_PWM, (1.5/4*255)); // We need to apply 1.5V for 35ms
-
-        digitalWrite(SOL_ON_EN, LOW);
-        digitalWrite(SOL_ON_PWM, LOW);
-        // delay(35);
-        
-        myPWM(35, (1.5/4*255), 20, MOTOR_PWM);
-        myPWM(int((Build_up_debug-35)), PWM_debug*255/100, 20, MOTOR_PWM);
-        delay(50);
-        
-        digitalWrite(SOL_ON_EN, HIGH);
-        myPWM(400,60*255/100, 20, SOL_ON_PWM);
-        
-        digitalWrite(SOL_ON_EN, LOW);
-        digitalWrite(SOL_ON_PWM, LOW);
-        // digitalWrite(SOL_ON_EN, HIGH);
-        // digitalWrite(SOL_ON_PWM, HIGH);
-        // delay(200);
-        // digitalWrite(SOL_ON_EN, LOW);
-        // digitalWrite(SOL_ON_PWM, LOW);
-        }
-        debug_mode = 0;
-        digitalWrite(SOL_ON_EN, LOW);
-        digitalWrite(SOL_ON_PWM, LOW);
-
-    } else 
-    {
-    for(int i = 0; i <= 17; i += 1) {
-        while(digitalRead(BUTTON) == LOW) {
-          delay(10);
-        }
-        counter=0;
-        while(digitalRead(BUTTON) == HIGH) {
-          delay(100);
-          counter+=1;
-          if (counter > 10) {
-            if(pump_mode == 0) {
-              pump_mode = 1;
-            } else {
-              pump_mode = 0;
-            }
-            i=0;
-            break;
-          }
-        }
-
-        if (pump_mode == 0) {
-          Build_up = Build_up_swing;
-          PWM = PWM_swing;
-        } else {
-          Build_up = Build_up_solo;
-          PWM = PWM_solo;
-        }
-
-        delay(500);
-        // analogWrite(MOTOR_PWM, (1.5/4*255)); // We need to apply 1.5V for 35ms
-        digitalWrite(SOL_ON_EN, LOW);
-        digitalWrite(SOL_ON_PWM, LOW);
-        // delay(35);
-        for (int j = -120; j <= 120; j=j+40) {
-        myPWM(35, (1.5/4*255), 20, MOTOR_PWM);
-        myPWM(int((Build_up[i]-35)*(1+j/1000.0)), PWM[i]*255/100, 20, MOTOR_PWM);
-        delay(50);
-        digitalWrite(SOL_ON_EN, HIGH);
-        digitalWrite(SOL_ON_PWM, HIGH);
-        delay(300);
-        digitalWrite(SOL_ON_EN, LOW);
-        digitalWrite(SOL_ON_PWM, LOW);
-        }
-      } 
+  // The phases run from the PWM/TIMER1 interrupts (see sequencer.cpp),
+  // loop() only decides what to start next and sleeps in between.
+  if (telemetryDrain(TELEMETRY_DRAIN_MAX) > 0) {
+    return;
+  }
+  cmdPoll();
+  // Flash erases (85 ms) only while idle with nothing about to start.
+  bool starting = start_pending || calib_stage >= 0 || debug_mode == 1;
+  // New profiles take over between stage runs only.
+  if (!seqBusy() && calib_stage < 0) {
+    uint8_t changed = profileService();
+    for (uint8_t m = 0; m < PROFILE_MODES; m++) {
+      if (!(changed & (1 << m))) continue;
+      // Targets taught from the old build-ups would hold the new profile
+      // to the old one, teach them again.
+      memset(charge_target[m], 0, sizeof(charge_target[m]));
+      telemetryPush(TEL_PROFILE, m, 0, profileCrc(profileActive(m)));
     }
+    changed = targetStoreService(!starting);
+    for (uint8_t m = 0; m < PROFILE_MODES; m++) {
+      if (!(changed & (1 << m))) continue;
+      int set = 0;
+      for (int i = 0; i < PROFILE_STAGES; i++) set += targetStoreGet(m)[i] != 0;
+      telemetryPush(TEL_TARGETS, m, 0, set);
     }
   }
+  // Word writes are short enough for any phase.
+  flashLogService(!seqBusy() && !starting);
+  if (seqBusy()) {
+    idleSleep();
+    return;
+  }
+
+  if (debug_mode == 1) {
+    seqStartDebug(schedule, &debug_schedule, DEBUG_CYCLES);
+    debug_mode = 0;
+    return;
+  }
+
+  if (calib_stage_done) {
+    calib_stage_done = false;
+    calib_ms[calib_stage] = calib_search.bestMs;
+    calib_stage++;
+    calibContinue();
+    return;
+  }
+
+  if (start_pending) {
+    start_pending = false;
+    if (calib_mode == 1) {
+      calib_stage = 0;
+      calibContinue();
+    } else {
+      startStage();
+    }
+    return;
+  }
+  idleSleep();
+}
+
+// Runs in interrupt context. A short press starts the next stage when the
+// sequencer is idle (presses during a stage are ignored, as before). A long
+// press toggles pump_mode right away, even in the middle of a build-up, and
+// queues stage 0 of the new mode.
+void onButton(button_event_t event, uint32_t atUs) {
+  telemetryPush(TEL_BUTTON, event, 0, (int32_t)atUs);
+  if (calib_stage >= 0) {
+    return; // a calibration runs to the end of the table
+  }
+  if (event == BUTTON_LONG) {
+    pump_mode = pump_mode == 0 ? 1 : 0;
+    stage = 0;
+    start_pending = true;
+  } else if (!seqBusy()) {
+    start_pending = true;
+  }
+}
+
+// Runs in interrupt context: feeds the build-up control loop every block
+// and sends one summary event per CURRENT_TEL_BLOCKS blocks.
+void onCurrentBlock(const int16_t *block, uint16_t count) {
+  static int32_t sum = 0;
+  static int32_t samples = 0;
+  static int16_t peak = 0;
+  static uint16_t blocks = 0;
+
+  ctrlOnBlock(block, count);
+  if (sample_log == 1) {
+    telemetryPushSamples(block, count);
+  }
+
+  for (uint16_t i = 0; i < count; i++) {
+    sum += block[i];
+    if (block[i] > peak) peak = block[i];
+  }
+  samples += count;
+  if (++blocks < CURRENT_TEL_BLOCKS) {
+    return;
+  }
+  telemetryPush(TEL_CURRENT, 0, (uint16_t)peak, sum / samples);
+  sum = 0;
+  samples = 0;
+  peak = 0;
+  blocks = 0;
+}
+
+// Refuses (false) a stage without a stored target.
+bool startCalibStage() {
+  uint32_t target = targetStoreGet(pump_mode)[calib_stage];
+  if (target == 0) {
+    telemetryPush(TEL_NO_TARGET, pump_mode, calib_stage, 0);
+    return false;
+  }
+  schedule = profileSchedule(pump_mode);
+  calibBegin(calib_search, profileActive(pump_mode).buildUpMs[calib_stage], target);
+  telemetryPush(TEL_RUN, pump_mode, calib_stage, 2);
+  seqStartCalib(schedule, calib_stage, &calib_search, onCalibStageDone);
+  return true;
+}
+
+// Starts the next stage from calib_stage on that has a target, the ones
+// without keep their build-up. Prints the table after the last stage.
+void calibContinue() {
+  while (calib_stage < PROFILE_STAGES && !startCalibStage()) {
+    calib_ms[calib_stage] = profileActive(pump_mode).buildUpMs[calib_stage];
+    calib_stage++;
+  }
+  if (calib_stage >= PROFILE_STAGES) {
+    calib_stage = -1;
+    printCalibTable();
+  }
+}
+
+// Interrupt context, the next stage is started from loop().
+void onCalibStageDone() {
+  FlashLogRecord r = {FLASH_LOG_CALIB, (uint8_t)pump_mode, (uint8_t)calib_stage,
+                      calib_search.tries, calib_search.bestMs, calib_search.target, 0};
+  flashLogAppend(r);
+  calib_stage_done = true;
+}
+
+// Interrupt context: every stage drive goes to the flash log.
+void onCycle(const SeqCycle &cycle) {
+  FlashLogRecord r = {FLASH_LOG_CYCLE, (uint8_t)pump_mode, cycle.stage,
+                      (uint8_t)(cycle.sweep | cycle.closedLoop << 6 | cycle.reachedTarget << 7),
+                      cycle.buildUpCycles, cycle.charge, 0};
+  flashLogAppend(r);
+}
+
+// Single letter commands on the serial port (outside command frames):
+//   l  print the flash log (idle only)
+//   t  dump the timing histograms, r  clear them (-DPHASE_TIMING)
+void onTextCommand(char c) {
+  if (c == 'l' && !seqBusy()) printFlashLog();
+#ifdef PHASE_TIMING
+  if (c == 't') ptDump();
+  if (c == 'r') ptReset();
+#endif
+}
+
+// log,boot,kind,mode,stage,arg,value0,value1 - oldest first
+void printFlashLog() {
+  FlashLogRecord r;
+  for (uint32_t i = 0; i < flashLogCount(); i++) {
+    if (!flashLogRead(i, &r)) continue;
+    Serial.print("log,");
+    Serial.print((unsigned long)r.boot);
+    Serial.print(',');
+    Serial.print(r.kind);
+    Serial.print(',');
+    Serial.print(r.mode);
+    Serial.print(',');
+    Serial.print(r.stage);
+    Serial.print(',');
+    Serial.print(r.arg);
+    Serial.print(',');
+    Serial.print((unsigned long)r.value0);
+    Serial.print(',');
+    Serial.println((unsigned long)r.value1);
+  }
+}
+
+// Same format as the tables above, ready to paste back into this file.
+// One row of a PumpProfile block, returns the characters printed.
+static size_t printProfileRow(const uint16_t *v) {
+  size_t n = Serial.print("  {");
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    if (i > 0) n += Serial.print(", ");
+    n += Serial.print(v[i]);
+  }
+  return n + Serial.print("}");
+}
+
+// Same layout as profilePrintBlock() (host/profile_tables.cpp): the found
+// build-ups with the active duties, ready to paste over the profile.
+void printCalibTable() {
+  const char *name = pump_mode == 0 ? "swing" : "solo";
+  Serial.print("constexpr PumpProfile ");
+  Serial.print(name);
+  Serial.println("_profile = {");
+  size_t column = printProfileRow(calib_ms) + 2;
+  Serial.print(", // Build_up_");
+  Serial.println(name);
+  uint16_t duty[PROFILE_STAGES];
+  for (int i = 0; i < PROFILE_STAGES; i++) duty[i] = profileActive(pump_mode).dutyPct[i];
+  size_t n = printProfileRow(duty);
+  while (n++ < column) Serial.print(' ');
+  Serial.print(" // PWM_");
+  Serial.println(name);
+  Serial.println("};");
+}
+
+void startStage() {
+  schedule = profileSchedule(pump_mode);
+  seqSetClosedLoop(control_mode == 1 ? charge_target[pump_mode] : 0);
+  telemetryPush(TEL_RUN, pump_mode, stage, control_mode);
+  seqStartStage(schedule, stage);
+  stage = (stage + 1) % SEQ_STAGES;
+}
 
   // while(1){
   //     delay(1000);
@@ -231,18 +430,3 @@ void loop() {
   // for (int i = 0; i < 22; i++) {
   // digitalWrite(i, LOW);
   // }
-
-
-int myPWM(int durationMs, int PWM, int frequencyKhz,int pin) {
-  int periodUs = 1E3/frequencyKhz;
-  int onTime = periodUs * PWM / 255;
-  int offTime = periodUs - onTime;
-  int cycles = durationMs*1E3 / periodUs;
-  for (int i = 0; i < cycles; i++) {
-    digitalWrite(pin, HIGH);
-    nrf_delay_us(onTime);
-    digitalWrite(pin, LOW);
-    nrf_delay_us(offTime);
-  }
-  return 1;
-}
\ No newline at end of file
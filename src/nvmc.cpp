@@ -0,0 +1,30 @@
+#include <Arduino.h>
+#include <nrf.h>
+#include "nvmc.h"
+
+static void nvmcWait() {
+  while (NRF_NVMC->READY == NVMC_READY_READY_Busy) {
+  }
+}
+
+void nvmcErasePage(uint32_t pageAddr) {
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Een << NVMC_CONFIG_WEN_Pos;
+  nvmcWait();
+  NRF_NVMC->ERASEPAGE = pageAddr;
+  nvmcWait();
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+  nvmcWait();
+}
+
+void nvmcWriteWord(uint32_t addr, uint32_t value) {
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Wen << NVMC_CONFIG_WEN_Pos;
+  nvmcWait();
+  *(volatile uint32_t *)addr = value;
+  nvmcWait();
+  NRF_NVMC->CONFIG = NVMC_CONFIG_WEN_Ren << NVMC_CONFIG_WEN_Pos;
+  nvmcWait();
+}
+
+const uint32_t *nvmcPtr(uint32_t addr) {
+  return (const uint32_t *)addr;
+}
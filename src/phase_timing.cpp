@@ -0,0 +1,132 @@
+#ifdef PHASE_TIMING
+
+#include <Arduino.h>
+#include <nrf.h>
+#include "phase_timing.h"
+#include "hw_timer.h"
+
+struct PtHist {
+  uint32_t count;
+  int32_t min;
+  int32_t max;
+  int64_t sum;
+  uint16_t bins[PT_PHASE_BINS > PT_EDGE_BINS ? PT_PHASE_BINS : PT_EDGE_BINS];
+};
+
+// Indexed by seq_phase_t, then the drive split.
+static const char *const phase_names[PT_PHASES] = {
+  "idle", "wait", "stage_gap", "debug_gap", "drive", "gap", "sol_open", "sol_pwm", "kick", "build_up"
+};
+static const char *const edge_names[PT_EDGES] = {"drive_on", "sol_open", "sol_close"};
+
+static PtHist phases[PT_PHASES];
+static PtHist edges[PT_EDGES];
+static uint8_t open_id;
+static uint32_t open_nominal_us; // 0: nothing open
+static uint32_t open_from_us;
+
+volatile uint32_t pt_irq_entry;
+
+static void record(PtHist &h, int32_t value, int bin, int bins) {
+  if (bin < 0) bin = 0;
+  if (bin >= bins) bin = bins - 1;
+  if (h.count == 0 || value < h.min) h.min = value;
+  if (h.count == 0 || value > h.max) h.max = value;
+  h.count++;
+  h.sum += value;
+  if (h.bins[bin] < UINT16_MAX) h.bins[bin]++;
+}
+
+void ptInit() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  ptReset();
+}
+
+void ptPhase(uint8_t id, uint32_t nominalUs) {
+  uint32_t now = hwTimerNowUs();
+  if (open_nominal_us != 0) {
+    int32_t dev = (int32_t)(now - open_from_us - open_nominal_us);
+    // Bin 0 of the range sits at -PT_PHASE_BINS / 2 bins, floor division.
+    int32_t shifted = dev + PT_PHASE_BINS / 2 * PT_PHASE_BIN_US;
+    int bin = shifted >= 0 ? shifted / PT_PHASE_BIN_US : -1;
+    record(phases[open_id], dev, bin, PT_PHASE_BINS);
+  }
+  open_id = id < PT_PHASES ? id : 0;
+  open_nominal_us = id < PT_PHASES ? nominalUs : 0;
+  open_from_us = now;
+}
+
+void ptEdge(uint8_t edge) {
+  int32_t cycles = (int32_t)(DWT->CYCCNT - pt_irq_entry);
+  if (edge < PT_EDGES) {
+    record(edges[edge], cycles, cycles / PT_EDGE_BIN_CYCLES, PT_EDGE_BINS);
+  }
+}
+
+void ptReset() {
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  memset(phases, 0, sizeof(phases));
+  memset(edges, 0, sizeof(edges));
+  open_nominal_us = 0;
+  if (!primask) __enable_irq();
+}
+
+// Upper edge of the bin holding the 99th percentile, capped at max.
+static int32_t p99(const PtHist &h, int bins, int32_t first, int32_t width) {
+  uint32_t need = h.count - h.count / 100;
+  uint32_t seen = 0;
+  for (int i = 0; i < bins; i++) {
+    seen += h.bins[i];
+    if (seen >= need) {
+      int32_t edge = first + (i + 1) * width - 1;
+      return edge < h.max ? edge : h.max;
+    }
+  }
+  return h.max;
+}
+
+static void dumpOne(const char *kind, const char *name, const PtHist &h, int bins, int32_t first,
+                    int32_t width) {
+  Serial.print("pt,");
+  Serial.print(kind);
+  Serial.print(',');
+  Serial.print(name);
+  Serial.print(',');
+  Serial.print((unsigned long)h.count);
+  if (h.count > 0) {
+    Serial.print(',');
+    Serial.print((long)h.min);
+    Serial.print(',');
+    Serial.print((long)h.max);
+    Serial.print(',');
+    Serial.print((long)(h.sum / (int64_t)h.count));
+    Serial.print(',');
+    Serial.print((long)p99(h, bins, first, width));
+  }
+  Serial.println();
+}
+
+// pt,phase,<name>,count,min,max,mean,p99 (us off nominal)
+// pt,edge,<name>,count,min,max,mean,p99  (cycles)
+void ptDump() {
+  static PtHist copy;
+  uint32_t primask = __get_PRIMASK();
+  for (int i = 0; i < PT_PHASES; i++) {
+    __disable_irq();
+    copy = phases[i];
+    if (!primask) __enable_irq();
+    dumpOne("phase", phase_names[i], copy, PT_PHASE_BINS,
+            -PT_PHASE_BINS / 2 * PT_PHASE_BIN_US, PT_PHASE_BIN_US);
+  }
+  for (int i = 0; i < PT_EDGES; i++) {
+    __disable_irq();
+    copy = edges[i];
+    if (!primask) __enable_irq();
+    dumpOne("edge", edge_names[i], copy, PT_EDGE_BINS, 0, PT_EDGE_BIN_CYCLES);
+  }
+}
+
+#endif
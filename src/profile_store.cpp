@@ -0,0 +1,85 @@
+#include "profile_store.h"
+#include "binlog.h"
+
+static const PumpProfile *defaults;
+static const PumpSchedule *default_schedules;
+
+static PumpProfile staged[PROFILE_MODES];
+static bool staged_ok[PROFILE_MODES];
+static bool activate_pending[PROFILE_MODES];
+
+static PumpProfile uploaded[PROFILE_MODES];
+static PumpSchedule uploaded_schedules[PROFILE_MODES];
+static profile_source_t source[PROFILE_MODES];
+
+void profileStoreInit(const PumpProfile *defaultProfiles, const PumpSchedule *defaultSchedules) {
+  defaults = defaultProfiles;
+  default_schedules = defaultSchedules;
+  for (int m = 0; m < PROFILE_MODES; m++) {
+    staged_ok[m] = false;
+    activate_pending[m] = false;
+    source[m] = PROFILE_FLASH;
+  }
+}
+
+int profileStage(uint8_t mode, const PumpProfile &p) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    if (!buildUpValid(p.buildUpMs[i]) || !dutyValid(p.dutyPct[i])) return i;
+  }
+  staged[mode] = p;
+  staged_ok[mode] = true;
+  activate_pending[mode] = false;
+  return -1;
+}
+
+bool profileActivate(uint8_t mode, uint16_t crc) {
+  if (!staged_ok[mode] || profileCrc(staged[mode]) != crc) return false;
+  activate_pending[mode] = true;
+  return true;
+}
+
+uint8_t profileService() {
+  uint8_t changed = 0;
+  for (int m = 0; m < PROFILE_MODES; m++) {
+    if (!activate_pending[m]) continue;
+    uploaded[m] = staged[m];
+    uploaded_schedules[m] = makeSchedule(uploaded[m]);
+    source[m] = PROFILE_UPLOADED;
+    activate_pending[m] = false;
+    changed |= 1 << m;
+  }
+  return changed;
+}
+
+const PumpProfile &profileActive(uint8_t mode) {
+  return source[mode] == PROFILE_UPLOADED ? uploaded[mode] : defaults[mode];
+}
+
+const PumpSchedule *profileSchedule(uint8_t mode) {
+  return source[mode] == PROFILE_UPLOADED ? &uploaded_schedules[mode] : &default_schedules[mode];
+}
+
+profile_source_t profileSource(uint8_t mode) {
+  return source[mode];
+}
+
+void profileSerialize(const PumpProfile &p, uint8_t *out) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    out[2 * i] = (uint8_t)p.buildUpMs[i];
+    out[2 * i + 1] = (uint8_t)(p.buildUpMs[i] >> 8);
+    out[2 * PROFILE_STAGES + i] = p.dutyPct[i];
+  }
+}
+
+void profileDeserialize(const uint8_t *in, PumpProfile *p) {
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    p->buildUpMs[i] = (uint16_t)(in[2 * i] | in[2 * i + 1] << 8);
+    p->dutyPct[i] = in[2 * PROFILE_STAGES + i];
+  }
+}
+
+uint16_t profileCrc(const PumpProfile &p) {
+  uint8_t wire[PROFILE_WIRE_SIZE];
+  profileSerialize(p, wire);
+  return binlogCrc16(wire, sizeof(wire));
+}
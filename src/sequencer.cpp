@@ -0,0 +1,332 @@
+#include <Arduino.h>
+#include "sequencer.h"
+#include "hw_timer.h"
+#include "handoff.h"
+#include "idle.h"
+#include "waveform.h"
+#include "current_sense.h"
+#include "telemetry.h"
+#include "control.h"
+#include "calib_search.h"
+#include "phase_timing.h"
+#include "pins.h"
+
+static volatile seq_phase_t phase = SEQ_IDLE;
+
+static const PumpSchedule *cur_schedule; // the kick comes from here
+static const StageSchedule *cur_stage;   // stage being run, or the debug entry
+static uint8_t cur_stage_index;
+static int sweep;                       // index into buildUpCycles[], try in calib runs
+static bool debug_run;
+static int debug_left;
+static uint32_t deadline;     // absolute end of the current timed phase, us
+static bool hw_handoff = false;
+static const WaveSegment *custom_drive = 0;
+static uint8_t custom_drive_count = 0;
+static WaveSegment drive[2];  // default kick + build-up
+static uint32_t *charge_targets = 0; // closed loop per stage, 0 entries are taught
+static bool kick_sent;
+static uint32_t build_up_cycles;     // of the running drive
+static uint32_t drive_chunks;        // started so far
+static CalibSearch *calib = 0;       // calibration run, build-up from the search
+static seq_done_t calib_done = 0;
+static seq_cycle_t cycle_hook = 0;
+
+static void onTimer();
+static void onPwmDone();
+static void onHandoffDone();
+
+static const uint16_t debug_sol_ticks = dutyToTicks(SEQ_DEBUG_SOL_DUTY);
+static const uint32_t debug_sol_cycles = msToCycles(SEQ_DEBUG_SOL_MS);
+
+#ifdef PHASE_TIMING
+static uint32_t periodsToUs(uint32_t periods) {
+  return (uint32_t)((uint64_t)periods * PWM_TOP / (PWM_HIRES_CLOCK_HZ / 1000000));
+}
+
+// Nominal length of each phase, 0 for the ones that are not timed.
+static uint32_t nominalUs(seq_phase_t p) {
+  switch (p) {
+    case SEQ_STAGE_GAP:
+      return SEQ_STAGE_GAP_MS * 1000UL;
+    case SEQ_DEBUG_GAP:
+      return SEQ_DEBUG_GAP_MS * 1000UL;
+    case SEQ_DRIVE:
+      // A schedule drive is timed as PT_PHASE_KICK and PT_PHASE_BUILD_UP.
+      return custom_drive ? periodsToUs(waveCycles(custom_drive, custom_drive_count)) : 0;
+    case SEQ_GAP:
+      // With the hardware hand-off the solenoid phase is not seen in software.
+      return (hw_handoff && !debug_run ? SEQ_GAP_MS + SEQ_SOL_OPEN_MS : SEQ_GAP_MS) * 1000UL;
+    case SEQ_SOL_OPEN:
+      return SEQ_SOL_OPEN_MS * 1000UL;
+    case SEQ_SOL_PWM:
+      return periodsToUs(debug_sol_cycles);
+    default:
+      return 0;
+  }
+}
+#endif
+
+static void setPhase(seq_phase_t next) {
+  PT_PHASE(next, nominalUs(next));
+  phase = next;
+  telemetryPush(TEL_PHASE, next, (uint16_t)((cur_stage_index << 8) | sweep), 0);
+}
+
+static void waitUntil(seq_phase_t next, uint32_t atUs) {
+  setPhase(next);
+  deadline = atUs;
+  hwTimerAt(TIMER_CH_SEQ, atUs, onTimer);
+}
+
+// Closed loop drive: the kick as one held value, then the build-up in
+// CTRL_CHUNK_CYCLES chunks at whatever duty the control loop asks for.
+static_assert(CTRL_CHUNK_CYCLES >= WAVE_FLAT_MIN, "control chunks shorter than the refill time");
+static uint16_t closedLoopFill(uint16_t *buf, uint16_t max, uint32_t *refresh) {
+  (void)max;
+  if (!kick_sent) {
+    kick_sent = true;
+    buf[0] = cur_schedule->kickTicks;
+    *refresh = cur_schedule->kickCycles - 1;
+  } else {
+    buf[0] = ctrlDuty();
+    *refresh = CTRL_CHUNK_CYCLES - 1;
+  }
+  return 1;
+}
+
+static void onChargeTarget() {
+  hwPWMStop();
+}
+
+static void beginControl() {
+  CtrlConfig c;
+  uint32_t target = charge_targets && !debug_run && !calib ? charge_targets[cur_stage_index] : 0;
+  // The taught target is the j = 0 charge, the sweep steps keep their offset.
+  target = (uint32_t)((uint64_t)target * (uint32_t)(1000 + sweepOffset(sweep)) / 1000);
+  c.closedLoop = target != 0;
+  c.targetCharge = target;
+  c.nominalCycles = cur_schedule->kickCycles + build_up_cycles;
+  c.kickCycles = cur_schedule->kickCycles;
+  c.startTicks = cur_stage->dutyTicks;
+  c.minTicks = 0;
+  c.maxTicks = dutyToTicks(DUTY_PCT(PROFILE_DUTY_MAX));
+  currentRealign(); // the first block of this drive starts with its first period
+  ctrlBegin(c, onChargeTarget);
+}
+
+// Current is sampled in the middle of the shortest on-time of each chunk, so
+// it follows the kick, a ramp or the duty the control loop picks.
+static void onChunkStart(uint16_t minTicks) {
+  if (minTicks > 0) currentSetDelay(minTicks / 2);
+  // The kick is one flat chunk, the second one starts the build-up.
+  if (++drive_chunks == 2 && !custom_drive) {
+    PT_PHASE(PT_PHASE_BUILD_UP, ctrlClosedLoop() ? 0 : periodsToUs(build_up_cycles));
+  }
+}
+
+// Kick and build-up play back to back as one waveform, no gap in between.
+static void startDrive() {
+  idleCycleMark();
+  telemetryPush(TEL_IDLE, 0, 0, idleLastCyclePermille());
+  SolOn::low();
+  build_up_cycles = calib ? buildUpCycles(calib->nextMs, 0) : cur_stage->buildUpCycles[sweep];
+  setPhase(SEQ_DRIVE);
+  drive_chunks = 0;
+  if (hw_handoff && !debug_run) {
+    handoffArm(SEQ_GAP_MS * 1000UL, SEQ_SOL_OPEN_MS * 1000UL, onHandoffDone);
+  }
+  if (custom_drive) {
+    wavePlay(custom_drive, custom_drive_count, PWM_TOP, MOTOR_PWM, onPwmDone, onChunkStart);
+    PT_EDGE(PT_EDGE_DRIVE_ON);
+    return;
+  }
+  beginControl();
+  PT_PHASE(PT_PHASE_KICK, periodsToUs(cur_schedule->kickCycles));
+  if (ctrlClosedLoop()) {
+    uint32_t max_cycles = build_up_cycles * CTRL_TIMEOUT_PCT / 100;
+    kick_sent = false;
+    hwPWMStream(1 + (max_cycles + CTRL_CHUNK_CYCLES - 1) / CTRL_CHUNK_CYCLES, PWM_TOP, MOTOR_PWM,
+                closedLoopFill, onPwmDone, onChunkStart);
+    PT_EDGE(PT_EDGE_DRIVE_ON);
+    return;
+  }
+  drive[0].cycles = cur_schedule->kickCycles;
+  drive[0].fromTicks = drive[0].toTicks = cur_schedule->kickTicks;
+  drive[1].cycles = build_up_cycles;
+  drive[1].fromTicks = drive[1].toTicks = cur_stage->dutyTicks;
+  wavePlay(drive, 2, PWM_TOP, MOTOR_PWM, onPwmDone, onChunkStart);
+  PT_EDGE(PT_EDGE_DRIVE_ON);
+}
+
+static void finish() {
+  SolOn::low();
+  seq_done_t done = calib ? calib_done : 0;
+  calib = 0;
+  setPhase(SEQ_IDLE);
+  if (done) done();
+}
+
+static void nextSweep() {
+  if (calib) {
+    if (!calib->done) {
+      sweep++;
+      startDrive();
+    } else {
+      finish();
+    }
+  } else if (++sweep < SEQ_SWEEPS) {
+    startDrive();
+  } else {
+    finish();
+  }
+}
+
+// Hardware hand-off: TIMER2 has run the gap and the solenoid open time.
+static void onHandoffDone() {
+  nextSweep();
+}
+
+static void onPwmDone() {
+  switch (phase) {
+    case SEQ_DRIVE:
+      ctrlEnd();
+      telemetryPush(TEL_DRIVE, ctrlReachedTarget(), 0, (int32_t)ctrlCharge());
+      if (cycle_hook && !debug_run) {
+        SeqCycle c;
+        c.stage = cur_stage_index;
+        c.sweep = sweep;
+        c.closedLoop = ctrlClosedLoop();
+        c.reachedTarget = ctrlReachedTarget();
+        c.buildUpCycles = build_up_cycles;
+        c.charge = ctrlCharge();
+        cycle_hook(c);
+      }
+      if (calib) {
+        calibUpdate(*calib, ctrlCharge());
+      }
+      // Teach: the open-loop j = 0 run sets the target of its stage.
+      if (charge_targets && !debug_run && !calib && !ctrlClosedLoop() && sweep == SEQ_SWEEP_CENTER &&
+          charge_targets[cur_stage_index] == 0) {
+        charge_targets[cur_stage_index] = ctrlCharge();
+      }
+      if (hw_handoff && !debug_run) {
+        setPhase(SEQ_GAP); // gap and solenoid run in hardware, see handoff.cpp
+        break;
+      }
+      waitUntil(SEQ_GAP, hwTimerNowUs() + SEQ_GAP_MS * 1000UL);
+      break;
+    case SEQ_SOL_PWM:
+      SolOn::low();
+      PT_EDGE(PT_EDGE_SOL_CLOSE);
+      if (--debug_left > 0) {
+        waitUntil(SEQ_DEBUG_GAP, hwTimerNowUs() + SEQ_DEBUG_GAP_MS * 1000UL);
+      } else {
+        finish();
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+static void onTimer() {
+  switch (phase) {
+    case SEQ_WAIT:
+      setPhase(SEQ_IDLE);
+      break;
+    case SEQ_STAGE_GAP:
+      sweep = 0;
+      startDrive();
+      break;
+    case SEQ_DEBUG_GAP:
+      startDrive();
+      break;
+    case SEQ_GAP:
+      if (debug_run) {
+        setPhase(SEQ_SOL_PWM);
+        SolOnEn::high();
+        hwPWMTicks(debug_sol_cycles, debug_sol_ticks, PWM_TOP, SOL_ON_PWM, onPwmDone);
+        PT_EDGE(PT_EDGE_SOL_OPEN);
+      } else {
+        SolOn::high();
+        PT_EDGE(PT_EDGE_SOL_OPEN);
+        waitUntil(SEQ_SOL_OPEN, deadline + SEQ_SOL_OPEN_MS * 1000UL);
+      }
+      break;
+    case SEQ_SOL_OPEN:
+      SolOn::low();
+      PT_EDGE(PT_EDGE_SOL_CLOSE);
+      nextSweep();
+      break;
+    default:
+      break;
+  }
+}
+
+void seqInit() {
+  hwTimerInit();
+  PT_INIT();
+  handoffInit();
+  phase = SEQ_IDLE;
+}
+
+void seqSetHwHandoff(bool on) {
+  hw_handoff = on;
+}
+
+void seqSetDrive(const WaveSegment *segs, uint8_t count) {
+  custom_drive = count > 0 ? segs : 0;
+  custom_drive_count = count;
+}
+
+void seqSetClosedLoop(uint32_t *targets) {
+  charge_targets = targets;
+}
+
+void seqSetCycleHook(seq_cycle_t hook) {
+  cycle_hook = hook;
+}
+
+void seqWait(uint32_t ms) {
+  waitUntil(SEQ_WAIT, hwTimerNowUs() + ms * 1000UL);
+}
+
+void seqStartStage(const PumpSchedule *schedule, int stage) {
+  cur_schedule = schedule;
+  cur_stage = &schedule->stage[stage];
+  cur_stage_index = stage;
+  debug_run = false;
+  calib = 0;
+  waitUntil(SEQ_STAGE_GAP, hwTimerNowUs() + SEQ_STAGE_GAP_MS * 1000UL);
+}
+
+void seqStartCalib(const PumpSchedule *schedule, int stage, CalibSearch *search, seq_done_t done) {
+  cur_schedule = schedule;
+  cur_stage = &schedule->stage[stage];
+  cur_stage_index = stage;
+  debug_run = false;
+  calib = search;
+  calib_done = done;
+  waitUntil(SEQ_STAGE_GAP, hwTimerNowUs() + SEQ_STAGE_GAP_MS * 1000UL);
+}
+
+void seqStartDebug(const PumpSchedule *schedule, const StageSchedule *debug, int cycles) {
+  cur_schedule = schedule;
+  cur_stage = debug;
+  cur_stage_index = 0xFF; // debug run
+  calib = 0;
+  sweep = SEQ_SWEEP_CENTER;
+  debug_left = cycles;
+  debug_run = true;
+  SolOnEn::high();
+  waitUntil(SEQ_DEBUG_GAP, hwTimerNowUs() + SEQ_DEBUG_GAP_MS * 1000UL);
+}
+
+bool seqBusy() {
+  return phase != SEQ_IDLE;
+}
+
+seq_phase_t seqPhase() {
+  return phase;
+}
@@ -0,0 +1,126 @@
+#include <string.h>
+#include "target_store.h"
+#include "nvmc.h"
+
+#define ERASED 0xFFFFFFFFUL
+
+static uint32_t targets[PROFILE_MODES][PROFILE_STAGES];
+static uint32_t staged[PROFILE_MODES][PROFILE_STAGES];
+static bool pending[PROFILE_MODES];
+static uint8_t cur_page;   // page in use
+static uint32_t cur_seq;   // its sequence number, 0 when neither page is valid
+static uint16_t head_slot; // first free record, TARGET_STORE_SLOTS when full
+
+static uint32_t pageAddr(uint8_t page) {
+  return TARGET_STORE_ADDR + (uint32_t)page * NVMC_PAGE_SIZE;
+}
+
+static uint32_t slotAddr(uint8_t page, uint16_t slot) {
+  return pageAddr(page) + (TARGET_PAGE_HEADER_WORDS + (uint32_t)slot * TARGET_RECORD_WORDS) * 4;
+}
+
+static bool pageValid(uint8_t page) {
+  const uint32_t *h = nvmcPtr(pageAddr(page));
+  return h[0] == TARGET_PAGE_MAGIC && h[1] != ERASED;
+}
+
+static bool pageErased(uint8_t page) {
+  const uint32_t *w = nvmcPtr(pageAddr(page));
+  for (uint32_t i = 0; i < NVMC_PAGE_WORDS; i++) {
+    if (w[i] != ERASED) return false;
+  }
+  return true;
+}
+
+static bool slotErased(uint8_t page, uint16_t slot) {
+  const uint32_t *w = nvmcPtr(slotAddr(page, slot));
+  for (int i = 0; i < TARGET_RECORD_WORDS; i++) {
+    if (w[i] != ERASED) return false;
+  }
+  return true;
+}
+
+// Targets first, the header commits the record.
+static void writeRecord(uint8_t page, uint8_t mode, const uint32_t *t) {
+  uint32_t addr = slotAddr(page, head_slot++);
+  for (int i = 0; i < PROFILE_STAGES; i++) {
+    nvmcWriteWord(addr + 4 + i * 4, t[i]);
+  }
+  nvmcWriteWord(addr, TARGET_STORE_MAGIC | mode);
+}
+
+// No erase is needed for the first page on a blank store.
+static bool compactErases() {
+  return cur_seq != 0 || !pageErased(cur_page ^ 1);
+}
+
+// Every table into the other page, committed by its header before the
+// old page goes: a power loss before the header keeps the old page.
+static void compact() {
+  uint8_t next = cur_page ^ 1;
+  if (!pageErased(next)) nvmcErasePage(pageAddr(next)); // cut short copy
+  head_slot = 0;
+  for (int k = 0; k < PROFILE_MODES; k++) writeRecord(next, (uint8_t)k, targets[k]);
+  nvmcWriteWord(pageAddr(next) + 4, cur_seq + 1);
+  nvmcWriteWord(pageAddr(next), TARGET_PAGE_MAGIC);
+  if (cur_seq != 0) nvmcErasePage(pageAddr(cur_page));
+  cur_page = next;
+  cur_seq++;
+}
+
+void targetStoreInit() {
+  memset(targets, 0, sizeof(targets));
+  for (int m = 0; m < PROFILE_MODES; m++) pending[m] = false;
+  // The valid page with the higher sequence, the other one is left over
+  // from a compaction cut before its erase.
+  cur_page = 1;
+  cur_seq = 0;
+  for (uint8_t p = 0; p < TARGET_STORE_PAGES; p++) {
+    uint32_t seq = nvmcPtr(pageAddr(p))[1];
+    if (pageValid(p) && seq > cur_seq) {
+      cur_page = p;
+      cur_seq = seq;
+    }
+  }
+  // None yet: the first table compacts into page 0.
+  head_slot = TARGET_STORE_SLOTS;
+  if (cur_seq == 0) return;
+  // Records fill in order; a slot with an erased header but written
+  // targets was cut by a power loss and stays unused.
+  for (uint16_t slot = 0; slot < TARGET_STORE_SLOTS; slot++) {
+    const uint32_t *w = nvmcPtr(slotAddr(cur_page, slot));
+    if ((w[0] & 0xFFFFFF00UL) == TARGET_STORE_MAGIC && (w[0] & 0xFF) < PROFILE_MODES) {
+      memcpy(targets[w[0] & 0xFF], w + 1, sizeof(targets[0]));
+    } else if (slotErased(cur_page, slot)) {
+      head_slot = slot;
+      break;
+    }
+  }
+}
+
+void targetStoreSet(uint8_t mode, const uint32_t *t) {
+  memcpy(staged[mode], t, sizeof(staged[mode]));
+  pending[mode] = true;
+}
+
+uint8_t targetStoreService(bool mayErase) {
+  uint8_t changed = 0;
+  for (int m = 0; m < PROFILE_MODES; m++) {
+    if (!pending[m]) continue;
+    bool full = head_slot >= TARGET_STORE_SLOTS;
+    if (full && !mayErase && compactErases()) break;
+    memcpy(targets[m], staged[m], sizeof(targets[m]));
+    pending[m] = false;
+    if (full) {
+      compact(); // the new table goes with the others
+    } else {
+      writeRecord(cur_page, (uint8_t)m, targets[m]);
+    }
+    changed |= 1 << m;
+  }
+  return changed;
+}
+
+const uint32_t *targetStoreGet(uint8_t mode) {
+  return targets[mode];
+}
@@ -0,0 +1,132 @@
+#include <Arduino.h>
+#include "telemetry.h"
+#include "spsc_ring.h"
+#include "hw_timer.h"
+#include "binlog.h"
+
+static SpscRing<TelemetryEvent, TELEMETRY_ISR_EVENTS> isr_ring;
+static SpscRing<TelemetryEvent, TELEMETRY_THREAD_EVENTS> thread_ring;
+static SpscRing<TelemetrySamples, TELEMETRY_SAMPLE_BLOCKS> sample_ring;
+static uint32_t reported_dropped = 0;
+static volatile bool binary = false;
+
+static bool inInterrupt() {
+#if defined(NRF52) || defined(NRF52_SERIES)
+  return __get_IPSR() != 0;
+#else
+  return false;
+#endif
+}
+
+bool telemetryPush(uint8_t type, uint8_t a, uint16_t b, int32_t value) {
+  TelemetryEvent ev;
+  ev.timeUs = hwTimerNowUs();
+  ev.type = type;
+  ev.a = a;
+  ev.b = b;
+  ev.value = value;
+  return inInterrupt() ? isr_ring.push(ev) : thread_ring.push(ev);
+}
+
+bool telemetryPushSamples(const int16_t *samples, uint8_t count) {
+  if (!binary) return false;
+  TelemetrySamples block;
+  block.timeUs = hwTimerNowUs();
+  block.count = count > TEL_SAMPLES_MAX ? TEL_SAMPLES_MAX : count;
+  for (uint8_t i = 0; i < block.count; i++) {
+    block.samples[i] = samples[i];
+  }
+  return sample_ring.push(block);
+}
+
+void telemetrySetBinary(bool on) {
+  binary = on;
+}
+
+uint32_t telemetryDropped() {
+  return isr_ring.dropped() + thread_ring.dropped() + sample_ring.dropped();
+}
+
+static void writeEvent(const TelemetryEvent &ev) {
+  Serial.print((unsigned long)ev.timeUs); // wraps at 2^32 like TIMER1, not at 2^31
+  Serial.print(",");
+  Serial.print((long)ev.type);
+  Serial.print(",");
+  Serial.print((long)ev.a);
+  Serial.print(",");
+  Serial.print((long)ev.b);
+  Serial.print(",");
+  Serial.println((long)ev.value);
+}
+
+static BinlogWriter frame_w;
+static uint8_t frame[BINLOG_FRAME_MAX];
+
+static void sendFrame() {
+  Serial.write(frame, binlogFinish(frame_w, frame));
+  binlogBegin(frame_w);
+}
+
+// A record that does not fit goes into the next frame, which it always
+// fits; the full one is sent first.
+static void addEvent(const TelemetryEvent &ev) {
+  if (binlogEvent(frame_w, ev)) return;
+  sendFrame();
+  binlogEvent(frame_w, ev);
+}
+
+static void addSamples(const TelemetrySamples &block) {
+  if (binlogSamples(frame_w, block.timeUs, block.samples, block.count)) return;
+  sendFrame();
+  binlogSamples(frame_w, block.timeUs, block.samples, block.count);
+}
+
+// At most maxEvents records (a frame holds BINLOG_FRAME_RECORDS of any
+// kind), events first, then sample blocks.
+static int drainBinary(int maxEvents) {
+  binlogBegin(frame_w);
+  int n = 0;
+  TelemetryEvent ev;
+  TelemetrySamples block;
+  while (n < maxEvents && (isr_ring.pop(ev) || thread_ring.pop(ev))) {
+    addEvent(ev);
+    n++;
+  }
+  while (n < maxEvents && sample_ring.pop(block)) {
+    addSamples(block);
+    n++;
+  }
+  uint32_t dropped = telemetryDropped();
+  if (dropped != reported_dropped) {
+    reported_dropped = dropped;
+    ev.timeUs = hwTimerNowUs();
+    ev.type = TEL_DROPPED;
+    ev.a = 0;
+    ev.b = 0;
+    ev.value = (int32_t)dropped;
+    addEvent(ev);
+  } else if (n == 0) {
+    return 0;
+  }
+  sendFrame();
+  return n;
+}
+
+int telemetryDrain(int maxEvents) {
+  if (binary) {
+    return drainBinary(maxEvents);
+  }
+  int n = 0;
+  TelemetryEvent ev;
+  while (n < maxEvents && (isr_ring.pop(ev) || thread_ring.pop(ev))) {
+    writeEvent(ev);
+    n++;
+  }
+  uint32_t dropped = telemetryDropped();
+  if (dropped != reported_dropped) {
+    reported_dropped = dropped;
+    Serial.print("dropped,");
+    Serial.println((long)dropped);
+  }
+  return n;
+}
@@ -0,0 +1,96 @@
+#include "waveform.h"
+
+static WaveCursor play_cursor;
+
+static uint16_t segValue(const WaveSegment &s, uint32_t pos) {
+  int32_t span = (int32_t)s.toTicks - (int32_t)s.fromTicks;
+  if (span == 0 || s.cycles <= 1) return s.fromTicks;
+  return (uint16_t)(s.fromTicks + (int64_t)span * pos / (s.cycles - 1));
+}
+
+static bool atEnd(const WaveCursor *c) {
+  return c->seg >= c->count;
+}
+
+// Skips finished and empty segments.
+static void settle(WaveCursor *c) {
+  while (!atEnd(c) && c->pos >= c->segs[c->seg].cycles) {
+    c->seg++;
+    c->pos = 0;
+  }
+}
+
+static uint32_t flatRun(const WaveCursor *c) {
+  const WaveSegment &s = c->segs[c->seg];
+  if (s.fromTicks != s.toTicks) return 0;
+  uint32_t left = s.cycles - c->pos;
+  return left >= WAVE_FLAT_MIN ? left : 0;
+}
+
+void waveRewind(WaveCursor *c, const WaveSegment *segs, uint8_t count) {
+  c->segs = segs;
+  c->count = count;
+  c->seg = 0;
+  c->pos = 0;
+  settle(c);
+}
+
+uint16_t waveNextChunk(WaveCursor *c, uint16_t *buf, uint16_t max, uint32_t *refresh) {
+  *refresh = 0;
+  if (atEnd(c) || max == 0) return 0;
+
+  uint32_t run = flatRun(c);
+  if (run > 0) {
+    if (run > PWM_SEQ_REFRESH_MAX + 1) run = PWM_SEQ_REFRESH_MAX + 1;
+    buf[0] = c->segs[c->seg].fromTicks;
+    *refresh = run - 1;
+    c->pos += run;
+    settle(c);
+    return 1;
+  }
+
+  // An explicit chunk ends before a flat run only once it is WAVE_FLAT_MIN
+  // periods long, the head of the flat run is folded in until then.
+  uint16_t n = 0;
+  while (n < max && !atEnd(c)) {
+    if (n >= WAVE_FLAT_MIN && flatRun(c) > 0) break;
+    buf[n++] = segValue(c->segs[c->seg], c->pos);
+    c->pos++;
+    settle(c);
+  }
+  return n;
+}
+
+uint32_t waveCountChunks(const WaveSegment *segs, uint8_t count, uint16_t max) {
+  WaveCursor c;
+  waveRewind(&c, segs, count);
+  uint32_t chunks = 0;
+  uint16_t scratch[PWM_STREAM_VALUES];
+  uint32_t refresh;
+  if (max > PWM_STREAM_VALUES) max = PWM_STREAM_VALUES;
+  while (waveNextChunk(&c, scratch, max, &refresh) > 0) {
+    chunks++;
+  }
+  return chunks;
+}
+
+uint32_t waveCycles(const WaveSegment *segs, uint8_t count) {
+  uint32_t cycles = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    cycles += segs[i].cycles;
+  }
+  return cycles;
+}
+
+static uint16_t fillFromCursor(uint16_t *buf, uint16_t max, uint32_t *refresh) {
+  return waveNextChunk(&play_cursor, buf, max, refresh);
+}
+
+int wavePlay(const WaveSegment *segs, uint8_t count, uint16_t countertop, int pin, pwm_done_t done,
+             pwm_start_t started) {
+  if (count == 0 || count > WAVE_MAX_SEGMENTS || hwPWMBusy()) return 0;
+  uint32_t chunks = waveCountChunks(segs, count, PWM_STREAM_VALUES);
+  if (chunks == 0) return 0;
+  waveRewind(&play_cursor, segs, count);
+  return hwPWMStream(chunks, countertop, pin, fillFromCursor, done, started);
+}